@@ -0,0 +1,415 @@
+#include "cpu/opcodes.h"
+
+#include <time.h>
+
+// each opcode runs as a straight-line block of copies of itself, ended by an
+// unknown opcode so mos6502_run returns and the block can start over
+#define BENCH_CODE 0x8000
+#define BENCH_COPIES 1024
+#define BENCH_END 0x02
+
+// operands: zero page $40 and absolute $0300, every zero page pointer leads
+// to $0303, branches jump to the next instruction either way
+#define BENCH_ZERO_PAGE 0x40
+#define BENCH_ABSOLUTE 0x0300
+#define BENCH_POINTER 0x03
+
+#define BENCH_CORES 3
+
+typedef struct bench_options
+{
+    int trials;
+    int warmup;
+    int passes;
+    int cores[BENCH_CORES];
+    const char *output;
+} bench_options_t;
+
+typedef struct bench_result
+{
+    double ns_median;
+    double ns_p99;
+    double cycles_per_instruction;
+} bench_result_t;
+
+typedef struct bench_opcode
+{
+    uint8_t opcode;
+    const char *name;
+} bench_opcode_t;
+
+#define BENCH_OPCODE(opcode, name, ...) {opcode, #name},
+
+static const bench_opcode_t bench_opcodes[] = {MOS6502_OPCODES(BENCH_OPCODE)};
+
+static const char *bench_core_names[BENCH_CORES] = {"interp", "predecode", "jit"};
+
+static uint8_t bench_memory[65536];
+static mos6502_page_map_t bench_pages;
+
+static uint8_t bench_read(mos6502_t *cpu, uint16_t address)
+{
+    return bench_memory[address];
+}
+
+static void bench_write(mos6502_t *cpu, uint16_t address, uint8_t value)
+{
+    bench_memory[address] = value;
+}
+
+static double bench_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+// brk, rti, rts and jmp (indirect) leave the block, they cannot be measured this way
+static int bench_supported(uint8_t opcode)
+{
+    return opcode != 0x00 && opcode != 0x40 && opcode != 0x60 && opcode != 0x6C;
+}
+
+static void bench_load(uint8_t opcode)
+{
+    memset(bench_memory, 0, sizeof(bench_memory));
+    memset(bench_memory, BENCH_POINTER, 256);
+
+    uint16_t address = BENCH_CODE;
+    int length = mos6502_opcode_length[opcode];
+    mos6502_mode_t mode = mos6502_opcode_mode(opcode);
+    for (int i = 0; i < BENCH_COPIES; i++)
+    {
+        uint16_t next = address + length;
+        bench_memory[address] = opcode;
+        if (mode == MOS6502_MODE_RELATIVE)
+        {
+            bench_memory[address + 1] = 0x00;
+        }
+        else if (length == 2)
+        {
+            bench_memory[address + 1] = BENCH_ZERO_PAGE;
+        }
+        else if (length == 3)
+        {
+            // jmp and jsr go on with the next copy
+            uint16_t target = opcode == 0x4C || opcode == 0x20 ? next : BENCH_ABSOLUTE;
+            bench_memory[address + 1] = target & 0xFF;
+            bench_memory[address + 2] = target >> 8;
+        }
+        address = next;
+    }
+    bench_memory[address] = BENCH_END;
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double bench_percentile(const double *sorted, int count, int percent)
+{
+    int index = (count * percent + 99) / 100 - 1;
+    return sorted[index < 0 ? 0 : index];
+}
+
+static int bench_enable(mos6502_t *cpu, int core)
+{
+    switch (core)
+    {
+    case 1:
+        return mos6502_predecode_enable(cpu);
+    case 2:
+        return mos6502_jit_enable(cpu, 1);
+    }
+    return 0;
+}
+
+static int bench_opcode(const bench_options_t *options, uint8_t opcode, int core, bench_result_t *result)
+{
+    bench_load(opcode);
+
+    mos6502_t cpu;
+    mos6502_init(&cpu);
+    cpu.read = bench_read;
+    cpu.write = bench_write;
+    cpu.pages = &bench_pages;
+    cpu.rst = 0;
+    if (bench_enable(&cpu, core))
+    {
+        return -1;
+    }
+
+    double *samples = malloc(options->trials * sizeof(double));
+    if (!samples)
+    {
+        return -1;
+    }
+
+    uint64_t cycles = 0;
+    uint64_t instructions = (uint64_t)options->trials * options->passes * BENCH_COPIES;
+    for (int trial = -options->warmup; trial < options->trials; trial++)
+    {
+        uint64_t start_cycles = cpu.cycles;
+        double start = bench_now();
+        for (int pass = 0; pass < options->passes; pass++)
+        {
+            cpu.pc = BENCH_CODE;
+            mos6502_run(&cpu, UINT64_MAX / 2, NULL);
+        }
+        double elapsed = bench_now() - start;
+
+        if (trial >= 0)
+        {
+            samples[trial] = elapsed / ((double)options->passes * BENCH_COPIES);
+            cycles += cpu.cycles - start_cycles;
+        }
+    }
+
+    mos6502_jit_disable(&cpu);
+    mos6502_predecode_disable(&cpu);
+
+    qsort(samples, options->trials, sizeof(double), bench_compare);
+    result->ns_median = bench_percentile(samples, options->trials, 50);
+    result->ns_p99 = bench_percentile(samples, options->trials, 99);
+    result->cycles_per_instruction = (double)cycles / instructions;
+    free(samples);
+    return 0;
+}
+
+// the lanes executor on the lanes test program, as instructions per second
+// over every lane
+static double bench_lanes(const bench_options_t *options, int count)
+{
+    static const uint8_t program[] = {0xA5, 0x10, 0x29, 0x0F, 0xAA, 0x38, 0x25, 0x11,
+                                      0x8D, 0x00, 0x02, 0xA6, 0x10, 0xA8, 0x84, 0x12};
+    mos6502_lanes_t lanes;
+    if (mos6502_lanes_init(&lanes, count))
+    {
+        return 0;
+    }
+
+    for (int lane = 0; lane < count; lane++)
+    {
+        uint16_t address = BENCH_CODE;
+        for (int i = 0; i < BENCH_COPIES / 8; i++)
+        {
+            for (int j = 0; j < (int)sizeof(program); j++)
+            {
+                mos6502_lanes_write8(&lanes, lane, address++, program[j]);
+            }
+        }
+        mos6502_lanes_write8(&lanes, lane, address, BENCH_END);
+        mos6502_lanes_write8(&lanes, lane, 0x0010, lane);
+        mos6502_lanes_write8(&lanes, lane, 0x0011, 0x3C);
+    }
+
+    double *samples = malloc(options->trials * sizeof(double));
+    if (!samples)
+    {
+        mos6502_lanes_free(&lanes);
+        return 0;
+    }
+
+    for (int trial = -options->warmup; trial < options->trials; trial++)
+    {
+        uint64_t instructions = lanes.instructions;
+        double start = bench_now();
+        for (int lane = 0; lane < count; lane++)
+        {
+            lanes.pc[lane] = BENCH_CODE;
+            lanes.cycles[lane] = 0;
+            lanes.stop[lane] = -1;
+        }
+        mos6502_lanes_run(&lanes, UINT64_MAX / 2);
+        double elapsed = bench_now() - start;
+
+        if (trial >= 0)
+        {
+            samples[trial] = (lanes.instructions - instructions) / elapsed * 1e9;
+        }
+    }
+
+    qsort(samples, options->trials, sizeof(double), bench_compare);
+    double median = bench_percentile(samples, options->trials, 50);
+    free(samples);
+    mos6502_lanes_free(&lanes);
+    return median;
+}
+
+static void bench_usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [--quick] [--trials N] [--core interp|predecode|jit] [--output FILE]\n", name);
+}
+
+static int bench_parse(bench_options_t *options, int argc, char **argv)
+{
+    int selected = 0;
+
+    options->trials = 101;
+    options->warmup = 5;
+    options->passes = 8;
+    options->output = "bench_output.txt";
+    for (int core = 0; core < BENCH_CORES; core++)
+    {
+        options->cores[core] = 1;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--quick"))
+        {
+            options->trials = 21;
+            options->warmup = 2;
+            options->passes = 2;
+        }
+        else if (!strcmp(argv[i], "--trials") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+        {
+            options->trials = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--output") && i + 1 < argc)
+        {
+            options->output = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--core") && i + 1 < argc)
+        {
+            i++;
+            if (!selected)
+            {
+                memset(options->cores, 0, sizeof(options->cores));
+                selected = 1;
+            }
+            int core = 0;
+            while (core < BENCH_CORES && strcmp(argv[i], bench_core_names[core]))
+            {
+                core++;
+            }
+            if (core == BENCH_CORES)
+            {
+                return -1;
+            }
+            options->cores[core] = 1;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options;
+    if (bench_parse(&options, argc, argv))
+    {
+        bench_usage(argv[0]);
+        return 2;
+    }
+
+    FILE *output = fopen(options.output, "w");
+    if (!output)
+    {
+        perror(options.output);
+        return 1;
+    }
+
+    mos6502_map_init(&bench_pages);
+    mos6502_map_pages(&bench_pages, 0x00, 256, bench_memory, 0);
+
+    // one tab separated record per line, the first field names the record
+    fprintf(output, "build");
+#ifdef MOS6502_SWITCH_CORE
+    fprintf(output, "\tswitch_core");
+#endif
+#ifdef MOS6502_LAZY_FLAGS
+    fprintf(output, "\tlazy_flags");
+#endif
+#ifdef MOS6502_NO_COMPUTED_GOTO
+    fprintf(output, "\tno_computed_goto");
+#endif
+#ifdef MOS6502_STATS
+    fprintf(output, "\tstats");
+#endif
+    fprintf(output, "\n");
+    fprintf(output, "#opcode\tcore\topcode\tname\tmode\tcycles\tns_median\tns_p99\tmhz_median\tmhz_p99\n");
+    fprintf(output, "#mode\tcore\tmode\topcodes\tns_median\tmhz_median\n");
+    fprintf(output, "#lanes\tlanes\tips_median\n");
+
+    int count = sizeof(bench_opcodes) / sizeof(bench_opcodes[0]);
+    printf("%-10s %-24s %-12s %6s %9s %9s %9s %9s\n", "core", "opcode", "mode", "cycles", "ns/instr", "p99", "MHz",
+           "p99 MHz");
+
+    for (int core = 0; core < BENCH_CORES; core++)
+    {
+        if (!options.cores[core])
+        {
+            continue;
+        }
+
+        // per addressing mode: mean of the opcode medians
+        const char *modes[MOS6502_MODES];
+        double mode_ns[MOS6502_MODES];
+        double mode_cycles[MOS6502_MODES];
+        int mode_opcodes[MOS6502_MODES];
+        int mode_count = 0;
+
+        for (int i = 0; i < count; i++)
+        {
+            const bench_opcode_t *opcode = &bench_opcodes[i];
+            bench_result_t result;
+            if (!bench_supported(opcode->opcode) || bench_opcode(&options, opcode->opcode, core, &result))
+            {
+                continue;
+            }
+
+            const char *mode = mos6502_mode_names[mos6502_opcode_mode(opcode->opcode)];
+            double mhz = result.cycles_per_instruction * 1000 / result.ns_median;
+            double mhz_p99 = result.cycles_per_instruction * 1000 / result.ns_p99;
+            printf("%-10s %-24s %-12s %6.2f %9.3f %9.3f %9.1f %9.1f\n", bench_core_names[core], opcode->name, mode,
+                   result.cycles_per_instruction, result.ns_median, result.ns_p99, mhz, mhz_p99);
+            fprintf(output, "opcode\t%s\t0x%02X\t%s\t%s\t%.2f\t%.4f\t%.4f\t%.2f\t%.2f\n", bench_core_names[core],
+                    opcode->opcode, opcode->name, mode, result.cycles_per_instruction, result.ns_median,
+                    result.ns_p99, mhz, mhz_p99);
+
+            int m = 0;
+            while (m < mode_count && strcmp(modes[m], mode))
+            {
+                m++;
+            }
+            if (m == mode_count)
+            {
+                modes[m] = mode;
+                mode_ns[m] = mode_cycles[m] = 0;
+                mode_opcodes[m] = 0;
+                mode_count++;
+            }
+            mode_ns[m] += result.ns_median;
+            mode_cycles[m] += result.cycles_per_instruction;
+            mode_opcodes[m]++;
+        }
+
+        for (int m = 0; m < mode_count; m++)
+        {
+            double ns = mode_ns[m] / mode_opcodes[m];
+            double mhz = mode_cycles[m] / mode_opcodes[m] * 1000 / ns;
+            printf("%-10s %-24s %-12s %6s %9.3f %9s %9.1f\n", bench_core_names[core], "(mode mean)", modes[m], "", ns,
+                   "", mhz);
+            fprintf(output, "mode\t%s\t%s\t%d\t%.4f\t%.2f\n", bench_core_names[core], modes[m], mode_opcodes[m], ns,
+                    mhz);
+        }
+    }
+
+    static const int lane_counts[] = {1, 64, 1024};
+    for (int i = 0; i < (int)(sizeof(lane_counts) / sizeof(lane_counts[0])); i++)
+    {
+        double ips = bench_lanes(&options, lane_counts[i]);
+        printf("lanes %-5d %.1f M instructions/s\n", lane_counts[i], ips / 1e6);
+        fprintf(output, "lanes\t%d\t%.0f\n", lane_counts[i], ips);
+    }
+
+    fclose(output);
+    return 0;
+}
@@ -1,15 +1,4 @@
-#include "mos6502.h"
-
-static int clc(mos6502_t *cpu)
-{
-    mos6502_set_flag(cpu, CARRY, 0);
-    return 2;
-}
-
-void mos6502_register_clc(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0x18, clc);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
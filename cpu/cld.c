@@ -1,15 +1,4 @@
-#include "mos6502.h"
-
-static int cld(mos6502_t *cpu)
-{
-    mos6502_set_flag(cpu, DECIMAL, 0);
-    return 2;
-}
-
-void mos6502_register_cld(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0xD8, cld);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
@@ -1,15 +1,4 @@
-#include "mos6502.h"
-
-static int clv(mos6502_t *cpu)
-{  
-    mos6502_set_flag(cpu, OVERFLOW, 0);
-    return 2;
-}
-
-void mos6502_register_clv(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0xB8, clv);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
@@ -1,111 +1,182 @@
-#include "mos6502.h"
+#include "opcodes.h"
 
 int mos6502_init(mos6502_t *cpu)
 {
     memset(cpu, 0, sizeof(mos6502_t));
 
-    mos6502_register_lda(cpu);
-
-    mos6502_register_stx(cpu);
-
-    mos6502_register_ldx(cpu);
-    mos6502_register_txa(cpu);
-    mos6502_register_tya(cpu);
-    mos6502_register_sta(cpu);
-    mos6502_register_and(cpu);
-    mos6502_register_nop(cpu);
-    mos6502_register_clc(cpu);
-    mos6502_register_cld(cpu);
-    mos6502_register_tax(cpu);
-    mos6502_register_tay(cpu);
-
-    mos6502_register_lsr(cpu);
-    mos6502_register_sec(cpu);
-    mos6502_register_sed(cpu);
-
-	mos6502_register_clv(cpu);
-    mos6502_register_sty(cpu);
-
-
+    cpu->pages = &mos6502_unmapped;
+    cpu->opcodes = mos6502_opcodes;
 
     cpu->rst = 1;
     cpu->rdy = 1;
 
+    mos6502_flags_load(cpu);
+    mos6502_decimal_init();
+
     return 0;
 }
 
-void mos6502_set_flag(mos6502_t *cpu, int flag, int value)
+static void mos6502_reset(mos6502_t *cpu)
 {
-    if (value)
-    {
-        cpu->flags |= flag;
-    }
-    else
+    if (cpu->rst)
     {
-        cpu->flags &= ~flag;
+        cpu->pc = mos6502_read16(cpu, 0xFFFC);
+        cpu->rst = 0;
     }
 }
 
-int mos6502_get_flag(mos6502_t *cpu, int flag)
+// fire the events due, then log or replay what they did to the lines
+static void mos6502_events_due(mos6502_t *cpu)
 {
-    return (cpu->flags & flag) != 0;
+    mos6502_events_fire(cpu);
+    if (cpu->replay)
+    {
+        mos6502_replay_sync(cpu, MOS6502_REPLAY_EVENTS);
+    }
 }
 
-uint8_t mos6502_read8(mos6502_t *cpu, uint16_t address)
+int mos6502_tick(mos6502_t *cpu)
 {
-    return cpu->read(cpu, address);
-}
+    if (cpu->replay)
+    {
+        mos6502_replay_sync(cpu, MOS6502_REPLAY_HOST);
+    }
+    mos6502_reset(cpu);
 
-void mos6502_write8(mos6502_t *cpu, uint16_t address, uint8_t value)
-{
-    cpu->write(cpu, address, value);
-}
+    if (!cpu->rdy)
+    {
+        return 0;
+    }
 
-uint16_t mos6502_read16(mos6502_t *cpu, uint16_t address)
-{
-    uint16_t low = (uint16_t)mos6502_read8(cpu, address);
-    uint16_t high = (uint16_t)mos6502_read8(cpu, address + 1);
-    return (high << 8) | low;
+    uint8_t opcode = mos6502_read8(cpu, cpu->pc++);
+    int ticks = -1;
+
+    if (cpu->trace)
+    {
+        mos6502_trace_instruction(cpu, cpu->pc - 1, opcode);
+    }
+
+    mos6502_flags_load(cpu);
+
+#ifdef MOS6502_SWITCH_CORE
+    if (cpu->opcodes == mos6502_opcodes)
+    {
+        ticks = mos6502_execute_inline(cpu, opcode);
+    }
+    else
+#endif
+    if (cpu->opcodes[opcode])
+    {
+        ticks = cpu->opcodes[opcode](cpu);
+    }
+
+    mos6502_flags_sync(cpu);
+
+    if (ticks >= 0)
+    {
+        cpu->cycles += ticks;
+        mos6502_stats_instruction(cpu, opcode, ticks);
+        mos6502_events_due(cpu);
+    }
+    else if (cpu->trace && cpu->trace->fault)
+    {
+        mos6502_trace_dump(cpu, cpu->trace->fault);
+    }
+    return ticks;
 }
 
-void mos6502_write16(mos6502_t *cpu, uint16_t address, uint16_t value)
+static int mos6502_run_table(mos6502_t *cpu)
 {
-    uint8_t low = (uint8_t)(value & 0xFF);
-    uint8_t high = (uint8_t)((value >> 8) & 0xFF);
-    mos6502_write8(cpu, address, low);
-    mos6502_write8(cpu, address + 1, high);
+    const mos6502_opcode_t *opcodes = cpu->opcodes;
+
+    while (cpu->cycles < cpu->end)
+    {
+        int reason = mos6502_lines_stop(cpu);
+        if (reason >= 0)
+        {
+            return reason;
+        }
+
+        uint8_t opcode = mos6502_read8(cpu, cpu->pc++);
+        mos6502_opcode_t handler = opcodes[opcode];
+        if (!handler)
+        {
+            return MOS6502_STOP_UNKNOWN_OPCODE;
+        }
+
+        cpu->cycles += handler(cpu);
+    }
+
+    return MOS6502_STOP_BUDGET;
 }
 
-int mos6502_tick(mos6502_t *cpu)
+// the core mos6502_run uses for the current configuration
+static int mos6502_run_core(mos6502_t *cpu)
 {
-    if (cpu->rst)
+    if (cpu->debug && mos6502_debug_armed(cpu))
     {
-        cpu->pc = mos6502_read16(cpu, 0xFFFC);
-        cpu->rst = 0;
+        return mos6502_debug_run(cpu);
     }
-
-    if (!cpu->rdy)
+    if (cpu->trace)
     {
-        return 0;
+        return mos6502_trace_run(cpu);
     }
-
-    uint8_t opcode = mos6502_read8(cpu, cpu->pc++);
-    if (!cpu->opcodes[opcode])
+#ifdef MOS6502_STATS
+    if (cpu->stats)
     {
-        return -1;
+        return mos6502_stats_run(cpu);
     }
-
-    return cpu->opcodes[opcode](cpu);
+#endif
+    if (cpu->jit)
+    {
+        return mos6502_jit_run(cpu);
+    }
+    if (cpu->predecode)
+    {
+        return mos6502_predecode_run(cpu);
+    }
+#if defined(MOS6502_SWITCH_CORE) && defined(MOS6502_COMPUTED_GOTO)
+    if (cpu->opcodes == mos6502_opcodes)
+    {
+        return mos6502_run_inline(cpu);
+    }
+#endif
+    return mos6502_run_table(cpu);
 }
 
-void mos6502_register_opcode(mos6502_t *cpu, uint8_t opcode, int (*func)(mos6502_t *cpu))
+int mos6502_run(mos6502_t *cpu, uint64_t cycle_budget, uint64_t *cycles)
 {
-    if (cpu->opcodes[opcode])
+    uint64_t start = cpu->cycles;
+    // a budget of UINT64_MAX runs until something else stops the cpu
+    uint64_t end = cycle_budget > UINT64_MAX - start ? UINT64_MAX : start + cycle_budget;
+    int reason;
+
+    if (cpu->replay)
     {
-        fprintf(stderr, "opcode %u already registered\n", opcode);
-        exit(1);
+        mos6502_replay_sync(cpu, MOS6502_REPLAY_HOST);
     }
-    cpu->opcodes[opcode] = func;
+    mos6502_reset(cpu);
+    mos6502_flags_load(cpu);
+    mos6502_events_due(cpu);
+
+    // the core runs uninterrupted up to the next event, the events due are
+    // fired between the slices
+    do
+    {
+        uint64_t next = mos6502_event_next(cpu);
+        cpu->end = next < end ? next : end;
+        reason = mos6502_run_core(cpu);
+        mos6502_events_due(cpu);
+    } while (reason == MOS6502_STOP_BUDGET && cpu->cycles < end);
+
+    mos6502_flags_sync(cpu);
+    cpu->end = 0;
+
+    if (cycles)
+    {
+        *cycles = cpu->cycles - start;
+    }
+    return reason;
 }
 
 #ifdef _TEST
@@ -125,14 +196,141 @@ static int test_write16(mos6502_t *cpu)
 
 static int test_tick(mos6502_t *cpu)
 {
+    mos6502_write8(cpu, 0x8000, 0xEA);
     int ticks = mos6502_tick(cpu);
     return cpu->pc == 0x8001;
 }
 
+static int test_opcodes_shared(mos6502_t *cpu)
+{
+    mos6502_t other;
+    mos6502_init(&other);
+    return cpu->opcodes == mos6502_opcodes && other.opcodes == mos6502_opcodes;
+}
+
+static int test_opcodes_variant(mos6502_t *cpu)
+{
+    static mos6502_opcode_t variant[256];
+    memcpy(variant, mos6502_opcodes, sizeof(variant));
+    variant[0xEA] = NULL;
+    cpu->opcodes = variant;
+    mos6502_write8(cpu, 0x8000, 0xEA);
+    int ticks = mos6502_tick(cpu);
+    return ticks == -1 && cpu->pc == 0x8001;
+}
+
+static int test_run_budget(mos6502_t *cpu)
+{
+    for (uint16_t address = 0x8000; address < 0x8010; address++)
+    {
+        mos6502_write8(cpu, address, 0xEA);
+    }
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 10, &cycles);
+    return reason == MOS6502_STOP_BUDGET && cycles == 10 && cpu->cycles == 10 && cpu->pc == 0x8005;
+}
+
+static int test_run_budget_overshoot(mos6502_t *cpu)
+{
+    for (uint16_t address = 0x8000; address < 0x8010; address += 2)
+    {
+        mos6502_write8(cpu, address, 0xA9);
+        mos6502_write8(cpu, address + 1, 0x01);
+    }
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 5, &cycles);
+    return reason == MOS6502_STOP_BUDGET && cycles == 6 && cpu->pc == 0x8006 && cpu->a == 0x01;
+}
+
+static int test_run_unknown_opcode(mos6502_t *cpu)
+{
+    mos6502_write8(cpu, 0x8000, 0xEA);
+    mos6502_write8(cpu, 0x8001, 0xEA);
+    mos6502_write8(cpu, 0x8002, 0x02);
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 100, &cycles);
+    return reason == MOS6502_STOP_UNKNOWN_OPCODE && cycles == 4 && cpu->pc == 0x8003;
+}
+
+static int test_run_unbounded(mos6502_t *cpu)
+{
+    // nop, nop, then an unknown opcode
+    mos6502_write8(cpu, 0x8000, 0xEA);
+    mos6502_write8(cpu, 0x8001, 0xEA);
+    mos6502_write8(cpu, 0x8002, 0x02);
+    mos6502_run(cpu, 2, NULL);
+
+    // start + budget would wrap around
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, UINT64_MAX, &cycles);
+    return reason == MOS6502_STOP_UNKNOWN_OPCODE && cycles == 2 && cpu->cycles == 4 && cpu->pc == 0x8003;
+}
+
+static int test_run_halt(mos6502_t *cpu)
+{
+    mos6502_write8(cpu, 0x8000, 0xEA);
+    cpu->rdy = 0;
+    uint64_t cycles = 1;
+    int reason = mos6502_run(cpu, 100, &cycles);
+    return reason == MOS6502_STOP_HALT && cycles == 0 && cpu->pc == 0x8000;
+}
+
+static int test_run_nmi(mos6502_t *cpu)
+{
+    mos6502_write8(cpu, 0x8000, 0xEA);
+    cpu->nmi = 1;
+    uint64_t cycles = 1;
+    int reason = mos6502_run(cpu, 100, &cycles);
+    return reason == MOS6502_STOP_INTERRUPT && cycles == 0 && cpu->pc == 0x8000;
+}
+
+static int test_run_interrupt_masked(mos6502_t *cpu)
+{
+    mos6502_write8(cpu, 0x8000, 0xEA);
+    mos6502_write8(cpu, 0x8001, 0xEA);
+    mos6502_set_flag(cpu, INTERRUPT, 1);
+    cpu->interrupt = 1;
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 4, &cycles);
+    return reason == MOS6502_STOP_BUDGET && cycles == 4 && cpu->pc == 0x8002;
+}
+
+static int test_flags_negative_and_zero(mos6502_t *cpu)
+{
+    mos6502_set_flag(cpu, NEGATIVE | ZERO, 1);
+    mos6502_write8(cpu, 0x8000, 0xEA);
+    int ticks = mos6502_tick(cpu);
+    return ticks == 2 && cpu->flags == (NEGATIVE | ZERO) && mos6502_get_flag(cpu, NEGATIVE) && mos6502_get_flag(cpu, ZERO);
+}
+
+static int test_flags_run_sync(mos6502_t *cpu)
+{
+    mos6502_set_flag(cpu, CARRY | DECIMAL, 1);
+    mos6502_write8(cpu, 0x8000, 0xA9);
+    mos6502_write8(cpu, 0x8001, 0x80);
+    mos6502_write8(cpu, 0x8002, 0x18);
+    mos6502_write8(cpu, 0x8003, 0xA2);
+    mos6502_write8(cpu, 0x8004, 0x00);
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 6, &cycles);
+    return reason == MOS6502_STOP_BUDGET && cycles == 6 && cpu->flags == (ZERO | DECIMAL);
+}
+
 void test_mos6502_core()
 {
     RUN_TEST(test_write8);
     RUN_TEST(test_write16);
     RUN_TEST(test_tick);
+    RUN_TEST(test_opcodes_shared);
+    RUN_TEST(test_opcodes_variant);
+    RUN_TEST(test_run_budget);
+    RUN_TEST(test_run_budget_overshoot);
+    RUN_TEST(test_run_unknown_opcode);
+    RUN_TEST(test_run_unbounded);
+    RUN_TEST(test_run_halt);
+    RUN_TEST(test_run_nmi);
+    RUN_TEST(test_run_interrupt_masked);
+    RUN_TEST(test_flags_negative_and_zero);
+    RUN_TEST(test_flags_run_sync);
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,334 @@
+#include "mos6502.h"
+
+#include <stdatomic.h>
+
+typedef struct mos6502_cow_page
+{
+    // cpus mapping the page, it is writable in place only while this is 1
+    atomic_int references;
+    uint8_t data[256];
+} mos6502_cow_page_t;
+
+typedef struct mos6502_cow
+{
+    mos6502_page_map_t map;
+    mos6502_cow_page_t *pages[256];
+
+    // what mos6502_cow_init replaced, put back by mos6502_cow_free
+    const mos6502_page_map_t *previous_pages;
+    void (*previous_write)(struct mos6502 *cpu, uint16_t address, uint8_t value);
+
+    // writes lost to failed page copies
+    uint64_t dropped;
+} mos6502_cow_t;
+
+static void mos6502_cow_release(mos6502_cow_page_t *page)
+{
+    if (atomic_fetch_sub(&page->references, 1) == 1)
+    {
+        free(page);
+    }
+}
+
+// the jit, the predecode cache and the debugger keep their own copy of the page map
+static void mos6502_cow_remapped(mos6502_t *cpu)
+{
+    mos6502_jit_flush(cpu);
+    mos6502_predecode_flush(cpu);
+    mos6502_debug_flush(cpu);
+}
+
+// a copy only moves one page, the code translated or decoded elsewhere stays
+static void mos6502_cow_copied(mos6502_t *cpu, uint8_t page)
+{
+    mos6502_jit_flush_page(cpu, page);
+    mos6502_predecode_flush_page(cpu, page);
+    mos6502_debug_flush_page(cpu, page);
+}
+
+// only reached for pages without a write pointer, i.e. shared ones
+static void mos6502_cow_write(mos6502_t *cpu, uint16_t address, uint8_t value)
+{
+    mos6502_cow_t *cow = cpu->cow;
+    uint8_t page = address >> 8;
+    mos6502_cow_page_t *shared = cow->pages[page];
+    int copied = 0;
+
+    if (atomic_load(&shared->references) > 1)
+    {
+        mos6502_cow_page_t *copy = malloc(sizeof(mos6502_cow_page_t));
+        if (!copy)
+        {
+            // out of memory, the write is lost
+            cow->dropped++;
+            return;
+        }
+        atomic_init(&copy->references, 1);
+        memcpy(copy->data, shared->data, sizeof(copy->data));
+
+        cow->pages[page] = copy;
+        cow->map.read[page] = copy->data;
+        mos6502_cow_release(shared);
+        copied = 1;
+    }
+
+    // the last sharer left, the page is ours
+    cow->map.write[page] = cow->pages[page]->data;
+    cow->pages[page]->data[address & 0xFF] = value;
+
+    if (copied)
+    {
+        mos6502_cow_copied(cpu, page);
+    }
+}
+
+int mos6502_cow_init(mos6502_t *cpu)
+{
+    if (cpu->cow || cpu->jit || cpu->predecode || cpu->debug)
+    {
+        return -1;
+    }
+
+    mos6502_cow_t *cow = calloc(1, sizeof(mos6502_cow_t));
+    mos6502_cow_page_t *zero = calloc(1, sizeof(mos6502_cow_page_t));
+    if (!cow || !zero)
+    {
+        free(cow);
+        free(zero);
+        return -1;
+    }
+
+    // every page starts as the same zeroed page
+    atomic_init(&zero->references, 256);
+    for (int page = 0; page < 256; page++)
+    {
+        cow->pages[page] = zero;
+        cow->map.read[page] = zero->data;
+    }
+
+    cow->previous_pages = cpu->pages;
+    cow->previous_write = cpu->write;
+    cpu->cow = cow;
+    cpu->pages = &cow->map;
+    cpu->write = mos6502_cow_write;
+    return 0;
+}
+
+int mos6502_cow_free(mos6502_t *cpu)
+{
+    mos6502_cow_t *cow = cpu->cow;
+    if (!cow)
+    {
+        return 0;
+    }
+    if (cpu->jit || cpu->predecode || cpu->debug)
+    {
+        return -1;
+    }
+
+    for (int page = 0; page < 256; page++)
+    {
+        mos6502_cow_release(cow->pages[page]);
+    }
+
+    cpu->pages = cow->previous_pages;
+    cpu->write = cow->previous_write;
+    cpu->cow = NULL;
+    free(cow);
+    return 0;
+}
+
+uint64_t mos6502_cow_dropped(const mos6502_t *cpu)
+{
+    return cpu->cow ? cpu->cow->dropped : 0;
+}
+
+int mos6502_fork(mos6502_t *child, mos6502_t *parent)
+{
+    mos6502_cow_t *source = parent->cow;
+    // the debugger has replaced parent's callbacks with its own
+    if (!source || parent->debug)
+    {
+        return -1;
+    }
+
+    mos6502_cow_t *cow = malloc(sizeof(mos6502_cow_t));
+    if (!cow)
+    {
+        return -1;
+    }
+
+    // both sides lose their write pointers until they copy or own the page again
+    mos6502_map_init(&cow->map);
+    for (int page = 0; page < 256; page++)
+    {
+        atomic_fetch_add(&source->pages[page]->references, 1);
+        cow->pages[page] = source->pages[page];
+        cow->map.read[page] = source->map.read[page];
+        source->map.write[page] = NULL;
+    }
+    cow->previous_pages = source->previous_pages;
+    cow->previous_write = source->previous_write;
+    cow->dropped = 0;
+
+    *child = *parent;
+    child->jit = NULL;
+    child->predecode = NULL;
+    child->stats = NULL;
+    child->trace = NULL;
+    child->events = NULL;
+    child->replay = NULL;
+    child->cow = cow;
+    child->pages = &cow->map;
+    child->write = mos6502_cow_write;
+
+    mos6502_cow_remapped(parent);
+    return 0;
+}
+
+#ifdef _TEST
+
+static int test_cow_zeroed(mos6502_t *cpu)
+{
+    if (mos6502_cow_init(cpu))
+    {
+        return 0;
+    }
+    mos6502_write8(cpu, 0x1234, 0x56);
+    int result = mos6502_read8(cpu, 0x1234) == 0x56 && mos6502_read8(cpu, 0x1235) == 0x00 &&
+                 mos6502_read8(cpu, 0x4321) == 0x00 && cpu->pages->read[0x12] != cpu->pages->read[0x43];
+    mos6502_cow_free(cpu);
+    return result;
+}
+
+static int test_cow_fork_isolation(mos6502_t *cpu)
+{
+    mos6502_t child;
+    if (mos6502_cow_init(cpu))
+    {
+        return 0;
+    }
+    mos6502_write8(cpu, 0x1234, 0x11);
+    if (mos6502_fork(&child, cpu))
+    {
+        mos6502_cow_free(cpu);
+        return 0;
+    }
+
+    mos6502_write8(&child, 0x1234, 0x22);
+    mos6502_write8(cpu, 0x2000, 0x33);
+    int result = mos6502_read8(cpu, 0x1234) == 0x11 && mos6502_read8(&child, 0x1234) == 0x22 &&
+                 mos6502_read8(cpu, 0x2000) == 0x33 && mos6502_read8(&child, 0x2000) == 0x00;
+
+    mos6502_cow_free(&child);
+    mos6502_cow_free(cpu);
+    return result;
+}
+
+static int test_cow_fork_shares_pages(mos6502_t *cpu)
+{
+    mos6502_t child;
+    if (mos6502_cow_init(cpu))
+    {
+        return 0;
+    }
+    mos6502_write8(cpu, 0x5000, 0x01);
+    mos6502_write8(cpu, 0x6000, 0x02);
+    if (mos6502_fork(&child, cpu))
+    {
+        mos6502_cow_free(cpu);
+        return 0;
+    }
+
+    // only the page written after the fork is copied
+    mos6502_write8(&child, 0x5001, 0x03);
+    int result = child.pages->read[0x60] == cpu->pages->read[0x60] &&
+                 child.pages->read[0x50] != cpu->pages->read[0x50] &&
+                 mos6502_read8(&child, 0x5000) == 0x01 && mos6502_read8(cpu, 0x5001) == 0x00;
+
+    // the parent freeing its memory leaves the child's intact
+    mos6502_cow_free(cpu);
+    result &= mos6502_read8(&child, 0x6000) == 0x02;
+    mos6502_cow_free(&child);
+    return result;
+}
+
+static int test_cow_fork_run(mos6502_t *cpu)
+{
+    mos6502_t child;
+    if (mos6502_cow_init(cpu))
+    {
+        return 0;
+    }
+    // lda $10, sta $11
+    mos6502_write8(cpu, 0x8000, 0xA5);
+    mos6502_write8(cpu, 0x8001, 0x10);
+    mos6502_write8(cpu, 0x8002, 0x85);
+    mos6502_write8(cpu, 0x8003, 0x11);
+    mos6502_write8(cpu, 0xFFFD, 0x80);
+    mos6502_write8(cpu, 0x0010, 0x44);
+    if (mos6502_fork(&child, cpu))
+    {
+        mos6502_cow_free(cpu);
+        return 0;
+    }
+    mos6502_write8(&child, 0x0010, 0x55);
+
+    uint64_t cycles = 0;
+    mos6502_run(cpu, 6, &cycles);
+    mos6502_run(&child, 6, NULL);
+    int result = cycles == 6 && cpu->a == 0x44 && child.a == 0x55 && child.pc == 0x8004 &&
+                 mos6502_read8(cpu, 0x0011) == 0x44 && mos6502_read8(&child, 0x0011) == 0x55;
+
+    mos6502_cow_free(&child);
+    mos6502_cow_free(cpu);
+    return result;
+}
+
+static int test_cow_fork_jit(mos6502_t *cpu)
+{
+    mos6502_t child;
+    if (mos6502_cow_init(cpu))
+    {
+        return 0;
+    }
+    // sta $11 translated with the page writable, then shared by the fork
+    mos6502_write8(cpu, 0x8000, 0x85);
+    mos6502_write8(cpu, 0x8001, 0x11);
+    mos6502_write8(cpu, 0x0011, 0x00);
+    if (mos6502_jit_enable(cpu, 1))
+    {
+        mos6502_cow_free(cpu);
+        return 1;
+    }
+    cpu->a = 0x77;
+    cpu->rst = 0;
+    cpu->pc = 0x8000;
+    mos6502_run(cpu, 3, NULL);
+    if (mos6502_fork(&child, cpu))
+    {
+        mos6502_jit_disable(cpu);
+        mos6502_cow_free(cpu);
+        return 0;
+    }
+
+    cpu->a = 0x88;
+    cpu->pc = 0x8000;
+    mos6502_run(cpu, 3, NULL);
+    int result = mos6502_read8(cpu, 0x0011) == 0x88 && mos6502_read8(&child, 0x0011) == 0x77;
+
+    mos6502_jit_disable(cpu);
+    mos6502_cow_free(&child);
+    mos6502_cow_free(cpu);
+    return result;
+}
+
+void test_mos6502_cow()
+{
+    RUN_TEST(test_cow_zeroed);
+    RUN_TEST(test_cow_fork_isolation);
+    RUN_TEST(test_cow_fork_shares_pages);
+    RUN_TEST(test_cow_fork_run);
+    RUN_TEST(test_cow_fork_jit);
+}
+#endif
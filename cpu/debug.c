@@ -0,0 +1,486 @@
+#include "opcodes.h"
+
+// bitmaps and per page counts are indexed by kind >> 1: execute, read, write
+#define MOS6502_DEBUG_KINDS 3
+
+typedef struct mos6502_debug_condition
+{
+    int kind;
+    uint16_t address;
+    mos6502_condition_t condition;
+    void *user;
+} mos6502_debug_condition_t;
+
+typedef struct mos6502_debug
+{
+    uint64_t breakpoints[MOS6502_DEBUG_KINDS][65536 / 64];
+    // breakpoints set in each page, watched pages are left out of the shadow map
+    uint16_t counts[MOS6502_DEBUG_KINDS][256];
+    // breakpoints set in total, mos6502_run only takes the debugging core when non zero
+    int armed;
+
+    // only searched on a hit
+    mos6502_debug_condition_t *conditions;
+    int condition_count;
+    int condition_capacity;
+
+    mos6502_breakpoint_hit_t hit;
+    int hit_valid;
+    // a watchpoint fired during the current instruction
+    int pending;
+    // the execute breakpoint that stopped the last run, not tested again on resume
+    int resume;
+    uint16_t resume_pc;
+
+    const mos6502_page_map_t *pages;
+    uint8_t (*read)(struct mos6502 *cpu, uint16_t address);
+    void (*write)(struct mos6502 *cpu, uint16_t address, uint8_t value);
+    mos6502_page_map_t shadow;
+} mos6502_debug_t;
+
+static inline int mos6502_debug_test(const mos6502_debug_t *debug, int index, uint16_t address)
+{
+    return (debug->breakpoints[index][address >> 6] >> (address & 63)) & 1;
+}
+
+static mos6502_debug_condition_t *mos6502_debug_find(mos6502_debug_t *debug, int kind, uint16_t address)
+{
+    for (int i = 0; i < debug->condition_count; i++)
+    {
+        if (debug->conditions[i].kind == kind && debug->conditions[i].address == address)
+        {
+            return &debug->conditions[i];
+        }
+    }
+    return NULL;
+}
+
+// a set bit was hit, check its condition and record the hit
+static int mos6502_debug_fire(mos6502_t *cpu, int kind, uint16_t address, uint8_t value)
+{
+    mos6502_debug_t *debug = cpu->debug;
+    const mos6502_debug_condition_t *condition = mos6502_debug_find(debug, kind, address);
+    if (condition && !condition->condition(cpu, address, value, condition->user))
+    {
+        return 0;
+    }
+
+    debug->hit.kind = kind;
+    debug->hit.address = address;
+    debug->hit.value = value;
+    debug->hit_valid = 1;
+    return 1;
+}
+
+static void mos6502_debug_map_page(mos6502_debug_t *debug, int page)
+{
+    debug->shadow.read[page] = debug->counts[1][page] ? NULL : debug->pages->read[page];
+    debug->shadow.write[page] = debug->counts[2][page] ? NULL : debug->pages->write[page];
+}
+
+// only reached for pages with a watchpoint (or without host memory)
+static uint8_t mos6502_debug_read(mos6502_t *cpu, uint16_t address)
+{
+    mos6502_debug_t *debug = cpu->debug;
+    const uint8_t *page = debug->pages->read[address >> 8];
+    uint8_t value = page ? page[address & 0xFF] : debug->read(cpu, address);
+
+    if (mos6502_debug_test(debug, 1, address) && mos6502_debug_fire(cpu, MOS6502_BREAK_READ, address, value))
+    {
+        debug->pending = 1;
+    }
+    return value;
+}
+
+static void mos6502_debug_write(mos6502_t *cpu, uint16_t address, uint8_t value)
+{
+    mos6502_debug_t *debug = cpu->debug;
+    if (mos6502_debug_test(debug, 2, address) && mos6502_debug_fire(cpu, MOS6502_BREAK_WRITE, address, value))
+    {
+        debug->pending = 1;
+    }
+
+    uint8_t *page = debug->pages->write[address >> 8];
+    if (page)
+    {
+        page[address & 0xFF] = value;
+        return;
+    }
+    debug->write(cpu, address, value);
+}
+
+int mos6502_debug_armed(const mos6502_t *cpu)
+{
+    return cpu->debug->armed;
+}
+
+int mos6502_debug_run(mos6502_t *cpu)
+{
+    mos6502_debug_t *debug = cpu->debug;
+    const mos6502_opcode_t *opcodes = cpu->opcodes;
+
+    debug->pending = 0;
+    debug->hit_valid = 0;
+
+    while (cpu->cycles < cpu->end)
+    {
+        int reason = mos6502_lines_stop(cpu);
+        if (reason >= 0)
+        {
+            return reason;
+        }
+
+        uint16_t pc = cpu->pc;
+        if (mos6502_debug_test(debug, 0, pc) && !(debug->resume && debug->resume_pc == pc))
+        {
+            const uint8_t *page = debug->pages->read[pc >> 8];
+            if (mos6502_debug_fire(cpu, MOS6502_BREAK_EXECUTE, pc, page ? page[pc & 0xFF] : 0))
+            {
+                debug->resume = 1;
+                debug->resume_pc = pc;
+                return MOS6502_STOP_BREAKPOINT;
+            }
+        }
+        debug->resume = 0;
+
+        uint8_t opcode = mos6502_read8(cpu, cpu->pc++);
+        if (cpu->trace)
+        {
+            mos6502_flags_sync(cpu);
+            mos6502_trace_instruction(cpu, pc, opcode);
+        }
+
+        mos6502_opcode_t handler = opcodes[opcode];
+        if (!handler)
+        {
+            if (cpu->trace && cpu->trace->fault)
+            {
+                mos6502_trace_dump(cpu, cpu->trace->fault);
+            }
+            return MOS6502_STOP_UNKNOWN_OPCODE;
+        }
+
+        int ticks = handler(cpu);
+        cpu->cycles += ticks;
+        mos6502_stats_instruction(cpu, opcode, ticks);
+
+        if (debug->pending)
+        {
+            debug->pending = 0;
+            return MOS6502_STOP_BREAKPOINT;
+        }
+    }
+
+    return MOS6502_STOP_BUDGET;
+}
+
+int mos6502_debug_enable(mos6502_t *cpu)
+{
+    if (cpu->debug)
+    {
+        return 0;
+    }
+    if (cpu->jit || cpu->predecode)
+    {
+        return -1;
+    }
+
+    mos6502_debug_t *debug = calloc(1, sizeof(mos6502_debug_t));
+    if (!debug)
+    {
+        return -1;
+    }
+
+    debug->pages = cpu->pages;
+    debug->read = cpu->read;
+    debug->write = cpu->write;
+    debug->shadow = *cpu->pages;
+
+    cpu->debug = debug;
+    cpu->pages = &debug->shadow;
+    cpu->read = mos6502_debug_read;
+    cpu->write = mos6502_debug_write;
+    return 0;
+}
+
+void mos6502_debug_disable(mos6502_t *cpu)
+{
+    mos6502_debug_t *debug = cpu->debug;
+    if (!debug)
+    {
+        return;
+    }
+
+    cpu->pages = debug->pages;
+    cpu->read = debug->read;
+    cpu->write = debug->write;
+    cpu->debug = NULL;
+    free(debug->conditions);
+    free(debug);
+}
+
+void mos6502_debug_flush(mos6502_t *cpu)
+{
+    mos6502_debug_t *debug = cpu->debug;
+    if (!debug)
+    {
+        return;
+    }
+
+    for (int page = 0; page < 256; page++)
+    {
+        mos6502_debug_map_page(debug, page);
+    }
+}
+
+void mos6502_debug_flush_page(mos6502_t *cpu, uint8_t page)
+{
+    mos6502_debug_t *debug = cpu->debug;
+    if (!debug)
+    {
+        return;
+    }
+
+    mos6502_debug_map_page(debug, page);
+}
+
+int mos6502_breakpoint_set(mos6502_t *cpu, int kinds, uint16_t address, mos6502_condition_t condition, void *user)
+{
+    mos6502_debug_t *debug = cpu->debug;
+    if (!debug)
+    {
+        return -1;
+    }
+
+    for (int index = 0; index < MOS6502_DEBUG_KINDS; index++)
+    {
+        int kind = 1 << index;
+        if (!(kinds & kind))
+        {
+            continue;
+        }
+
+        mos6502_debug_condition_t *entry = mos6502_debug_find(debug, kind, address);
+        if (condition && !entry)
+        {
+            if (debug->condition_count == debug->condition_capacity)
+            {
+                int capacity = debug->condition_capacity ? debug->condition_capacity * 2 : 8;
+                mos6502_debug_condition_t *grown = realloc(debug->conditions, capacity * sizeof(mos6502_debug_condition_t));
+                if (!grown)
+                {
+                    return -1;
+                }
+                debug->conditions = grown;
+                debug->condition_capacity = capacity;
+            }
+            entry = &debug->conditions[debug->condition_count++];
+        }
+        if (condition)
+        {
+            entry->kind = kind;
+            entry->address = address;
+            entry->condition = condition;
+            entry->user = user;
+        }
+        else if (entry)
+        {
+            *entry = debug->conditions[--debug->condition_count];
+        }
+
+        if (!mos6502_debug_test(debug, index, address))
+        {
+            debug->breakpoints[index][address >> 6] |= (uint64_t)1 << (address & 63);
+            debug->counts[index][address >> 8]++;
+            debug->armed++;
+            mos6502_debug_map_page(debug, address >> 8);
+        }
+    }
+    return 0;
+}
+
+void mos6502_breakpoint_clear(mos6502_t *cpu, int kinds, uint16_t address)
+{
+    mos6502_debug_t *debug = cpu->debug;
+    if (!debug)
+    {
+        return;
+    }
+
+    for (int index = 0; index < MOS6502_DEBUG_KINDS; index++)
+    {
+        int kind = 1 << index;
+        if (!(kinds & kind) || !mos6502_debug_test(debug, index, address))
+        {
+            continue;
+        }
+
+        mos6502_debug_condition_t *entry = mos6502_debug_find(debug, kind, address);
+        if (entry)
+        {
+            *entry = debug->conditions[--debug->condition_count];
+        }
+
+        debug->breakpoints[index][address >> 6] &= ~((uint64_t)1 << (address & 63));
+        debug->counts[index][address >> 8]--;
+        debug->armed--;
+        mos6502_debug_map_page(debug, address >> 8);
+    }
+}
+
+const mos6502_breakpoint_hit_t *mos6502_breakpoint_hit(const mos6502_t *cpu)
+{
+    return cpu->debug && cpu->debug->hit_valid ? &cpu->debug->hit : NULL;
+}
+
+#ifdef _TEST
+
+// lda #$01, ldx #$02, tax, sta $10, lda $20, nop, then an unknown opcode
+static const uint8_t test_debug_program[] = {0xA9, 0x01, 0xA2, 0x02, 0xAA, 0x85, 0x10, 0xA5, 0x20, 0xEA, 0x02};
+
+static int test_debug_load(mos6502_t *cpu)
+{
+    mos6502_test_program(cpu, test_debug_program, sizeof(test_debug_program));
+    mos6502_write8(cpu, 0x0020, 0x07);
+    return mos6502_debug_enable(cpu) == 0;
+}
+
+static int test_debug_a_is(mos6502_t *cpu, uint16_t address, uint8_t value, void *user)
+{
+    return cpu->a == *(uint8_t *)user;
+}
+
+static int test_debug_value_is(mos6502_t *cpu, uint16_t address, uint8_t value, void *user)
+{
+    return value == *(uint8_t *)user;
+}
+
+static int test_debug_execute(mos6502_t *cpu)
+{
+    if (!test_debug_load(cpu) || mos6502_breakpoint_set(cpu, MOS6502_BREAK_EXECUTE, 0x8004, NULL, NULL))
+    {
+        mos6502_debug_disable(cpu);
+        return 0;
+    }
+
+    // stops before tax, then resumes with it
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 100, &cycles);
+    const mos6502_breakpoint_hit_t *hit = mos6502_breakpoint_hit(cpu);
+    int result = reason == MOS6502_STOP_BREAKPOINT && cycles == 4 && cpu->pc == 0x8004 && cpu->x == 0x02 && hit &&
+                 hit->kind == MOS6502_BREAK_EXECUTE && hit->address == 0x8004 && hit->value == 0xAA;
+
+    reason = mos6502_run(cpu, 100, NULL);
+    result &= reason == MOS6502_STOP_UNKNOWN_OPCODE && cpu->x == 0x01 && mos6502_breakpoint_hit(cpu) == NULL;
+
+    mos6502_debug_disable(cpu);
+    return result && cpu->debug == NULL;
+}
+
+static int test_debug_condition(mos6502_t *cpu)
+{
+    uint8_t a = 0x05;
+    if (!test_debug_load(cpu) || mos6502_breakpoint_set(cpu, MOS6502_BREAK_EXECUTE, 0x8004, test_debug_a_is, &a))
+    {
+        mos6502_debug_disable(cpu);
+        return 0;
+    }
+
+    // a is 1 at tax, the condition keeps the breakpoint quiet
+    int result = mos6502_run(cpu, 100, NULL) == MOS6502_STOP_UNKNOWN_OPCODE;
+
+    // replacing the breakpoint without a condition drops the condition
+    cpu->pc = 0x8000;
+    mos6502_breakpoint_set(cpu, MOS6502_BREAK_EXECUTE, 0x8004, NULL, NULL);
+    result &= mos6502_run(cpu, 100, NULL) == MOS6502_STOP_BREAKPOINT && cpu->pc == 0x8004;
+
+    mos6502_debug_disable(cpu);
+    return result;
+}
+
+static int test_debug_watch(mos6502_t *cpu)
+{
+    uint8_t seven = 0x07;
+    if (!test_debug_load(cpu) || mos6502_breakpoint_set(cpu, MOS6502_BREAK_WRITE, 0x0010, NULL, NULL) ||
+        mos6502_breakpoint_set(cpu, MOS6502_BREAK_READ, 0x0020, test_debug_value_is, &seven))
+    {
+        mos6502_debug_disable(cpu);
+        return 0;
+    }
+
+    // only the watched page leaves the map, the code page stays direct
+    int result = cpu->pages->read[0x00] == NULL && cpu->pages->write[0x00] == NULL && cpu->pages->read[0x80] != NULL;
+
+    // stops after sta $10 has written, then after lda $20
+    int reason = mos6502_run(cpu, 100, NULL);
+    const mos6502_breakpoint_hit_t *hit = mos6502_breakpoint_hit(cpu);
+    result &= reason == MOS6502_STOP_BREAKPOINT && cpu->pc == 0x8007 && mos6502_read8(cpu, 0x0010) == 0x01 && hit &&
+              hit->kind == MOS6502_BREAK_WRITE && hit->address == 0x0010 && hit->value == 0x01;
+
+    reason = mos6502_run(cpu, 100, NULL);
+    hit = mos6502_breakpoint_hit(cpu);
+    result &= reason == MOS6502_STOP_BREAKPOINT && cpu->pc == 0x8009 && cpu->a == 0x07 && hit &&
+              hit->kind == MOS6502_BREAK_READ && hit->address == 0x0020;
+
+    // cleared, the page is mapped again and runs are not interrupted
+    mos6502_breakpoint_clear(cpu, MOS6502_BREAK_READ | MOS6502_BREAK_WRITE, 0x0010);
+    mos6502_breakpoint_clear(cpu, MOS6502_BREAK_READ, 0x0020);
+    result &= cpu->pages->read[0x00] != NULL && cpu->pages->write[0x00] != NULL && cpu->debug->armed == 0;
+    cpu->pc = 0x8000;
+    result &= mos6502_run(cpu, 100, NULL) == MOS6502_STOP_UNKNOWN_OPCODE;
+
+    mos6502_debug_disable(cpu);
+    return result;
+}
+
+static int test_debug_exclusive(mos6502_t *cpu)
+{
+    if (!test_debug_load(cpu))
+    {
+        return 0;
+    }
+    int result = mos6502_jit_enable(cpu, 1) == -1 && mos6502_predecode_enable(cpu) == -1;
+    mos6502_debug_disable(cpu);
+
+    result &= mos6502_predecode_enable(cpu) == 0 && mos6502_debug_enable(cpu) == -1;
+    mos6502_predecode_disable(cpu);
+    return result;
+}
+
+static int test_debug_cow(mos6502_t *cpu)
+{
+    mos6502_t child;
+    if (mos6502_cow_init(cpu))
+    {
+        return 0;
+    }
+    mos6502_test_program(cpu, test_debug_program, sizeof(test_debug_program));
+    mos6502_write8(cpu, 0xFFFD, 0x80);
+    if (mos6502_fork(&child, cpu) || mos6502_debug_enable(cpu) ||
+        mos6502_breakpoint_set(cpu, MOS6502_BREAK_WRITE, 0x0010, NULL, NULL))
+    {
+        mos6502_debug_disable(cpu);
+        mos6502_cow_free(cpu);
+        return 0;
+    }
+
+    // the write copies the shared zero page under the debugger's map
+    int result = mos6502_fork(&child, cpu) == -1 && mos6502_run(cpu, 100, NULL) == MOS6502_STOP_BREAKPOINT &&
+                 mos6502_read8(cpu, 0x0010) == 0x01 && mos6502_read8(&child, 0x0010) == 0x00 &&
+                 cpu->pages->read[0x80] != NULL;
+
+    mos6502_debug_disable(cpu);
+    mos6502_cow_free(&child);
+    mos6502_cow_free(cpu);
+    return result;
+}
+
+void test_mos6502_debug()
+{
+    RUN_TEST(test_debug_execute);
+    RUN_TEST(test_debug_condition);
+    RUN_TEST(test_debug_watch);
+    RUN_TEST(test_debug_exclusive);
+    RUN_TEST(test_debug_cow);
+}
+#endif
@@ -0,0 +1,165 @@
+#include "opcodes.h"
+
+#include <pthread.h>
+
+uint16_t mos6502_decimal_adc[2][65536];
+uint16_t mos6502_decimal_sbc[2][65536];
+
+static uint16_t mos6502_decimal_entry(uint8_t result, int negative, int overflow, int zero, int carry)
+{
+    uint8_t flags = (negative ? NEGATIVE : 0) | (overflow ? OVERFLOW : 0) | (zero ? ZERO : 0) | (carry ? CARRY : 0);
+    return result | (flags << 8);
+}
+
+// NMOS: Z is the one of the binary sum, N and V are taken before the high digit
+// is adjusted
+static uint16_t mos6502_decimal_add(uint8_t a, uint8_t value, int carry)
+{
+    int low = (a & 0x0F) + (value & 0x0F) + carry;
+    if (low > 0x09)
+    {
+        low += 0x06;
+    }
+    int high = (a >> 4) + (value >> 4) + (low > 0x0F);
+    uint8_t partial = (high << 4) | (low & 0x0F);
+    if (high > 0x09)
+    {
+        high += 0x06;
+    }
+
+    return mos6502_decimal_entry((high << 4) | (low & 0x0F), partial & 0x80, ~(a ^ value) & (a ^ partial) & 0x80,
+                                 (uint8_t)(a + value + carry) == 0, high > 0x0F);
+}
+
+// NMOS: every flag is the one of the binary difference
+static uint16_t mos6502_decimal_subtract(uint8_t a, uint8_t value, int carry)
+{
+    int low = (a & 0x0F) - (value & 0x0F) - !carry;
+    int high = (a >> 4) - (value >> 4);
+    if (low & 0x10)
+    {
+        low -= 0x06;
+        high--;
+    }
+    if (high & 0x10)
+    {
+        high -= 0x06;
+    }
+
+    int difference = a - value - !carry;
+    return mos6502_decimal_entry(((high & 0x0F) << 4) | (low & 0x0F), difference & 0x80,
+                                 (a ^ value) & (a ^ difference) & 0x80, (uint8_t)difference == 0, difference >= 0);
+}
+
+static void mos6502_decimal_build(void)
+{
+    for (int carry = 0; carry < 2; carry++)
+    {
+        for (int index = 0; index < 65536; index++)
+        {
+            mos6502_decimal_adc[carry][index] = mos6502_decimal_add(index >> 8, index & 0xFF, carry);
+            mos6502_decimal_sbc[carry][index] = mos6502_decimal_subtract(index >> 8, index & 0xFF, carry);
+        }
+    }
+}
+
+void mos6502_decimal_init(void)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, mos6502_decimal_build);
+}
+
+#ifdef _TEST
+
+static int test_decimal_run(mos6502_t *cpu, uint8_t opcode, uint8_t a, uint8_t value, int carry)
+{
+    mos6502_write8(cpu, 0x8000, opcode);
+    mos6502_write8(cpu, 0x8001, value);
+    cpu->pc = 0x8000;
+    cpu->a = a;
+    cpu->flags = DECIMAL | (carry ? CARRY : 0);
+    return mos6502_tick(cpu);
+}
+
+static int test_decimal_adc(mos6502_t *cpu)
+{
+    // 58 + 46 + 1 = 105, then 12 + 34 = 46
+    int result = test_decimal_run(cpu, 0x69, 0x58, 0x46, 1) == 2 && cpu->a == 0x05 &&
+                 cpu->flags == (DECIMAL | NEGATIVE | OVERFLOW | CARRY);
+    result &= test_decimal_run(cpu, 0x69, 0x12, 0x34, 0) == 2 && cpu->a == 0x46 && cpu->flags == DECIMAL;
+    return result;
+}
+
+static int test_decimal_adc_zero(mos6502_t *cpu)
+{
+    // 99 + 1 wraps to 00, Z is the one of the binary $9A and N of the unadjusted $A0
+    return test_decimal_run(cpu, 0x69, 0x99, 0x01, 0) == 2 && cpu->a == 0x00 &&
+           cpu->flags == (DECIMAL | NEGATIVE | CARRY);
+}
+
+static int test_decimal_sbc(mos6502_t *cpu)
+{
+    // 46 - 12 = 34, then 12 - 21 borrows: 91
+    int result = test_decimal_run(cpu, 0xE9, 0x46, 0x12, 1) == 2 && cpu->a == 0x34 && cpu->flags == (DECIMAL | CARRY);
+    result &= test_decimal_run(cpu, 0xE9, 0x12, 0x21, 1) == 2 && cpu->a == 0x91 && cpu->flags == (DECIMAL | NEGATIVE);
+    return result;
+}
+
+static int test_decimal_sbc_zero(mos6502_t *cpu)
+{
+    // 46 - 46 = 00, then 40 - 39 - 1 = 00 without Z: the binary difference is $06
+    int result = test_decimal_run(cpu, 0xE9, 0x46, 0x46, 1) == 2 && cpu->a == 0x00 &&
+                 cpu->flags == (DECIMAL | ZERO | CARRY);
+    result &= test_decimal_run(cpu, 0xE9, 0x40, 0x39, 0) == 2 && cpu->a == 0x00 && cpu->flags == (DECIMAL | CARRY);
+    return result;
+}
+
+// every valid bcd operand pair against plain decimal arithmetic
+static int test_decimal_exhaustive(mos6502_t *cpu)
+{
+    mos6502_decimal_init();
+    int result = 1;
+    for (int carry = 0; carry < 2; carry++)
+    {
+        for (int a = 0; a < 100; a++)
+        {
+            for (int value = 0; value < 100; value++)
+            {
+                uint8_t a_bcd = (a / 10) << 4 | a % 10;
+                uint8_t value_bcd = (value / 10) << 4 | value % 10;
+                int sum = a + value + carry;
+                int difference = a - value - !carry;
+                uint16_t adc = mos6502_decimal_adc[carry][a_bcd << 8 | value_bcd];
+                uint16_t sbc = mos6502_decimal_sbc[carry][a_bcd << 8 | value_bcd];
+
+                result &= (adc & 0xFF) == ((sum % 100 / 10) << 4 | sum % 10) && !!(adc & (CARRY << 8)) == (sum > 99) &&
+                          !!(adc & (ZERO << 8)) == ((uint8_t)(a_bcd + value_bcd + carry) == 0);
+                difference = (difference + 100) % 100;
+                result &= (sbc & 0xFF) == ((difference / 10) << 4 | difference % 10) &&
+                          !!(sbc & (CARRY << 8)) == (a - value - !carry >= 0);
+            }
+        }
+    }
+    return result;
+}
+
+static int test_decimal_binary(mos6502_t *cpu)
+{
+    // without D the same opcodes stay binary
+    mos6502_write8(cpu, 0x8000, 0x69);
+    mos6502_write8(cpu, 0x8001, 0x09);
+    cpu->a = 0x09;
+    int ticks = mos6502_tick(cpu);
+    return ticks == 2 && cpu->a == 0x12 && cpu->flags == 0;
+}
+
+void test_mos6502_decimal()
+{
+    RUN_TEST(test_decimal_adc);
+    RUN_TEST(test_decimal_adc_zero);
+    RUN_TEST(test_decimal_sbc);
+    RUN_TEST(test_decimal_sbc_zero);
+    RUN_TEST(test_decimal_exhaustive);
+    RUN_TEST(test_decimal_binary);
+}
+#endif
\ No newline at end of file
@@ -1,17 +1,4 @@
-#include "mos6502.h"
-
-static int dex(mos6502_t *cpu)
-{
-    cpu->x--;
-    mos6502_set_flag(cpu, NEGATIVE, cpu->x & NEGATIVE);
-    mos6502_set_flag(cpu, ZERO, cpu->x == 0);
-    return 2;
-}
-
-void mos6502_register_dex(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0xCA, dex);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
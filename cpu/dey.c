@@ -1,17 +1,4 @@
-#include "mos6502.h"
-
-static int dey(mos6502_t *cpu)
-{
-    cpu->y--;
-    mos6502_set_flag(cpu, NEGATIVE, cpu->y & NEGATIVE);
-    mos6502_set_flag(cpu, ZERO, cpu->y == 0);
-    return 2;
-}
-
-void mos6502_register_dey(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0x88, dey);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
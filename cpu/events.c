@@ -0,0 +1,335 @@
+#include "opcodes.h"
+
+typedef struct mos6502_event_entry
+{
+    uint64_t cycle;
+    // scheduling order, so events due at the same cycle fire first come first served
+    uint64_t sequence;
+    mos6502_event_t event;
+    void *user;
+} mos6502_event_entry_t;
+
+// binary min-heap on (cycle, sequence), the next event is entries[0]
+typedef struct mos6502_events
+{
+    mos6502_event_entry_t *entries;
+    int count;
+    int capacity;
+    uint64_t sequence;
+} mos6502_events_t;
+
+static int mos6502_event_before(const mos6502_event_entry_t *a, const mos6502_event_entry_t *b)
+{
+    return a->cycle < b->cycle || (a->cycle == b->cycle && a->sequence < b->sequence);
+}
+
+static void mos6502_events_up(mos6502_events_t *events, int i)
+{
+    mos6502_event_entry_t entry = events->entries[i];
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (!mos6502_event_before(&entry, &events->entries[parent]))
+        {
+            break;
+        }
+        events->entries[i] = events->entries[parent];
+        i = parent;
+    }
+    events->entries[i] = entry;
+}
+
+static void mos6502_events_down(mos6502_events_t *events, int i)
+{
+    mos6502_event_entry_t entry = events->entries[i];
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= events->count)
+        {
+            break;
+        }
+        if (child + 1 < events->count && mos6502_event_before(&events->entries[child + 1], &events->entries[child]))
+        {
+            child++;
+        }
+        if (!mos6502_event_before(&events->entries[child], &entry))
+        {
+            break;
+        }
+        events->entries[i] = events->entries[child];
+        i = child;
+    }
+    events->entries[i] = entry;
+}
+
+int mos6502_event_schedule(mos6502_t *cpu, uint64_t cycle, mos6502_event_t event, void *user)
+{
+    mos6502_events_t *events = cpu->events;
+    if (!events)
+    {
+        events = calloc(1, sizeof(mos6502_events_t));
+        if (!events)
+        {
+            return -1;
+        }
+        cpu->events = events;
+    }
+
+    if (events->count == events->capacity)
+    {
+        int capacity = events->capacity ? events->capacity * 2 : 16;
+        mos6502_event_entry_t *entries = realloc(events->entries, capacity * sizeof(mos6502_event_entry_t));
+        if (!entries)
+        {
+            return -1;
+        }
+        events->entries = entries;
+        events->capacity = capacity;
+    }
+
+    mos6502_event_entry_t *entry = &events->entries[events->count];
+    entry->cycle = cycle;
+    entry->sequence = events->sequence++;
+    entry->event = event;
+    entry->user = user;
+    mos6502_events_up(events, events->count++);
+
+    // scheduled from a callback during mos6502_run: the core stops at it
+    if (cycle < cpu->end)
+    {
+        cpu->end = cycle;
+    }
+    return 0;
+}
+
+int mos6502_event_cancel(mos6502_t *cpu, mos6502_event_t event, void *user)
+{
+    mos6502_events_t *events = cpu->events;
+    if (!events)
+    {
+        return 0;
+    }
+
+    int kept = 0;
+    for (int i = 0; i < events->count; i++)
+    {
+        if (events->entries[i].event != event || events->entries[i].user != user)
+        {
+            events->entries[kept++] = events->entries[i];
+        }
+    }
+
+    int cancelled = events->count - kept;
+    events->count = kept;
+    if (cancelled)
+    {
+        for (int i = kept / 2 - 1; i >= 0; i--)
+        {
+            mos6502_events_down(events, i);
+        }
+    }
+    return cancelled;
+}
+
+uint64_t mos6502_event_next(const mos6502_t *cpu)
+{
+    const mos6502_events_t *events = cpu->events;
+    return events && events->count ? events->entries[0].cycle : UINT64_MAX;
+}
+
+void mos6502_events_free(mos6502_t *cpu)
+{
+    if (cpu->events)
+    {
+        free(cpu->events->entries);
+        free(cpu->events);
+        cpu->events = NULL;
+    }
+}
+
+void mos6502_events_fire(mos6502_t *cpu)
+{
+    mos6502_events_t *events = cpu->events;
+    if (!events || !events->count || events->entries[0].cycle > cpu->cycles)
+    {
+        return;
+    }
+
+    // the callbacks see the real flags and may change them
+    mos6502_flags_sync(cpu);
+    while (events->count && events->entries[0].cycle <= cpu->cycles)
+    {
+        // off the heap first, the callback may schedule or cancel events
+        mos6502_event_entry_t entry = events->entries[0];
+        events->entries[0] = events->entries[--events->count];
+        if (events->count)
+        {
+            mos6502_events_down(events, 0);
+        }
+        entry.event(cpu, entry.user);
+    }
+    mos6502_flags_load(cpu);
+}
+
+#ifdef _TEST
+
+typedef struct test_events_device
+{
+    int fired;
+    uint64_t cycles[8];
+    uint64_t next;
+    uint64_t period;
+} test_events_device_t;
+
+static void test_events_record(mos6502_t *cpu, void *user)
+{
+    test_events_device_t *device = user;
+    if (device->fired < 8)
+    {
+        device->cycles[device->fired] = cpu->cycles;
+    }
+    device->fired++;
+}
+
+static void test_events_timer(mos6502_t *cpu, void *user)
+{
+    test_events_device_t *device = user;
+    test_events_record(cpu, user);
+    device->next += device->period;
+    mos6502_event_schedule(cpu, device->next, test_events_timer, user);
+}
+
+static void test_events_irq(mos6502_t *cpu, void *user)
+{
+    cpu->interrupt = 1;
+}
+
+static int test_events_order(mos6502_t *cpu)
+{
+    test_events_device_t first = {0}, second = {0};
+    static const uint64_t deadlines[] = {40, 10, 30, 10, 20, 50, 30};
+    for (int i = 0; i < sizeof(deadlines) / sizeof(deadlines[0]); i++)
+    {
+        mos6502_event_schedule(cpu, deadlines[i], test_events_record, i & 1 ? &second : &first);
+    }
+
+    // nops: every deadline is an instruction boundary
+    for (uint16_t address = 0x8000; address < 0x8100; address++)
+    {
+        mos6502_write8(cpu, address, 0xEA);
+    }
+
+    int result = mos6502_event_next(cpu) == 10 && mos6502_run(cpu, 36, NULL) == MOS6502_STOP_BUDGET &&
+                 cpu->cycles == 36 && first.fired == 3 && second.fired == 2 && second.cycles[0] == 10 &&
+                 second.cycles[1] == 10 && first.cycles[0] == 20 && first.cycles[1] == 30 && first.cycles[2] == 30;
+
+    // cancelling the first device leaves the other one's
+    result &= mos6502_event_next(cpu) == 40 && mos6502_event_cancel(cpu, test_events_record, &first) == 1 &&
+              mos6502_event_next(cpu) == 50 && mos6502_run(cpu, 100, NULL) == MOS6502_STOP_BUDGET &&
+              first.fired == 3 && second.fired == 3 && second.cycles[2] == 50 && mos6502_event_next(cpu) == UINT64_MAX;
+
+    mos6502_events_free(cpu);
+    return result && cpu->events == NULL;
+}
+
+static int test_events_irq_line(mos6502_t *cpu)
+{
+    // nops: the run stops on the interrupt the device raises
+    for (uint16_t address = 0x8000; address < 0x8010; address++)
+    {
+        mos6502_write8(cpu, address, 0xEA);
+    }
+    mos6502_write8(cpu, 0x8010, 0x02);
+    mos6502_event_schedule(cpu, 8, test_events_irq, NULL);
+
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 100, &cycles);
+    int result = reason == MOS6502_STOP_INTERRUPT && cycles == 8 && cpu->pc == 0x8004 && cpu->interrupt;
+    mos6502_events_free(cpu);
+    return result;
+}
+
+static void test_events_device_write(mos6502_t *cpu, uint16_t address, uint8_t value)
+{
+    // starting a timer that expires during the run
+    mos6502_event_schedule(cpu, cpu->cycles + value, test_events_irq, NULL);
+}
+
+static int test_events_scheduled_by_device(mos6502_t *cpu)
+{
+    // lda #$02, sta $D000, then nops, with the timer register behind the callback
+    static const uint8_t program[] = {0xA9, 0x02, 0x8D, 0x00, 0xD0};
+    mos6502_page_map_t pages = *cpu->pages;
+    pages.write[0xD0] = NULL;
+    for (int i = 0; i < 64; i++)
+    {
+        mos6502_write8(cpu, 0x8000 + i, i < sizeof(program) ? program[i] : 0xEA);
+    }
+    cpu->pages = &pages;
+    cpu->write = test_events_device_write;
+
+    // the core stops at the new event, translated code included
+    int jit = mos6502_jit_enable(cpu, 1) == 0;
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 1000, &cycles);
+    int result = reason == MOS6502_STOP_INTERRUPT && cycles == 6 && cpu->pc == 0x8005;
+    if (jit)
+    {
+        mos6502_jit_disable(cpu);
+    }
+    mos6502_events_free(cpu);
+    return result;
+}
+
+static int test_events_idle_timer(mos6502_t *cpu)
+{
+    // bne * between timer ticks every 1000 cycles
+    mos6502_write8(cpu, 0x8000, 0xD0);
+    mos6502_write8(cpu, 0x8001, 0xFE);
+
+    test_events_device_t timer = {.next = 1000, .period = 1000};
+    mos6502_event_schedule(cpu, timer.next, test_events_timer, &timer);
+    if (mos6502_trace_enable(cpu, 4, NULL))
+    {
+        return 0;
+    }
+
+    // the loop is skipped up to each tick instead of running 3 cycles at a
+    // time, the ticks fire at the end of the branch reaching them
+    int reason = mos6502_run(cpu, 10000, NULL);
+    int result = reason == MOS6502_STOP_BUDGET && timer.fired == 10 && cpu->cycles == 10002 &&
+                 cpu->trace->count < 100 && mos6502_event_next(cpu) == 11000;
+    for (int i = 0; i < 8; i++)
+    {
+        result &= timer.cycles[i] >= (i + 1) * 1000 && timer.cycles[i] < (i + 1) * 1000 + 3;
+    }
+
+    mos6502_trace_disable(cpu);
+    mos6502_events_free(cpu);
+    return result;
+}
+
+static int test_events_tick(mos6502_t *cpu)
+{
+    test_events_device_t device = {0};
+    mos6502_write8(cpu, 0x8000, 0xA9);
+    mos6502_write8(cpu, 0x8002, 0xEA);
+    mos6502_event_schedule(cpu, 1, test_events_record, &device);
+
+    // due during the lda, fired once it completed
+    int result = mos6502_tick(cpu) == 2 && device.fired == 1 && device.cycles[0] == 2;
+    result &= mos6502_tick(cpu) == 2 && device.fired == 1;
+    mos6502_events_free(cpu);
+    return result;
+}
+
+void test_mos6502_events()
+{
+    RUN_TEST(test_events_order);
+    RUN_TEST(test_events_irq_line);
+    RUN_TEST(test_events_scheduled_by_device);
+    RUN_TEST(test_events_idle_timer);
+    RUN_TEST(test_events_tick);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,267 @@
+#include "opcodes.h"
+
+#include <limits.h>
+
+// longest loop body looked at, in bytes before the branch
+#define MOS6502_IDLE_BODY 32
+
+// instructions that only read registers and memory and write registers and
+// flags, without leaving the body: loads, compares, BIT, AND/ORA/EOR,
+// register transfers, NOP and the carry/overflow/decimal flag instructions
+static const uint8_t mos6502_idle_pure[256] = {
+    [0x09] = 1, [0x05] = 1, [0x15] = 1, [0x0D] = 1, [0x1D] = 1, [0x19] = 1, // ora
+    [0x29] = 1, [0x25] = 1, [0x35] = 1, [0x2D] = 1, [0x3D] = 1, [0x39] = 1, // and
+    [0x49] = 1, [0x45] = 1, [0x55] = 1, [0x4D] = 1, [0x5D] = 1, [0x59] = 1, // eor
+    [0xA9] = 1, [0xA5] = 1, [0xB5] = 1, [0xAD] = 1, [0xBD] = 1, [0xB9] = 1, // lda
+    [0xA2] = 1, [0xA6] = 1, [0xB6] = 1, [0xAE] = 1, [0xBE] = 1,             // ldx
+    [0xA0] = 1, [0xA4] = 1, [0xB4] = 1, [0xAC] = 1, [0xBC] = 1,             // ldy
+    [0xC9] = 1, [0xC5] = 1, [0xD5] = 1, [0xCD] = 1, [0xDD] = 1, [0xD9] = 1, // cmp
+    [0xE0] = 1, [0xE4] = 1, [0xEC] = 1,                                     // cpx
+    [0xC0] = 1, [0xC4] = 1, [0xCC] = 1,                                     // cpy
+    [0x24] = 1, [0x2C] = 1,                                                 // bit
+    [0xAA] = 1, [0xA8] = 1, [0x8A] = 1, [0x98] = 1, [0xBA] = 1,             // transfers
+    [0xEA] = 1, [0x18] = 1, [0x38] = 1, [0xB8] = 1, [0xD8] = 1, [0xF8] = 1, // nop, flags
+};
+
+// true when every byte the loop reads (code included) comes straight from host
+// memory: callbacks may be devices whose value changes while the cpu spins
+static int mos6502_idle_mapped(const mos6502_t *cpu, uint16_t address, int pages)
+{
+    for (int i = 0; i < pages; i++)
+    {
+        if (!cpu->pages->read[(uint8_t)((address >> 8) + i)])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// the body from target to the branch can only change registers and flags, so
+// with the same registers at the branch each iteration repeats the previous one.
+// cycles is the time from the target to the branch: anything longer than the
+// body ran code outside of it (a not taken branch and a jump back cost at least
+// 5 more), the body's page crosses account for anything in between
+static int mos6502_idle_body(const mos6502_t *cpu, uint16_t target, uint16_t branch, uint64_t cycles)
+{
+    uint16_t pc = target;
+    uint64_t body = 0;
+    int penalties = 0;
+
+    while (pc != branch)
+    {
+        if (!mos6502_idle_mapped(cpu, pc, 1) || !mos6502_idle_mapped(cpu, pc + 2, 1))
+        {
+            return 0;
+        }
+
+        const uint8_t *code = cpu->pages->read[pc >> 8];
+        uint8_t opcode = code[pc & 0xFF];
+        if (!mos6502_idle_pure[opcode] || cpu->opcodes[opcode] != mos6502_opcodes[opcode])
+        {
+            return 0;
+        }
+
+        int length = mos6502_opcode_length[opcode];
+        uint16_t operand = cpu->pages->read[(uint16_t)(pc + 1) >> 8][(pc + 1) & 0xFF];
+        if (length == 3)
+        {
+            operand |= cpu->pages->read[(uint16_t)(pc + 2) >> 8][(pc + 2) & 0xFF] << 8;
+        }
+
+        // indexed reads may reach the next page whatever the index
+        switch (mos6502_opcode_mode(opcode))
+        {
+        case MOS6502_MODE_ZERO_PAGE:
+        case MOS6502_MODE_ZERO_PAGE_X:
+        case MOS6502_MODE_ZERO_PAGE_Y:
+            if (!mos6502_idle_mapped(cpu, 0x0000, 1))
+            {
+                return 0;
+            }
+            break;
+        case MOS6502_MODE_ABSOLUTE:
+            if (!mos6502_idle_mapped(cpu, operand, 1))
+            {
+                return 0;
+            }
+            break;
+        case MOS6502_MODE_ABSOLUTE_X:
+        case MOS6502_MODE_ABSOLUTE_Y:
+            if (!mos6502_idle_mapped(cpu, operand, 2))
+            {
+                return 0;
+            }
+            break;
+        default:
+            break;
+        }
+
+        body += mos6502_opcode_cycles[opcode];
+        penalties += mos6502_opcode_page_penalty[opcode];
+        pc += length;
+        // ran past the branch: it sits inside an instruction of the body
+        if ((uint16_t)(branch - pc) > MOS6502_IDLE_BODY)
+        {
+            return 0;
+        }
+    }
+    return penalties < 5 && cycles >= body && cycles - body <= (uint64_t)penalties;
+}
+
+uint32_t mos6502_idle_skip(mos6502_t *cpu, uint16_t branch, uint16_t target, int ticks)
+{
+    // backward branches too far to be a spin loop
+    if ((uint16_t)(branch - target) > MOS6502_IDLE_BODY)
+    {
+        return 0;
+    }
+    // the stats count every instruction with the cycles it took
+    if (cpu->stats)
+    {
+        return 0;
+    }
+
+    mos6502_flags_sync(cpu);
+    uint64_t period = cpu->cycles - cpu->idle.cycles;
+    int same = cpu->idle.pc == branch && cpu->idle.a == cpu->a && cpu->idle.x == cpu->x && cpu->idle.y == cpu->y &&
+               cpu->idle.sp == cpu->sp && cpu->idle.flags == cpu->flags;
+
+    // two iterations in a row took the same time from the same state. nothing
+    // to skip in mos6502_tick (end is 0) or on the last instruction of the run
+    uint32_t skip = 0;
+    if (same && period == cpu->idle.period && period >= (uint64_t)ticks && cpu->cycles + ticks < cpu->end &&
+        mos6502_idle_body(cpu, target, branch, period - ticks))
+    {
+        uint64_t remaining = cpu->end - cpu->cycles - ticks;
+        uint64_t limit = INT_MAX - ticks;
+        skip = (uint32_t)((remaining < limit ? remaining : limit) / period * period);
+    }
+
+    cpu->idle.cycles = cpu->cycles + skip;
+    cpu->idle.period = same && period <= UINT32_MAX ? (uint32_t)period : 0;
+    cpu->idle.pc = branch;
+    cpu->idle.a = cpu->a;
+    cpu->idle.x = cpu->x;
+    cpu->idle.y = cpu->y;
+    cpu->idle.sp = cpu->sp;
+    cpu->idle.flags = cpu->flags;
+    return skip;
+}
+
+#ifdef _TEST
+
+static int test_idle_poll_loop(mos6502_t *cpu)
+{
+    // loop: lda $10, beq loop
+    static const uint8_t program[] = {0xA5, 0x10, 0xF0, 0xFC};
+    mos6502_test_program(cpu, program, sizeof(program));
+    if (mos6502_trace_enable(cpu, 64, NULL))
+    {
+        return 0;
+    }
+
+    // a few iterations to see the loop repeat, then whole iterations are skipped
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 1000000, &cycles);
+    int result = reason == MOS6502_STOP_BUDGET && cycles == 1000002 && cpu->pc == 0x8000 && cpu->trace->count < 16 &&
+                 cpu->end == 0;
+
+    // the next run goes on skipping from the first branch
+    uint64_t count = cpu->trace->count;
+    reason = mos6502_run(cpu, 600, &cycles);
+    result &= reason == MOS6502_STOP_BUDGET && cycles == 600 && cpu->trace->count - count == 2;
+
+    // a host write ends the wait
+    mos6502_write8(cpu, 0x0010, 0x01);
+    mos6502_write8(cpu, 0x8004, 0x02);
+    result &= mos6502_run(cpu, 1000, NULL) == MOS6502_STOP_UNKNOWN_OPCODE && cpu->pc == 0x8005;
+
+    mos6502_trace_disable(cpu);
+    return result;
+}
+
+static int test_idle_branch_to_self(mos6502_t *cpu)
+{
+    // bne *
+    static const uint8_t program[] = {0xD0, 0xFE};
+    mos6502_test_program(cpu, program, sizeof(program));
+
+    uint64_t cycles = 0;
+    int result = mos6502_run(cpu, 3000, &cycles) == MOS6502_STOP_BUDGET && cycles == 3000 && cpu->pc == 0x8000;
+
+    // single steps are never skipped
+    result &= mos6502_tick(cpu) == 3 && cpu->cycles == 3003;
+    return result;
+}
+
+static uint8_t test_idle_device(mos6502_t *cpu, uint16_t address)
+{
+    return 0x00;
+}
+
+static int test_idle_device_poll(mos6502_t *cpu)
+{
+    // loop: ldx $D010, beq loop, with $D0xx behind the read callback
+    static const uint8_t program[] = {0xAE, 0x10, 0xD0, 0xF0, 0xFB};
+    mos6502_page_map_t pages = *cpu->pages;
+    mos6502_test_program(cpu, program, sizeof(program));
+    pages.read[0xD0] = NULL;
+    cpu->pages = &pages;
+    cpu->read = test_idle_device;
+    if (mos6502_trace_enable(cpu, 4, NULL))
+    {
+        return 0;
+    }
+
+    // the device could change, every iteration runs
+    int result = mos6502_run(cpu, 700, NULL) == MOS6502_STOP_BUDGET && cpu->cycles == 700 && cpu->trace->count == 200;
+    mos6502_trace_disable(cpu);
+    return result;
+}
+
+static int test_idle_counting_loop(mos6502_t *cpu)
+{
+    // loop: dex, bne loop, then an unknown opcode
+    static const uint8_t program[] = {0xCA, 0xD0, 0xFD, 0x02};
+    mos6502_test_program(cpu, program, sizeof(program));
+
+    // x changes every iteration, nothing can be skipped
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 100000, &cycles);
+    return reason == MOS6502_STOP_UNKNOWN_OPCODE && cycles == 255 * 5 + 4 && cpu->x == 0;
+}
+
+static int test_idle_loop_exit(mos6502_t *cpu)
+{
+    // ldx #0, loop: txa, ldx #1, cmp #1, bne loop, inc $0200, ldx #0, jmp loop
+    static const uint8_t program[] = {0xA2, 0x00, 0x8A, 0xA2, 0x01, 0xC9, 0x01, 0xD0, 0xF9,
+                                      0xEE, 0x00, 0x02, 0xA2, 0x00, 0x4C, 0x02, 0x80};
+    mos6502_test_program(cpu, program, sizeof(program));
+
+    // the branch repeats from the same state but the code after it runs in
+    // between, nothing can be skipped
+    uint64_t cycles = 0;
+    int result = mos6502_run(cpu, 100000, &cycles) == MOS6502_STOP_BUDGET;
+    uint8_t count = mos6502_read8(cpu, 0x0200);
+    uint16_t pc = cpu->pc;
+
+    mos6502_write8(cpu, 0x0200, 0x00);
+    cpu->pc = 0x8000;
+    cpu->cycles = 0;
+    while (cpu->cycles < cycles)
+    {
+        mos6502_tick(cpu);
+    }
+    return result && cpu->cycles == cycles && cpu->pc == pc && mos6502_read8(cpu, 0x0200) == count && count == 243;
+}
+
+void test_mos6502_idle()
+{
+    RUN_TEST(test_idle_poll_loop);
+    RUN_TEST(test_idle_branch_to_self);
+    RUN_TEST(test_idle_device_poll);
+    RUN_TEST(test_idle_counting_loop);
+    RUN_TEST(test_idle_loop_exit);
+}
+#endif
\ No newline at end of file
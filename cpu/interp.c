@@ -0,0 +1,59 @@
+#include "operations.h"
+
+// every handler of mos6502_opcodes composed in place in one function, so the
+// compiler inlines them and replicates the dispatch after each one (computed
+// goto, see opcodes.h). single steps go through a switch
+
+#define MOS6502_CASE(opcode, name, kind, operation, mode, ...) \
+    case opcode:                                               \
+        return mos6502_exec_##name(cpu, mos6502_fetch_##mode(cpu));
+
+int mos6502_execute_inline(mos6502_t *cpu, uint8_t opcode)
+{
+    switch (opcode)
+    {
+        MOS6502_OPCODES(MOS6502_CASE)
+    default:
+        return -1;
+    }
+}
+
+#ifdef MOS6502_COMPUTED_GOTO
+
+#define MOS6502_LABEL(opcode, name, ...) [opcode] = &&op_##name,
+
+#define MOS6502_DISPATCH()                        \
+    if (cpu->cycles >= cpu->end)                  \
+    {                                             \
+        return MOS6502_STOP_BUDGET;               \
+    }                                             \
+    if ((reason = mos6502_lines_stop(cpu)) >= 0)  \
+    {                                             \
+        return reason;                            \
+    }                                             \
+    goto *labels[mos6502_read8(cpu, cpu->pc++)];
+
+#define MOS6502_HANDLER(opcode, name, kind, operation, mode, ...)       \
+    op_##name:                                                          \
+    cpu->cycles += mos6502_exec_##name(cpu, mos6502_fetch_##mode(cpu)); \
+    MOS6502_DISPATCH()
+
+int mos6502_run_inline(mos6502_t *cpu)
+{
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+    static const void *labels[256] = {
+        [0 ... 255] = &&unknown,
+        MOS6502_OPCODES(MOS6502_LABEL)
+    };
+#pragma GCC diagnostic pop
+    int reason;
+
+    MOS6502_DISPATCH()
+    MOS6502_OPCODES(MOS6502_HANDLER)
+
+unknown:
+    return MOS6502_STOP_UNKNOWN_OPCODE;
+}
+
+#endif
@@ -0,0 +1,944 @@
+#include "opcodes.h"
+
+#include <stddef.h>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// a block is at most this many instructions, so it never spans more than two pages
+#define MOS6502_JIT_BLOCK_INSTRUCTIONS 32
+#define MOS6502_JIT_BLOCK_BYTES (MOS6502_JIT_BLOCK_INSTRUCTIONS * 3)
+// worst case of native code for one block (prologue, epilogue and every instruction)
+#define MOS6502_JIT_BLOCK_CODE (64 + MOS6502_JIT_BLOCK_INSTRUCTIONS * 96)
+#define MOS6502_JIT_CACHE_SIZE (4 * 1024 * 1024)
+#define MOS6502_JIT_MAX_BLOCKS 16384
+
+typedef void (*mos6502_jit_code_t)(mos6502_t *cpu, uint64_t end);
+
+typedef struct mos6502_jit_block
+{
+    mos6502_jit_code_t code;
+    uint16_t start;
+    uint8_t first_page;
+    uint8_t last_page;
+    // inlined zero page loads read through the zero page's host pointer
+    uint8_t zero_page;
+} mos6502_jit_block_t;
+
+typedef struct mos6502_jit
+{
+    int threshold;
+    // set when a write invalidates a block, native code checks it after every
+    // handler call so a block never runs past a write into itself
+    uint8_t dirty;
+
+    // the map and write callback the host installed, and the map the cpu uses
+    // while the jit is enabled: pages holding translated code have no write
+    // pointer there, so every write to them goes through mos6502_jit_write
+    const mos6502_page_map_t *pages;
+    void (*write)(struct mos6502 *cpu, uint16_t address, uint8_t value);
+    mos6502_page_map_t shadow;
+
+    // blocks overlapping each page and pages written by inlined stores
+    uint16_t code_pages[256];
+    uint8_t store_pages[256];
+
+    uint8_t heat[65536];
+    mos6502_jit_block_t *blocks[65536];
+
+    mos6502_jit_block_t pool[MOS6502_JIT_MAX_BLOCKS];
+    int pool_used;
+
+    // never writable and executable at once, see mos6502_jit_protect
+    uint8_t *cache;
+    size_t cache_used;
+    size_t page_size;
+} mos6502_jit_t;
+
+static void mos6502_jit_flush_blocks(mos6502_jit_t *jit)
+{
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    memset(jit->code_pages, 0, sizeof(jit->code_pages));
+    memset(jit->store_pages, 0, sizeof(jit->store_pages));
+    memcpy(jit->shadow.write, jit->pages->write, sizeof(jit->shadow.write));
+    jit->pool_used = 0;
+    jit->cache_used = 0;
+    jit->dirty = 1;
+}
+
+static void mos6502_jit_remove_block(mos6502_jit_t *jit, mos6502_jit_block_t *block)
+{
+    jit->blocks[block->start] = NULL;
+    for (int page = block->first_page; page <= block->last_page; page++)
+    {
+        if (--jit->code_pages[page] == 0)
+        {
+            jit->shadow.write[page] = jit->pages->write[page];
+        }
+    }
+}
+
+static void mos6502_jit_invalidate_page(mos6502_jit_t *jit, uint8_t page)
+{
+    int first = page * 256 - MOS6502_JIT_BLOCK_BYTES;
+    for (int pc = first < 0 ? 0 : first; pc < page * 256 + 256; pc++)
+    {
+        mos6502_jit_block_t *block = jit->blocks[pc];
+        if (block && block->first_page <= page && block->last_page >= page)
+        {
+            mos6502_jit_remove_block(jit, block);
+        }
+    }
+    jit->dirty = 1;
+}
+
+// blocks holding the zero page's host pointer, dropped when the page moves
+static void mos6502_jit_invalidate_zero_page(mos6502_jit_t *jit)
+{
+    for (int i = 0; i < jit->pool_used; i++)
+    {
+        mos6502_jit_block_t *block = &jit->pool[i];
+        if (block->zero_page && jit->blocks[block->start] == block)
+        {
+            mos6502_jit_remove_block(jit, block);
+        }
+    }
+    jit->dirty = 1;
+}
+
+// the host pages of the code cache holding size bytes from offset: writable
+// while a block is emitted into them, executable again once it is done
+static int mos6502_jit_protect(mos6502_jit_t *jit, size_t offset, size_t size, int protection)
+{
+    size_t start = offset / jit->page_size * jit->page_size;
+    size_t end = (offset + size + jit->page_size - 1) / jit->page_size * jit->page_size;
+    return mprotect(jit->cache + start, end - start, protection);
+}
+
+static void mos6502_jit_write(mos6502_t *cpu, uint16_t address, uint8_t value)
+{
+    mos6502_jit_t *jit = cpu->jit;
+    uint8_t page = address >> 8;
+
+    if (jit->code_pages[page])
+    {
+        mos6502_jit_invalidate_page(jit, page);
+    }
+
+    uint8_t *memory = jit->pages->write[page];
+    if (memory)
+    {
+        memory[address & 0xFF] = value;
+        return;
+    }
+    jit->write(cpu, address, value);
+}
+
+// x86-64 emitter, every memory operand is [rbx + disp32] with rbx = cpu
+
+#define CPU_FIELD(field) ((uint32_t)offsetof(mos6502_t, field))
+
+static void emit8(uint8_t **p, uint8_t value)
+{
+    *(*p)++ = value;
+}
+
+static void emit16(uint8_t **p, uint16_t value)
+{
+    memcpy(*p, &value, 2);
+    *p += 2;
+}
+
+static void emit32(uint8_t **p, uint32_t value)
+{
+    memcpy(*p, &value, 4);
+    *p += 4;
+}
+
+static void emit64(uint8_t **p, uint64_t value)
+{
+    memcpy(*p, &value, 8);
+    *p += 8;
+}
+
+// opcode bytes followed by a [rbx + disp32] modrm with the given reg field
+static void emit_cpu_operand(uint8_t **p, uint8_t reg, uint32_t field)
+{
+    emit8(p, 0x80 | (reg << 3) | 3);
+    emit32(p, field);
+}
+
+static void emit_jump(uint8_t **p, uint8_t *target)
+{
+    emit8(p, 0xE9);
+    emit32(p, (uint32_t)(target - (*p + 4)));
+}
+
+static void emit_jump_if(uint8_t **p, uint8_t condition, uint8_t *target)
+{
+    emit8(p, 0x0F);
+    emit8(p, condition);
+    emit32(p, (uint32_t)(target - (*p + 4)));
+}
+
+#define JB 0x82
+#define JAE 0x83
+#define JE 0x84
+#define JNE 0x85
+
+static void emit_store_imm8(uint8_t **p, uint32_t field, uint8_t value)
+{
+    emit8(p, 0xC6);
+    emit_cpu_operand(p, 0, field);
+    emit8(p, value);
+}
+
+static void emit_store_imm16(uint8_t **p, uint32_t field, uint16_t value)
+{
+    emit8(p, 0x66);
+    emit8(p, 0xC7);
+    emit_cpu_operand(p, 0, field);
+    emit16(p, value);
+}
+
+// and/or byte [rbx + field], imm8
+static void emit_and_imm8(uint8_t **p, uint32_t field, uint8_t value)
+{
+    emit8(p, 0x80);
+    emit_cpu_operand(p, 4, field);
+    emit8(p, value);
+}
+
+static void emit_or_imm8(uint8_t **p, uint32_t field, uint8_t value)
+{
+    emit8(p, 0x80);
+    emit_cpu_operand(p, 1, field);
+    emit8(p, value);
+}
+
+// movzx eax, byte [rbx + field]
+static void emit_load_eax(uint8_t **p, uint32_t field)
+{
+    emit8(p, 0x0F);
+    emit8(p, 0xB6);
+    emit_cpu_operand(p, 0, field);
+}
+
+// mov byte [rbx + field], al
+static void emit_store_al(uint8_t **p, uint32_t field)
+{
+    emit8(p, 0x88);
+    emit_cpu_operand(p, 0, field);
+}
+
+static void emit_add_cycles(uint8_t **p, uint32_t cycles)
+{
+    emit8(p, 0x48);
+    emit8(p, 0x81);
+    emit_cpu_operand(p, 0, CPU_FIELD(cycles));
+    emit32(p, cycles);
+}
+
+// N and Z of a constant result
+static void emit_nz_imm(uint8_t **p, uint8_t value)
+{
+#ifdef MOS6502_LAZY_FLAGS
+    emit_store_imm16(p, CPU_FIELD(lazy_nz), value);
+#else
+    emit_and_imm8(p, CPU_FIELD(flags), (uint8_t)~(NEGATIVE | ZERO));
+    uint8_t flags = (value & NEGATIVE) | (value == 0 ? ZERO : 0);
+    if (flags)
+    {
+        emit_or_imm8(p, CPU_FIELD(flags), flags);
+    }
+#endif
+}
+
+// N and Z of the result zero-extended in eax
+static void emit_nz_eax(uint8_t **p)
+{
+#ifdef MOS6502_LAZY_FLAGS
+    // mov word [rbx + lazy_nz], ax
+    emit8(p, 0x66);
+    emit8(p, 0x89);
+    emit_cpu_operand(p, 0, CPU_FIELD(lazy_nz));
+#else
+    // movzx ecx, byte [rbx + flags]
+    emit8(p, 0x0F);
+    emit8(p, 0xB6);
+    emit_cpu_operand(p, 1, CPU_FIELD(flags));
+    // and ecx, ~(N | Z)
+    emit8(p, 0x83);
+    emit8(p, 0xE1);
+    emit8(p, (uint8_t)~(NEGATIVE | ZERO));
+    // mov edx, eax; and edx, N; or ecx, edx
+    emit8(p, 0x89);
+    emit8(p, 0xC2);
+    emit8(p, 0x81);
+    emit8(p, 0xE2);
+    emit32(p, NEGATIVE);
+    emit8(p, 0x09);
+    emit8(p, 0xD1);
+    // test eax, eax; jnz +3; or ecx, Z
+    emit8(p, 0x85);
+    emit8(p, 0xC0);
+    emit8(p, 0x75);
+    emit8(p, 0x03);
+    emit8(p, 0x83);
+    emit8(p, 0xC9);
+    emit8(p, ZERO);
+    // mov byte [rbx + flags], cl
+    emit8(p, 0x88);
+    emit_cpu_operand(p, 1, CPU_FIELD(flags));
+#endif
+}
+
+static void emit_carry(uint8_t **p, uint8_t carry)
+{
+#ifdef MOS6502_LAZY_FLAGS
+    emit_store_imm8(p, CPU_FIELD(lazy_c), carry);
+#else
+    if (carry)
+    {
+        emit_or_imm8(p, CPU_FIELD(flags), CARRY);
+    }
+    else
+    {
+        emit_and_imm8(p, CPU_FIELD(flags), (uint8_t)~CARRY);
+    }
+#endif
+}
+
+// movabs rax, host; movzx eax, byte [rax]
+static void emit_load_host(uint8_t **p, const uint8_t *host)
+{
+    emit8(p, 0x48);
+    emit8(p, 0xB8);
+    emit64(p, (uint64_t)(uintptr_t)host);
+    emit8(p, 0x0F);
+    emit8(p, 0xB6);
+    emit8(p, 0x00);
+}
+
+// movzx eax, byte [rbx + field]; movabs rcx, host; mov byte [rcx], al
+static void emit_store_host(uint8_t **p, uint32_t field, uint8_t *host)
+{
+    emit_load_eax(p, field);
+    emit8(p, 0x48);
+    emit8(p, 0xB9);
+    emit64(p, (uint64_t)(uintptr_t)host);
+    emit8(p, 0x88);
+    emit8(p, 0x01);
+}
+
+static int mos6502_jit_ends_block(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case 0x10: case 0x30: case 0x50: case 0x70:
+    case 0x90: case 0xB0: case 0xD0: case 0xF0:
+    case 0x00: case 0x20: case 0x40: case 0x4C: case 0x60: case 0x6C:
+        return 1;
+    }
+    return 0;
+}
+
+// emit a native version of a default handler, returns 0 when the instruction
+// has to call its handler. its cycles are the ones of mos6502_opcode_cycles
+static int mos6502_jit_emit_inline(mos6502_jit_t *jit, mos6502_jit_block_t *block, uint8_t **p, const uint8_t *code)
+{
+    uint8_t operand = code[1];
+    uint16_t absolute = code[1] | (code[2] << 8);
+    const uint8_t *zero_page = jit->shadow.read[0];
+
+    switch (code[0])
+    {
+    case 0xEA: // nop
+        return 1;
+    case 0xAA: // tax
+        emit_load_eax(p, CPU_FIELD(a));
+        emit_store_al(p, CPU_FIELD(x));
+        emit_nz_eax(p);
+        return 1;
+    case 0xA8: // tay
+        emit_load_eax(p, CPU_FIELD(a));
+        emit_store_al(p, CPU_FIELD(y));
+        emit_nz_eax(p);
+        return 1;
+    case 0x8A: // txa
+        emit_load_eax(p, CPU_FIELD(x));
+        emit_store_al(p, CPU_FIELD(a));
+        emit_nz_eax(p);
+        return 1;
+    case 0x98: // tya
+        emit_load_eax(p, CPU_FIELD(y));
+        emit_store_al(p, CPU_FIELD(a));
+        emit_nz_eax(p);
+        return 1;
+    case 0xA9: // lda #
+        emit_store_imm8(p, CPU_FIELD(a), operand);
+        emit_nz_imm(p, operand);
+        return 1;
+    case 0xA2: // ldx #
+        emit_store_imm8(p, CPU_FIELD(x), operand);
+        emit_nz_imm(p, operand);
+        return 1;
+    case 0x29: // and #
+        emit_load_eax(p, CPU_FIELD(a));
+        emit8(p, 0x25);
+        emit32(p, operand);
+        emit_store_al(p, CPU_FIELD(a));
+        emit_nz_eax(p);
+        return 1;
+    case 0xA5: // lda zp
+    case 0xA6: // ldx zp
+        if (!zero_page)
+        {
+            return 0;
+        }
+        emit_load_host(p, zero_page + operand);
+        block->zero_page = 1;
+        emit_store_al(p, code[0] == 0xA5 ? CPU_FIELD(a) : CPU_FIELD(x));
+        emit_nz_eax(p);
+        return 1;
+    case 0x85: // sta zp
+    case 0x86: // stx zp
+    case 0x84: // sty zp
+    case 0x8D: // sta abs
+    case 0x8C: // sty abs
+    {
+        int is_absolute = code[0] == 0x8D || code[0] == 0x8C;
+        uint16_t address = is_absolute ? absolute : operand;
+        uint8_t *page = jit->shadow.write[address >> 8];
+        if (!page)
+        {
+            return 0;
+        }
+        uint32_t field = code[0] == 0x86 ? CPU_FIELD(x) : code[0] == 0x84 || code[0] == 0x8C ? CPU_FIELD(y) : CPU_FIELD(a);
+        emit_store_host(p, field, page + (address & 0xFF));
+        jit->store_pages[address >> 8] = 1;
+        return 1;
+    }
+    case 0x18: // clc
+        emit_carry(p, 0);
+        return 1;
+    case 0x38: // sec
+        emit_carry(p, 1);
+        return 1;
+    case 0xD8: // cld
+        emit_and_imm8(p, CPU_FIELD(flags), (uint8_t)~DECIMAL);
+        return 1;
+    case 0xF8: // sed
+        emit_or_imm8(p, CPU_FIELD(flags), DECIMAL);
+        return 1;
+    case 0xB8: // clv
+#ifdef MOS6502_LAZY_FLAGS
+        emit_store_imm8(p, CPU_FIELD(lazy_v), 0);
+#endif
+        emit_and_imm8(p, CPU_FIELD(flags), (uint8_t)~OVERFLOW);
+        return 1;
+    }
+    return 0;
+}
+
+// call the handler with pc just past the opcode, then leave the block if the
+// budget is spent (or an event moved its end), a line changed or a write hit
+// translated code
+static void mos6502_jit_emit_call(uint8_t **p, mos6502_opcode_t handler, uint16_t pc, uint8_t *epilogue)
+{
+    emit_store_imm16(p, CPU_FIELD(pc), pc + 1);
+    // movabs rax, handler; mov rdi, rbx; call rax
+    emit8(p, 0x48);
+    emit8(p, 0xB8);
+    emit64(p, (uint64_t)(uintptr_t)handler);
+    emit8(p, 0x48);
+    emit8(p, 0x89);
+    emit8(p, 0xDF);
+    emit8(p, 0xFF);
+    emit8(p, 0xD0);
+    // mov eax, eax; add qword [rbx + cycles], rax
+    emit8(p, 0x89);
+    emit8(p, 0xC0);
+    emit8(p, 0x48);
+    emit8(p, 0x01);
+    emit_cpu_operand(p, 0, CPU_FIELD(cycles));
+    // the handler may have scheduled an event: mov r12, qword [rbx + end]
+    emit8(p, 0x4C);
+    emit8(p, 0x8B);
+    emit_cpu_operand(p, 4, CPU_FIELD(end));
+    // cmp qword [rbx + cycles], r12; jae epilogue
+    emit8(p, 0x4C);
+    emit8(p, 0x39);
+    emit_cpu_operand(p, 4, CPU_FIELD(cycles));
+    emit_jump_if(p, JAE, epilogue);
+    // mov eax, [rbx + nmi]; or eax, [rbx + interrupt]; jne epilogue
+    emit8(p, 0x8B);
+    emit_cpu_operand(p, 0, CPU_FIELD(nmi));
+    emit8(p, 0x0B);
+    emit_cpu_operand(p, 0, CPU_FIELD(interrupt));
+    emit_jump_if(p, JNE, epilogue);
+    // cmp dword [rbx + rdy], 0; je epilogue
+    emit8(p, 0x83);
+    emit_cpu_operand(p, 7, CPU_FIELD(rdy));
+    emit8(p, 0x00);
+    emit_jump_if(p, JE, epilogue);
+    // cmp byte [r13], 0; jne epilogue
+    emit8(p, 0x41);
+    emit8(p, 0x80);
+    emit8(p, 0x7D);
+    emit8(p, 0x00);
+    emit8(p, 0x00);
+    emit_jump_if(p, JNE, epilogue);
+}
+
+// after an inlined instruction only the budget can stop the block
+static void mos6502_jit_emit_budget(uint8_t **p, uint16_t next_pc, uint8_t *epilogue)
+{
+    // cmp qword [rbx + cycles], r12; jb +14
+    emit8(p, 0x4C);
+    emit8(p, 0x39);
+    emit_cpu_operand(p, 4, CPU_FIELD(cycles));
+    emit8(p, 0x72);
+    emit8(p, 14);
+    emit_store_imm16(p, CPU_FIELD(pc), next_pc);
+    emit_jump(p, epilogue);
+}
+
+static mos6502_jit_block_t *mos6502_jit_translate(mos6502_t *cpu, mos6502_jit_t *jit, uint16_t start)
+{
+    const uint8_t *code[MOS6502_JIT_BLOCK_INSTRUCTIONS];
+    int count = 0;
+    uint32_t pc = start;
+
+    // decode up to the first jump, unknown opcode or byte outside mapped memory
+    while (count < MOS6502_JIT_BLOCK_INSTRUCTIONS)
+    {
+        const uint8_t *page = jit->shadow.read[pc >> 8];
+        if (!page)
+        {
+            break;
+        }
+        uint8_t opcode = page[pc & 0xFF];
+        uint32_t length = mos6502_opcode_length[opcode];
+        if (!cpu->opcodes[opcode] || pc + length > 0x10000 || !jit->shadow.read[(pc + length - 1) >> 8])
+        {
+            break;
+        }
+        code[count++] = page + (pc & 0xFF);
+        pc += length;
+        if (mos6502_jit_ends_block(opcode))
+        {
+            break;
+        }
+    }
+
+    if (count == 0)
+    {
+        return NULL;
+    }
+
+    uint8_t first_page = start >> 8;
+    uint8_t last_page = (pc - 1) >> 8;
+
+    // inlined stores into pages that now hold code would skip invalidation
+    if (jit->pool_used == MOS6502_JIT_MAX_BLOCKS ||
+        jit->cache_used + MOS6502_JIT_BLOCK_CODE > MOS6502_JIT_CACHE_SIZE ||
+        jit->store_pages[first_page] || jit->store_pages[last_page])
+    {
+        mos6502_jit_flush_blocks(jit);
+    }
+
+    if (mos6502_jit_protect(jit, jit->cache_used, MOS6502_JIT_BLOCK_CODE, PROT_READ | PROT_WRITE))
+    {
+        return NULL;
+    }
+
+    // operand bytes may sit across a page boundary, copy them out before emitting
+    uint8_t bytes[MOS6502_JIT_BLOCK_INSTRUCTIONS][3];
+    pc = start;
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t length = mos6502_opcode_length[code[i][0]];
+        for (int j = 0; j < length; j++)
+        {
+            bytes[i][j] = jit->shadow.read[(pc + j) >> 8][(pc + j) & 0xFF];
+        }
+        for (int j = length; j < 3; j++)
+        {
+            bytes[i][j] = 0;
+        }
+        pc += length;
+    }
+
+    mos6502_jit_block_t *block = &jit->pool[jit->pool_used++];
+    block->start = start;
+    block->first_page = first_page;
+    block->last_page = last_page;
+    block->zero_page = 0;
+    for (int page = first_page; page <= last_page; page++)
+    {
+        jit->code_pages[page]++;
+        jit->shadow.write[page] = NULL;
+    }
+
+    uint8_t *base = jit->cache + jit->cache_used;
+    uint8_t *p = base;
+
+    // epilogue first, so every exit is a backward jump to a known address
+    uint8_t *epilogue = p;
+    emit8(&p, 0x41);
+    emit8(&p, 0x5D);
+    emit8(&p, 0x41);
+    emit8(&p, 0x5C);
+    emit8(&p, 0x5B);
+    emit8(&p, 0xC3);
+
+    // push rbx; push r12; push r13; mov rbx, rdi; mov r12, rsi; movabs r13, &dirty
+    block->code = (mos6502_jit_code_t)(void *)p;
+    emit8(&p, 0x53);
+    emit8(&p, 0x41);
+    emit8(&p, 0x54);
+    emit8(&p, 0x41);
+    emit8(&p, 0x55);
+    emit8(&p, 0x48);
+    emit8(&p, 0x89);
+    emit8(&p, 0xFB);
+    emit8(&p, 0x49);
+    emit8(&p, 0x89);
+    emit8(&p, 0xF4);
+    emit8(&p, 0x49);
+    emit8(&p, 0xBD);
+    emit64(&p, (uint64_t)(uintptr_t)&jit->dirty);
+
+    int inlined = 0;
+    pc = start;
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t opcode = bytes[i][0];
+        uint16_t next_pc = pc + mos6502_opcode_length[opcode];
+
+        inlined = 0;
+        if (cpu->opcodes[opcode] == mos6502_opcodes[opcode])
+        {
+            if (mos6502_jit_emit_inline(jit, block, &p, bytes[i]))
+            {
+                emit_add_cycles(&p, mos6502_opcode_cycles[opcode]);
+                mos6502_jit_emit_budget(&p, next_pc, epilogue);
+                inlined = 1;
+            }
+        }
+        if (!inlined)
+        {
+            mos6502_jit_emit_call(&p, cpu->opcodes[opcode], pc, epilogue);
+        }
+        pc = next_pc;
+    }
+
+    if (inlined)
+    {
+        emit_store_imm16(&p, CPU_FIELD(pc), pc);
+    }
+    emit_jump(&p, epilogue);
+
+    // blocks sharing these host pages cannot run until they are executable again
+    if (mos6502_jit_protect(jit, base - jit->cache, MOS6502_JIT_BLOCK_CODE, PROT_READ | PROT_EXEC))
+    {
+        mos6502_jit_flush_blocks(jit);
+        return NULL;
+    }
+
+    jit->cache_used += p - base;
+    jit->blocks[start] = block;
+    return block;
+}
+
+int mos6502_jit_run(mos6502_t *cpu)
+{
+    mos6502_jit_t *jit = cpu->jit;
+    int block_instructions = 0;
+
+    while (cpu->cycles < cpu->end)
+    {
+        int reason = mos6502_lines_stop(cpu);
+        if (reason >= 0)
+        {
+            return reason;
+        }
+
+        if (block_instructions == 0)
+        {
+            mos6502_jit_block_t *block = jit->blocks[cpu->pc];
+            if (!block && ++jit->heat[cpu->pc] >= jit->threshold)
+            {
+                jit->heat[cpu->pc] = 0;
+                block = mos6502_jit_translate(cpu, jit, cpu->pc);
+            }
+            if (block)
+            {
+                jit->dirty = 0;
+                block->code(cpu, cpu->end);
+                continue;
+            }
+        }
+
+        // interpret up to where a block starting here would end
+        uint8_t opcode = mos6502_read8(cpu, cpu->pc++);
+        mos6502_opcode_t handler = cpu->opcodes[opcode];
+        if (!handler)
+        {
+            return MOS6502_STOP_UNKNOWN_OPCODE;
+        }
+        cpu->cycles += handler(cpu);
+
+        if (mos6502_jit_ends_block(opcode) || ++block_instructions == MOS6502_JIT_BLOCK_INSTRUCTIONS)
+        {
+            block_instructions = 0;
+        }
+    }
+
+    return MOS6502_STOP_BUDGET;
+}
+
+// heat counters are 8 bits wide
+static int mos6502_jit_threshold(int threshold)
+{
+    return threshold < 1 ? 1 : threshold > 255 ? 255 : threshold;
+}
+
+int mos6502_jit_enable(mos6502_t *cpu, int threshold)
+{
+    if (cpu->jit)
+    {
+        cpu->jit->threshold = mos6502_jit_threshold(threshold);
+        return 0;
+    }
+    if (cpu->predecode || cpu->debug)
+    {
+        return -1;
+    }
+
+    mos6502_jit_t *jit = calloc(1, sizeof(mos6502_jit_t));
+    if (!jit)
+    {
+        return -1;
+    }
+
+    // pages become writable or executable as blocks are emitted into them
+    jit->cache = mmap(NULL, MOS6502_JIT_CACHE_SIZE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->cache == MAP_FAILED)
+    {
+        free(jit);
+        return -1;
+    }
+
+    jit->page_size = sysconf(_SC_PAGESIZE);
+    jit->threshold = mos6502_jit_threshold(threshold);
+    jit->pages = cpu->pages;
+    jit->write = cpu->write;
+    jit->shadow = *cpu->pages;
+
+    cpu->jit = jit;
+    cpu->pages = &jit->shadow;
+    cpu->write = mos6502_jit_write;
+    return 0;
+}
+
+void mos6502_jit_disable(mos6502_t *cpu)
+{
+    mos6502_jit_t *jit = cpu->jit;
+    if (!jit)
+    {
+        return;
+    }
+
+    cpu->pages = jit->pages;
+    cpu->write = jit->write;
+    cpu->jit = NULL;
+
+    munmap(jit->cache, MOS6502_JIT_CACHE_SIZE);
+    free(jit);
+}
+
+void mos6502_jit_flush(mos6502_t *cpu)
+{
+    mos6502_jit_t *jit = cpu->jit;
+    if (!jit)
+    {
+        return;
+    }
+
+    memcpy(jit->shadow.read, jit->pages->read, sizeof(jit->shadow.read));
+    mos6502_jit_flush_blocks(jit);
+}
+
+void mos6502_jit_flush_page(mos6502_t *cpu, uint8_t page)
+{
+    mos6502_jit_t *jit = cpu->jit;
+    if (!jit)
+    {
+        return;
+    }
+
+    jit->shadow.read[page] = jit->pages->read[page];
+    // inlined stores hold the page's old write pointer and are not tracked per block
+    if (jit->store_pages[page])
+    {
+        mos6502_jit_flush_blocks(jit);
+        return;
+    }
+
+    mos6502_jit_invalidate_page(jit, page);
+    if (page == 0)
+    {
+        mos6502_jit_invalidate_zero_page(jit);
+    }
+    if (!jit->code_pages[page])
+    {
+        jit->shadow.write[page] = jit->pages->write[page];
+    }
+}
+
+#else
+
+int mos6502_jit_run(mos6502_t *cpu)
+{
+    return MOS6502_STOP_HALT;
+}
+
+int mos6502_jit_enable(mos6502_t *cpu, int threshold)
+{
+    return -1;
+}
+
+void mos6502_jit_disable(mos6502_t *cpu)
+{
+}
+
+void mos6502_jit_flush(mos6502_t *cpu)
+{
+}
+
+void mos6502_jit_flush_page(mos6502_t *cpu, uint8_t page)
+{
+}
+
+#endif
+
+#ifdef _TEST
+
+static int test_jit_straight_line(mos6502_t *cpu)
+{
+    if (mos6502_jit_enable(cpu, 1))
+    {
+        return 1;
+    }
+    uint8_t program[] = {0xA9, 0x81, 0x85, 0x10, 0xA6, 0x10, 0x8A, 0x29, 0x0F, 0xA8, 0x8C, 0x00, 0x02, 0x38, 0xF8, 0xEA, 0x02};
+    mos6502_test_program(cpu, program, sizeof(program));
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 100, &cycles);
+    int translated = cpu->jit->blocks[0x8000] != NULL;
+    mos6502_jit_disable(cpu);
+    return translated && reason == MOS6502_STOP_UNKNOWN_OPCODE && cycles == 24 && cpu->pc == 0x8011 &&
+           cpu->a == 0x01 && cpu->x == 0x81 && cpu->y == 0x01 && mos6502_read8(cpu, 0x0010) == 0x81 &&
+           mos6502_read8(cpu, 0x0200) == 0x01 && cpu->flags == (CARRY | DECIMAL);
+}
+
+static int test_jit_budget(mos6502_t *cpu)
+{
+    if (mos6502_jit_enable(cpu, 1))
+    {
+        return 1;
+    }
+    for (uint16_t address = 0x8000; address < 0x8010; address += 2)
+    {
+        mos6502_write8(cpu, address, 0xA9);
+        mos6502_write8(cpu, address + 1, address & 0xFF);
+    }
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 5, &cycles);
+    mos6502_jit_disable(cpu);
+    return reason == MOS6502_STOP_BUDGET && cycles == 6 && cpu->pc == 0x8006 && cpu->a == 0x04;
+}
+
+static int test_jit_self_modifying(mos6502_t *cpu)
+{
+    if (mos6502_jit_enable(cpu, 1))
+    {
+        return 1;
+    }
+    // sta $8006 rewrites the operand of the lda # that follows it
+    uint8_t program[] = {0xA9, 0x42, 0x8D, 0x06, 0x80, 0xA9, 0x00};
+    mos6502_test_program(cpu, program, sizeof(program));
+    uint64_t cycles = 0;
+    mos6502_run(cpu, 8, &cycles);
+    mos6502_jit_disable(cpu);
+    return cycles == 8 && cpu->pc == 0x8007 && cpu->a == 0x42 && cpu->flags == 0;
+}
+
+static int test_jit_invalidate(mos6502_t *cpu)
+{
+    if (mos6502_jit_enable(cpu, 1))
+    {
+        return 1;
+    }
+    mos6502_write8(cpu, 0x8000, 0xA9);
+    mos6502_write8(cpu, 0x8001, 0x01);
+    mos6502_run(cpu, 2, NULL);
+    int translated = cpu->jit->blocks[0x8000] != NULL;
+    mos6502_write8(cpu, 0x8001, 0x02);
+    int invalidated = cpu->jit->blocks[0x8000] == NULL;
+    cpu->pc = 0x8000;
+    mos6502_run(cpu, 2, NULL);
+    mos6502_jit_disable(cpu);
+    return translated && invalidated && cpu->a == 0x02;
+}
+
+static int test_jit_cow_copy(mos6502_t *cpu)
+{
+    if (mos6502_cow_init(cpu))
+    {
+        return 0;
+    }
+    // lda $10 at $8000, lda #$01 at $9000, both followed by an unknown opcode.
+    // every page still shares the zeroed page
+    static const uint8_t program[] = {0xA5, 0x10, 0x02, 0xA9, 0x01, 0x02};
+    for (int i = 0; i < 3; i++)
+    {
+        mos6502_write8(cpu, 0x8000 + i, program[i]);
+        mos6502_write8(cpu, 0x9000 + i, program[3 + i]);
+    }
+    if (mos6502_jit_enable(cpu, 1))
+    {
+        mos6502_cow_free(cpu);
+        return 1;
+    }
+    cpu->rst = 0;
+    cpu->pc = 0x8000;
+    mos6502_run(cpu, 10, NULL);
+    cpu->pc = 0x9000;
+    mos6502_run(cpu, 10, NULL);
+
+    // copying the zero page drops the block loading from it, not the other one
+    mos6502_write8(cpu, 0x0010, 0x42);
+    int result = cpu->jit->blocks[0x8000] == NULL && cpu->jit->blocks[0x9000] != NULL;
+    cpu->pc = 0x8000;
+    result &= mos6502_run(cpu, 10, NULL) == MOS6502_STOP_UNKNOWN_OPCODE && cpu->a == 0x42;
+
+    // the jit still holds the copy-on-write map
+    result &= mos6502_cow_free(cpu) == -1;
+    mos6502_jit_disable(cpu);
+    result &= mos6502_cow_free(cpu) == 0 && cpu->cow == NULL;
+    return result;
+}
+
+void test_mos6502_jit()
+{
+    RUN_TEST(test_jit_straight_line);
+    RUN_TEST(test_jit_budget);
+    RUN_TEST(test_jit_self_modifying);
+    RUN_TEST(test_jit_invalidate);
+    RUN_TEST(test_jit_cow_copy);
+}
+#endif
@@ -0,0 +1,784 @@
+#include "opcodes.h"
+
+// byte vectors used by the lockstep kernels: AVX2 or SSE2 when the compiler
+// targets them, one byte at a time otherwise
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+#define MOS6502_VECTOR_BYTES 32
+
+typedef __m256i mos6502_vector_t;
+
+static inline mos6502_vector_t mos6502_vector_load(const uint8_t *p)
+{
+    return _mm256_loadu_si256((const __m256i *)p);
+}
+
+static inline void mos6502_vector_store(uint8_t *p, mos6502_vector_t v)
+{
+    _mm256_storeu_si256((__m256i *)p, v);
+}
+
+static inline mos6502_vector_t mos6502_vector_set(uint8_t value)
+{
+    return _mm256_set1_epi8((char)value);
+}
+
+static inline mos6502_vector_t mos6502_vector_and(mos6502_vector_t a, mos6502_vector_t b)
+{
+    return _mm256_and_si256(a, b);
+}
+
+static inline mos6502_vector_t mos6502_vector_or(mos6502_vector_t a, mos6502_vector_t b)
+{
+    return _mm256_or_si256(a, b);
+}
+
+// ~a & b
+static inline mos6502_vector_t mos6502_vector_andnot(mos6502_vector_t a, mos6502_vector_t b)
+{
+    return _mm256_andnot_si256(a, b);
+}
+
+static inline mos6502_vector_t mos6502_vector_equal(mos6502_vector_t a, mos6502_vector_t b)
+{
+    return _mm256_cmpeq_epi8(a, b);
+}
+
+// every byte shifted by one, there are no byte shifts
+static inline mos6502_vector_t mos6502_vector_shift_left(mos6502_vector_t v)
+{
+    return _mm256_add_epi8(v, v);
+}
+
+static inline mos6502_vector_t mos6502_vector_shift_right(mos6502_vector_t v)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(v, 1), _mm256_set1_epi8(0x7F));
+}
+
+static inline int mos6502_vector_any(mos6502_vector_t v)
+{
+    return !_mm256_testz_si256(v, v);
+}
+
+#elif defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#define MOS6502_VECTOR_BYTES 16
+
+typedef __m128i mos6502_vector_t;
+
+static inline mos6502_vector_t mos6502_vector_load(const uint8_t *p)
+{
+    return _mm_loadu_si128((const __m128i *)p);
+}
+
+static inline void mos6502_vector_store(uint8_t *p, mos6502_vector_t v)
+{
+    _mm_storeu_si128((__m128i *)p, v);
+}
+
+static inline mos6502_vector_t mos6502_vector_set(uint8_t value)
+{
+    return _mm_set1_epi8((char)value);
+}
+
+static inline mos6502_vector_t mos6502_vector_and(mos6502_vector_t a, mos6502_vector_t b)
+{
+    return _mm_and_si128(a, b);
+}
+
+static inline mos6502_vector_t mos6502_vector_or(mos6502_vector_t a, mos6502_vector_t b)
+{
+    return _mm_or_si128(a, b);
+}
+
+// ~a & b
+static inline mos6502_vector_t mos6502_vector_andnot(mos6502_vector_t a, mos6502_vector_t b)
+{
+    return _mm_andnot_si128(a, b);
+}
+
+static inline mos6502_vector_t mos6502_vector_equal(mos6502_vector_t a, mos6502_vector_t b)
+{
+    return _mm_cmpeq_epi8(a, b);
+}
+
+// every byte shifted by one, there are no byte shifts
+static inline mos6502_vector_t mos6502_vector_shift_left(mos6502_vector_t v)
+{
+    return _mm_add_epi8(v, v);
+}
+
+static inline mos6502_vector_t mos6502_vector_shift_right(mos6502_vector_t v)
+{
+    return _mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi8(0x7F));
+}
+
+static inline int mos6502_vector_any(mos6502_vector_t v)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF;
+}
+
+#else
+
+#define MOS6502_VECTOR_BYTES 1
+
+typedef uint8_t mos6502_vector_t;
+
+static inline mos6502_vector_t mos6502_vector_load(const uint8_t *p)
+{
+    return *p;
+}
+
+static inline void mos6502_vector_store(uint8_t *p, mos6502_vector_t v)
+{
+    *p = v;
+}
+
+static inline mos6502_vector_t mos6502_vector_set(uint8_t value)
+{
+    return value;
+}
+
+static inline mos6502_vector_t mos6502_vector_and(mos6502_vector_t a, mos6502_vector_t b)
+{
+    return a & b;
+}
+
+static inline mos6502_vector_t mos6502_vector_or(mos6502_vector_t a, mos6502_vector_t b)
+{
+    return a | b;
+}
+
+// ~a & b
+static inline mos6502_vector_t mos6502_vector_andnot(mos6502_vector_t a, mos6502_vector_t b)
+{
+    return ~a & b;
+}
+
+static inline mos6502_vector_t mos6502_vector_equal(mos6502_vector_t a, mos6502_vector_t b)
+{
+    return a == b ? 0xFF : 0x00;
+}
+
+static inline mos6502_vector_t mos6502_vector_shift_left(mos6502_vector_t v)
+{
+    return v << 1;
+}
+
+static inline mos6502_vector_t mos6502_vector_shift_right(mos6502_vector_t v)
+{
+    return v >> 1;
+}
+
+static inline int mos6502_vector_any(mos6502_vector_t v)
+{
+    return v != 0;
+}
+
+#endif
+
+// mask ? a : b
+static inline mos6502_vector_t mos6502_vector_select(mos6502_vector_t mask, mos6502_vector_t a, mos6502_vector_t b)
+{
+    return mos6502_vector_or(mos6502_vector_and(mask, a), mos6502_vector_andnot(mask, b));
+}
+
+// stride is a multiple of this whatever vector width the build uses
+#define MOS6502_LANES_ALIGN 32
+
+// one instruction as a lockstep kernel: target = source (& a when and_a, | a
+// when or_a, shifted left or right by one when shift is 1 or -1), then flags =
+// (flags & ~clear) | set, the carry shifted out and N/Z from the result when nz
+// is set
+typedef struct mos6502_lanes_op
+{
+    // register array or memory row, NULL for an immediate
+    const uint8_t *source;
+    uint8_t immediate;
+    int and_a;
+    int or_a;
+    int shift;
+    // register array or memory row, NULL for flag only instructions
+    uint8_t *target;
+    int nz;
+    uint8_t clear;
+    uint8_t set;
+    int cycles;
+} mos6502_lanes_op_t;
+
+static uint8_t *mos6502_lanes_row(mos6502_lanes_t *lanes, uint16_t address)
+{
+    return lanes->memory + (size_t)address * lanes->stride;
+}
+
+// fill op with the kernel of the default handler of code[0], returns 0 if the
+// instruction has none (its lanes then run the handler one by one)
+static int mos6502_lanes_decode(mos6502_lanes_t *lanes, const uint8_t *code, mos6502_lanes_op_t *op)
+{
+    uint16_t zero_page = code[1];
+    uint16_t absolute = code[1] | (code[2] << 8);
+
+    memset(op, 0, sizeof(mos6502_lanes_op_t));
+    op->cycles = mos6502_opcode_cycles[code[0]];
+
+    switch (code[0])
+    {
+    case 0xA9: // lda #
+        op->immediate = code[1];
+        op->target = lanes->a;
+        op->nz = 1;
+        return 1;
+    case 0xA5: // lda zp
+        op->source = mos6502_lanes_row(lanes, zero_page);
+        op->target = lanes->a;
+        op->nz = 1;
+        return 1;
+    case 0xA2: // ldx #
+        op->immediate = code[1];
+        op->target = lanes->x;
+        op->nz = 1;
+        return 1;
+    case 0xA6: // ldx zp
+        op->source = mos6502_lanes_row(lanes, zero_page);
+        op->target = lanes->x;
+        op->nz = 1;
+        return 1;
+    case 0xAE: // ldx abs
+        op->source = mos6502_lanes_row(lanes, absolute);
+        op->target = lanes->x;
+        op->nz = 1;
+        return 1;
+    case 0x29: // and #
+        op->immediate = code[1];
+        op->and_a = 1;
+        op->target = lanes->a;
+        op->nz = 1;
+        return 1;
+    case 0x25: // and zp
+        op->source = mos6502_lanes_row(lanes, zero_page);
+        op->and_a = 1;
+        op->target = lanes->a;
+        op->nz = 1;
+        return 1;
+    case 0x09: // ora #
+        op->immediate = code[1];
+        op->or_a = 1;
+        op->target = lanes->a;
+        op->nz = 1;
+        return 1;
+    case 0x05: // ora zp
+        op->source = mos6502_lanes_row(lanes, zero_page);
+        op->or_a = 1;
+        op->target = lanes->a;
+        op->nz = 1;
+        return 1;
+    case 0x0A: // asl A
+    case 0x4A: // lsr A
+        op->source = lanes->a;
+        op->shift = code[0] == 0x0A ? 1 : -1;
+        op->target = lanes->a;
+        op->nz = 1;
+        op->clear = CARRY;
+        return 1;
+    case 0x85: // sta zp
+    case 0x8D: // sta abs
+        op->source = lanes->a;
+        op->target = mos6502_lanes_row(lanes, code[0] == 0x85 ? zero_page : absolute);
+        return 1;
+    case 0x86: // stx zp
+        op->source = lanes->x;
+        op->target = mos6502_lanes_row(lanes, zero_page);
+        return 1;
+    case 0x84: // sty zp
+    case 0x8C: // sty abs
+        op->source = lanes->y;
+        op->target = mos6502_lanes_row(lanes, code[0] == 0x84 ? zero_page : absolute);
+        return 1;
+    case 0xAA: // tax
+        op->source = lanes->a;
+        op->target = lanes->x;
+        op->nz = 1;
+        return 1;
+    case 0xA8: // tay
+        op->source = lanes->a;
+        op->target = lanes->y;
+        op->nz = 1;
+        return 1;
+    case 0x8A: // txa
+        op->source = lanes->x;
+        op->target = lanes->a;
+        op->nz = 1;
+        return 1;
+    case 0x98: // tya
+        op->source = lanes->y;
+        op->target = lanes->a;
+        op->nz = 1;
+        return 1;
+    case 0x18: // clc
+        op->clear = CARRY;
+        return 1;
+    case 0x38: // sec
+        op->set = CARRY;
+        return 1;
+    case 0xD8: // cld
+        op->clear = DECIMAL;
+        return 1;
+    case 0xF8: // sed
+        op->set = DECIMAL;
+        return 1;
+    case 0xB8: // clv
+        op->clear = OVERFLOW;
+        return 1;
+    case 0xEA: // nop
+        return 1;
+    }
+    return 0;
+}
+
+static void mos6502_lanes_execute(mos6502_lanes_t *lanes, const mos6502_lanes_op_t *op)
+{
+    mos6502_vector_t immediate = mos6502_vector_set(op->immediate);
+    mos6502_vector_t clear = mos6502_vector_set(op->clear | (op->nz ? NEGATIVE | ZERO : 0));
+    mos6502_vector_t set = mos6502_vector_set(op->set);
+    mos6502_vector_t negative = mos6502_vector_set(NEGATIVE);
+    mos6502_vector_t zero = mos6502_vector_set(ZERO);
+    mos6502_vector_t nothing = mos6502_vector_set(0);
+    mos6502_vector_t carry = mos6502_vector_set(CARRY);
+    int flags = op->nz || op->clear || op->set;
+
+    for (int i = 0; i < lanes->stride; i += MOS6502_VECTOR_BYTES)
+    {
+        mos6502_vector_t active = mos6502_vector_load(lanes->active + i);
+        mos6502_vector_t value = op->source ? mos6502_vector_load(op->source + i) : immediate;
+
+        mos6502_vector_t shifted_out = nothing;
+
+        if (op->and_a)
+        {
+            value = mos6502_vector_and(value, mos6502_vector_load(lanes->a + i));
+        }
+        if (op->or_a)
+        {
+            value = mos6502_vector_or(value, mos6502_vector_load(lanes->a + i));
+        }
+        if (op->shift > 0)
+        {
+            shifted_out = mos6502_vector_and(mos6502_vector_equal(mos6502_vector_and(value, negative), negative), carry);
+            value = mos6502_vector_shift_left(value);
+        }
+        else if (op->shift < 0)
+        {
+            shifted_out = mos6502_vector_and(value, carry);
+            value = mos6502_vector_shift_right(value);
+        }
+        if (op->target)
+        {
+            mos6502_vector_store(op->target + i, mos6502_vector_select(active, value, mos6502_vector_load(op->target + i)));
+        }
+        if (flags)
+        {
+            mos6502_vector_t old = mos6502_vector_load(lanes->flags + i);
+            mos6502_vector_t updated = mos6502_vector_or(mos6502_vector_andnot(clear, old), set);
+            updated = mos6502_vector_or(updated, shifted_out);
+            if (op->nz)
+            {
+                updated = mos6502_vector_or(updated, mos6502_vector_and(value, negative));
+                updated = mos6502_vector_or(updated, mos6502_vector_and(mos6502_vector_equal(value, nothing), zero));
+            }
+            mos6502_vector_store(lanes->flags + i, mos6502_vector_select(active, updated, old));
+        }
+    }
+}
+
+// whether some active lane holds other code bytes than the instruction the
+// group runs, narrow drops those lanes from active
+static int mos6502_lanes_match(mos6502_lanes_t *lanes, uint16_t pc, const uint8_t *code, int length, int narrow)
+{
+    mos6502_vector_t mismatch = mos6502_vector_set(0);
+
+    for (int i = 0; i < length; i++)
+    {
+        const uint8_t *row = mos6502_lanes_row(lanes, pc + i);
+        mos6502_vector_t expected = mos6502_vector_set(code[i]);
+        for (int lane = 0; lane < lanes->stride; lane += MOS6502_VECTOR_BYTES)
+        {
+            mos6502_vector_t active = mos6502_vector_load(lanes->active + lane);
+            mos6502_vector_t same = mos6502_vector_equal(mos6502_vector_load(row + lane), expected);
+            mismatch = mos6502_vector_or(mismatch, mos6502_vector_andnot(same, active));
+            if (narrow)
+            {
+                mos6502_vector_store(lanes->active + lane, mos6502_vector_and(active, same));
+            }
+        }
+    }
+    return mos6502_vector_any(mismatch);
+}
+
+// a lane seen through mos6502_t, for the instructions without a kernel
+typedef struct mos6502_lane_cpu
+{
+    mos6502_t base;
+    mos6502_lanes_t *lanes;
+    int lane;
+} mos6502_lane_cpu_t;
+
+static uint8_t mos6502_lane_read(mos6502_t *cpu, uint16_t address)
+{
+    mos6502_lane_cpu_t *lane_cpu = (mos6502_lane_cpu_t *)cpu;
+    return mos6502_lanes_read8(lane_cpu->lanes, lane_cpu->lane, address);
+}
+
+static void mos6502_lane_write(mos6502_t *cpu, uint16_t address, uint8_t value)
+{
+    mos6502_lane_cpu_t *lane_cpu = (mos6502_lane_cpu_t *)cpu;
+    mos6502_lanes_write8(lane_cpu->lanes, lane_cpu->lane, address, value);
+}
+
+static void mos6502_lanes_tick(mos6502_lanes_t *lanes, mos6502_lane_cpu_t *lane_cpu, int lane)
+{
+    mos6502_t *cpu = &lane_cpu->base;
+
+    lane_cpu->lane = lane;
+    cpu->a = lanes->a[lane];
+    cpu->x = lanes->x[lane];
+    cpu->y = lanes->y[lane];
+    cpu->pc = lanes->pc[lane];
+    cpu->sp = lanes->sp[lane];
+    cpu->flags = lanes->flags[lane];
+    cpu->cycles = lanes->cycles[lane];
+
+    if (mos6502_tick(cpu) < 0)
+    {
+        lanes->stop[lane] = MOS6502_STOP_UNKNOWN_OPCODE;
+    }
+    else
+    {
+        lanes->instructions++;
+    }
+
+    lanes->a[lane] = cpu->a;
+    lanes->x[lane] = cpu->x;
+    lanes->y[lane] = cpu->y;
+    lanes->pc[lane] = cpu->pc;
+    lanes->sp[lane] = cpu->sp;
+    lanes->flags[lane] = cpu->flags;
+    lanes->cycles[lane] = cpu->cycles;
+}
+
+// lanes of a group share pc and add the same cycles, so while it runs they are
+// only tracked as a whole. write the group state back to each lane
+static void mos6502_lanes_flush(mos6502_lanes_t *lanes, uint16_t pc, uint64_t pending)
+{
+    for (int lane = 0; lane < lanes->count; lane++)
+    {
+        if (lanes->active[lane])
+        {
+            lanes->pc[lane] = pc;
+            lanes->cycles[lane] += pending;
+        }
+    }
+}
+
+// size of the group in active, and the highest cycle counter in it
+static int mos6502_lanes_group(mos6502_lanes_t *lanes, uint64_t *highest)
+{
+    int size = 0;
+    *highest = 0;
+    for (int lane = 0; lane < lanes->count; lane++)
+    {
+        if (lanes->active[lane])
+        {
+            size++;
+            *highest = lanes->cycles[lane] > *highest ? lanes->cycles[lane] : *highest;
+        }
+    }
+    return size;
+}
+
+int mos6502_lanes_run(mos6502_lanes_t *lanes, uint64_t until)
+{
+    mos6502_lane_cpu_t lane_cpu;
+    mos6502_init(&lane_cpu.base);
+    lane_cpu.base.read = mos6502_lane_read;
+    lane_cpu.base.write = mos6502_lane_write;
+    lane_cpu.base.rst = 0;
+    lane_cpu.lanes = lanes;
+
+    // the group: lanes in active, all at pc, all pending cycles behind
+    int size = 0;
+    int first = 0;
+    uint16_t pc = 0;
+    uint64_t pending = 0;
+    uint64_t highest = 0;
+
+    for (;;)
+    {
+        if (size == 0)
+        {
+            // the lowest pc goes first, so lanes that fell behind catch up
+            uint32_t lowest = 0x10000;
+            for (int lane = 0; lane < lanes->count; lane++)
+            {
+                if (lanes->stop[lane] < 0 && lanes->cycles[lane] < until && lanes->pc[lane] < lowest)
+                {
+                    lowest = lanes->pc[lane];
+                    first = lane;
+                }
+            }
+            if (lowest == 0x10000)
+            {
+                break;
+            }
+
+            pc = lowest;
+            pending = 0;
+            for (int lane = 0; lane < lanes->stride; lane++)
+            {
+                int runnable = lanes->stop[lane] < 0 && lanes->cycles[lane] < until;
+                lanes->active[lane] = runnable && lanes->pc[lane] == pc ? 0xFF : 0x00;
+            }
+            size = mos6502_lanes_group(lanes, &highest);
+        }
+
+        // a lane of the group is out of cycles, regroup without it
+        if (highest + pending >= until)
+        {
+            mos6502_lanes_flush(lanes, pc, pending);
+            size = 0;
+            continue;
+        }
+
+        uint8_t code[3];
+        for (int i = 0; i < 3; i++)
+        {
+            code[i] = mos6502_lanes_read8(lanes, first, pc + i);
+        }
+        int length = mos6502_opcode_length[code[0]];
+        if (mos6502_lanes_match(lanes, pc, code, length, 0))
+        {
+            mos6502_lanes_flush(lanes, pc, pending);
+            pending = 0;
+            mos6502_lanes_match(lanes, pc, code, length, 1);
+            size = mos6502_lanes_group(lanes, &highest);
+        }
+
+        mos6502_lanes_op_t op;
+        if (!mos6502_lanes_decode(lanes, code, &op))
+        {
+            mos6502_lanes_flush(lanes, pc, pending);
+            for (int lane = 0; lane < lanes->count; lane++)
+            {
+                if (lanes->active[lane])
+                {
+                    mos6502_lanes_tick(lanes, &lane_cpu, lane);
+                }
+            }
+            size = 0;
+            continue;
+        }
+
+        mos6502_lanes_execute(lanes, &op);
+        pc += length;
+        pending += op.cycles;
+        lanes->instructions += size;
+    }
+
+    int running = 0;
+    for (int lane = 0; lane < lanes->count; lane++)
+    {
+        running += lanes->stop[lane] < 0;
+    }
+    return running;
+}
+
+uint8_t mos6502_lanes_read8(mos6502_lanes_t *lanes, int lane, uint16_t address)
+{
+    return lanes->memory[(size_t)address * lanes->stride + lane];
+}
+
+void mos6502_lanes_write8(mos6502_lanes_t *lanes, int lane, uint16_t address, uint8_t value)
+{
+    lanes->memory[(size_t)address * lanes->stride + lane] = value;
+}
+
+void mos6502_lanes_reset(mos6502_lanes_t *lanes)
+{
+    for (int lane = 0; lane < lanes->count; lane++)
+    {
+        lanes->pc[lane] = mos6502_lanes_read8(lanes, lane, 0xFFFC) | (mos6502_lanes_read8(lanes, lane, 0xFFFD) << 8);
+    }
+}
+
+int mos6502_lanes_init(mos6502_lanes_t *lanes, int count)
+{
+    memset(lanes, 0, sizeof(mos6502_lanes_t));
+    lanes->count = count;
+    lanes->stride = (count + MOS6502_LANES_ALIGN - 1) / MOS6502_LANES_ALIGN * MOS6502_LANES_ALIGN;
+
+    lanes->a = calloc(lanes->stride, 1);
+    lanes->x = calloc(lanes->stride, 1);
+    lanes->y = calloc(lanes->stride, 1);
+    lanes->pc = calloc(lanes->stride, sizeof(uint16_t));
+    lanes->sp = calloc(lanes->stride, 1);
+    lanes->flags = calloc(lanes->stride, 1);
+    lanes->cycles = calloc(lanes->stride, sizeof(uint64_t));
+    lanes->stop = malloc(lanes->stride);
+    lanes->active = calloc(lanes->stride, 1);
+    lanes->memory = calloc(65536, lanes->stride);
+
+    if (!lanes->a || !lanes->x || !lanes->y || !lanes->pc || !lanes->sp || !lanes->flags ||
+        !lanes->cycles || !lanes->stop || !lanes->active || !lanes->memory)
+    {
+        mos6502_lanes_free(lanes);
+        return -1;
+    }
+
+    memset(lanes->stop, -1, lanes->count);
+    // padding lanes are stopped for good
+    memset(lanes->stop + lanes->count, MOS6502_STOP_HALT, lanes->stride - lanes->count);
+    return 0;
+}
+
+void mos6502_lanes_free(mos6502_lanes_t *lanes)
+{
+    free(lanes->a);
+    free(lanes->x);
+    free(lanes->y);
+    free(lanes->pc);
+    free(lanes->sp);
+    free(lanes->flags);
+    free(lanes->cycles);
+    free(lanes->stop);
+    free(lanes->active);
+    free(lanes->memory);
+    memset(lanes, 0, sizeof(mos6502_lanes_t));
+}
+
+#ifdef _TEST
+
+// every lane runs the same program on its own input at $10
+static const uint8_t test_lanes_program[] = {
+    0xA5, 0x10, // lda $10
+    0x29, 0x0F, // and #$0F
+    0xAA,       // tax
+    0x38,       // sec
+    0x25, 0x11, // and $11
+    0x8D, 0x00, 0x02, // sta $0200
+    0xA6, 0x10, // ldx $10
+    0x4A,       // lsr
+    0xA8,       // tay
+    0x84, 0x12, // sty $12
+    0xA5, 0x10, // lda $10
+    0x0A,       // asl
+    0x09, 0x21, // ora #$21
+    0x05, 0x11, // ora $11
+    0x6A,       // ror (scalar handler, rotates the carry of asl in)
+    0x4A,       // lsr
+    0x8D, 0x01, 0x02, // sta $0201
+};
+
+static int test_lanes_matches_scalar(mos6502_t *cpu)
+{
+    mos6502_lanes_t lanes;
+    if (mos6502_lanes_init(&lanes, 40))
+    {
+        return 0;
+    }
+
+    for (int lane = 0; lane < lanes.count; lane++)
+    {
+        for (int i = 0; i < sizeof(test_lanes_program); i++)
+        {
+            mos6502_lanes_write8(&lanes, lane, 0x8000 + i, test_lanes_program[i]);
+        }
+        mos6502_lanes_write8(&lanes, lane, 0x8000 + sizeof(test_lanes_program), 0x02);
+        mos6502_lanes_write8(&lanes, lane, 0x0010, lane * 37);
+        mos6502_lanes_write8(&lanes, lane, 0x0011, 0x0C);
+        mos6502_lanes_write8(&lanes, lane, 0xFFFC, 0x00);
+        mos6502_lanes_write8(&lanes, lane, 0xFFFD, 0x80);
+    }
+    mos6502_lanes_reset(&lanes);
+    int running = mos6502_lanes_run(&lanes, 1000);
+
+    // each lane against the same program run by the cpu of the test
+    int same = running == 0;
+    for (int lane = 0; lane < lanes.count; lane++)
+    {
+        cpu->a = cpu->x = cpu->y = cpu->flags = 0;
+        cpu->cycles = 0;
+        cpu->pc = 0x8000;
+        mos6502_test_program(cpu, test_lanes_program, sizeof(test_lanes_program));
+        mos6502_write8(cpu, 0x8000 + sizeof(test_lanes_program), 0x02);
+        mos6502_write8(cpu, 0x0010, lane * 37);
+        mos6502_write8(cpu, 0x0011, 0x0C);
+        mos6502_write8(cpu, 0x0012, 0x00);
+        mos6502_write8(cpu, 0x0200, 0x00);
+        mos6502_write8(cpu, 0x0201, 0x00);
+        mos6502_run(cpu, 1000, NULL);
+
+        same &= lanes.a[lane] == cpu->a && lanes.x[lane] == cpu->x && lanes.y[lane] == cpu->y &&
+                lanes.pc[lane] == cpu->pc && lanes.flags[lane] == cpu->flags && lanes.cycles[lane] == cpu->cycles &&
+                mos6502_lanes_read8(&lanes, lane, 0x0200) == mos6502_read8(cpu, 0x0200) &&
+                mos6502_lanes_read8(&lanes, lane, 0x0201) == mos6502_read8(cpu, 0x0201) &&
+                mos6502_lanes_read8(&lanes, lane, 0x0012) == mos6502_read8(cpu, 0x0012);
+    }
+    same &= lanes.instructions == lanes.count * 17;
+
+    mos6502_lanes_free(&lanes);
+    return same;
+}
+
+static int test_lanes_divergent_code(mos6502_t *cpu)
+{
+    mos6502_lanes_t lanes;
+    if (mos6502_lanes_init(&lanes, 3))
+    {
+        return 0;
+    }
+
+    // lane 1 runs ldx # where the others run lda #
+    for (int lane = 0; lane < lanes.count; lane++)
+    {
+        mos6502_lanes_write8(&lanes, lane, 0x0000, lane == 1 ? 0xA2 : 0xA9);
+        mos6502_lanes_write8(&lanes, lane, 0x0001, 0x80);
+    }
+    mos6502_lanes_run(&lanes, 2);
+
+    int result = lanes.a[0] == 0x80 && lanes.x[0] == 0x00 && lanes.a[1] == 0x00 && lanes.x[1] == 0x80 &&
+                 lanes.a[2] == 0x80 && lanes.flags[1] == NEGATIVE && lanes.pc[1] == 0x0002 &&
+                 lanes.cycles[0] == 2 && lanes.cycles[1] == 2 && lanes.cycles[2] == 2;
+    mos6502_lanes_free(&lanes);
+    return result;
+}
+
+static int test_lanes_until(mos6502_t *cpu)
+{
+    mos6502_lanes_t lanes;
+    if (mos6502_lanes_init(&lanes, 2))
+    {
+        return 0;
+    }
+
+    // nops everywhere, lane 1 starts ahead
+    memset(lanes.memory, 0xEA, (size_t)65536 * lanes.stride);
+    lanes.cycles[1] = 3;
+    int running = mos6502_lanes_run(&lanes, 5);
+
+    int result = running == 2 && lanes.cycles[0] == 6 && lanes.pc[0] == 3 && lanes.cycles[1] == 5 &&
+                 lanes.pc[1] == 1 && lanes.instructions == 4;
+    mos6502_lanes_free(&lanes);
+    return result;
+}
+
+void test_mos6502_lanes()
+{
+    RUN_TEST(test_lanes_matches_scalar);
+    RUN_TEST(test_lanes_divergent_code);
+    RUN_TEST(test_lanes_until);
+}
+#endif
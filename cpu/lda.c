@@ -1,29 +1,4 @@
-#include "mos6502.h"
-
-static int lda_immediate(mos6502_t *cpu)
-{
-    uint8_t immediate = cpu->read(cpu, cpu->pc++);
-    cpu->a = immediate;
-    mos6502_set_flag(cpu, NEGATIVE, cpu->a & NEGATIVE);
-    mos6502_set_flag(cpu, ZERO, cpu->a == 0);
-    return 2;
-}
-
-static int lda_zero_page(mos6502_t *cpu)
-{
-    uint8_t zp_address = cpu->read(cpu, cpu->pc++);
-    cpu->a = mos6502_read8(cpu, (uint16_t)zp_address);
-    mos6502_set_flag(cpu, NEGATIVE, cpu->a & NEGATIVE);
-    mos6502_set_flag(cpu, ZERO, cpu->a == 0);
-    return 3;
-}
-
-
-void mos6502_register_lda(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0xA9, lda_immediate);
-    mos6502_register_opcode(cpu, 0xA5, lda_zero_page);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
@@ -1,67 +1,4 @@
-#include "mos6502.h"
-
-static int ldx_immediate(mos6502_t *cpu)
-{
-    uint8_t immediate = cpu->read(cpu, cpu->pc++);
-    cpu->x = immediate;
-    mos6502_set_flag(cpu, NEGATIVE, cpu->x & NEGATIVE);
-    mos6502_set_flag(cpu, ZERO, cpu->x == 0);
-    return 2;
-}
-
-static int ldx_zero_page(mos6502_t *cpu)
-{
-    uint8_t zp_address = cpu->read(cpu, cpu->pc++);
-    cpu->x = mos6502_read8(cpu, (uint16_t)zp_address);
-    mos6502_set_flag(cpu, NEGATIVE, cpu->x & NEGATIVE);
-    mos6502_set_flag(cpu, ZERO, cpu->x == 0);
-    return 3;
-}
-
-static int ldx_zero_page_y(mos6502_t *cpu)
-{    
-    uint8_t zp_address = cpu->read(cpu, cpu->pc++);
-    uint16_t new_address = zp_address + cpu->y;
-    cpu->x = mos6502_read8(cpu, new_address);
-    mos6502_set_flag(cpu, NEGATIVE, cpu->x & NEGATIVE);
-    mos6502_set_flag(cpu, ZERO, cpu->x == 0);
-    uint8_t boundary_page = (new_address >> 8);    
-    return 4 + boundary_page;
-}
-
-static int ldx_absolute(mos6502_t *cpu)
-{
-    uint8_t low = cpu->read(cpu, cpu->pc++);
-    uint8_t high = cpu->read(cpu, cpu->pc++);
-    uint16_t address = (high << 8) | low;   
-    cpu->x = mos6502_read8(cpu, address);
-    mos6502_set_flag(cpu, NEGATIVE, cpu->x & NEGATIVE);
-    mos6502_set_flag(cpu, ZERO, cpu->x == 0);  
-    return 4;
-}
-
-static int ldx_absolute_y(mos6502_t *cpu)
-{
-    uint8_t low = cpu->read(cpu, cpu->pc++);
-    uint8_t high = cpu->read(cpu, cpu->pc++);
-    uint16_t address = (high << 8) | low;
-    uint16_t new_address = address + cpu->y;
-    cpu->x = mos6502_read8(cpu, address + cpu->y);
-    mos6502_set_flag(cpu, NEGATIVE, cpu->x & NEGATIVE);
-    mos6502_set_flag(cpu, ZERO, cpu->x == 0);
-    uint8_t boundary_page = (new_address >> 8) - high;
-    return 4 + boundary_page;
-}
-
-
-void mos6502_register_ldx(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0xA2, ldx_immediate);
-    mos6502_register_opcode(cpu, 0xA6, ldx_zero_page);
-    mos6502_register_opcode(cpu, 0xB6, ldx_zero_page_y);
-    mos6502_register_opcode(cpu, 0xAE, ldx_absolute);
-    mos6502_register_opcode(cpu, 0xBE, ldx_absolute_y);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
@@ -157,21 +94,21 @@ static int test_ldx_zero_page_y_negative(mos6502_t *cpu)
 static int test_ldx_zero_page_y_page_boundary(mos6502_t *cpu)
 {
     cpu->y = 2;
-    mos6502_write8(cpu, 0x0101, 0x44);
+    mos6502_write8(cpu, 0x0001, 0x44);
     mos6502_write8(cpu, 0x8000, 0xB6);
     mos6502_write8(cpu, 0x8001, 0xFF);
     int ticks = mos6502_tick(cpu);
-    return ticks == 5 && cpu->x == 0x44 && cpu->pc == 0x8002 && cpu->flags == 0;
+    return ticks == 4 && cpu->x == 0x44 && cpu->pc == 0x8002 && cpu->flags == 0;
 }
 
 static int test_ldx_zero_page_y_page_boundary_negative(mos6502_t *cpu)
 {
     cpu->y = 2;
-    mos6502_write8(cpu, 0x0101, 0xF0);
+    mos6502_write8(cpu, 0x0001, 0xF0);
     mos6502_write8(cpu, 0x8000, 0xB6);
     mos6502_write8(cpu, 0x8001, 0xFF);
     int ticks = mos6502_tick(cpu);
-    return ticks == 5 && cpu->x == 0xF0 && cpu->pc == 0x8002 && cpu->flags == NEGATIVE;
+    return ticks == 4 && cpu->x == 0xF0 && cpu->pc == 0x8002 && cpu->flags == NEGATIVE;
 }
 
 static int test_ldx_absolute(mos6502_t *cpu)
@@ -0,0 +1,131 @@
+#include "mos6502.h"
+
+const mos6502_page_map_t mos6502_unmapped;
+
+void mos6502_map_init(mos6502_page_map_t *map)
+{
+    memset(map, 0, sizeof(mos6502_page_map_t));
+}
+
+void mos6502_map_pages(mos6502_page_map_t *map, uint8_t first_page, int count, uint8_t *memory, int read_only)
+{
+    for (int i = 0; i < count && first_page + i < 256; i++)
+    {
+        map->read[first_page + i] = memory + i * 256;
+        map->write[first_page + i] = read_only ? NULL : memory + i * 256;
+    }
+}
+
+void mos6502_unmap_pages(mos6502_page_map_t *map, uint8_t first_page, int count)
+{
+    for (int i = 0; i < count && first_page + i < 256; i++)
+    {
+        map->read[first_page + i] = NULL;
+        map->write[first_page + i] = NULL;
+    }
+}
+
+#ifdef _TEST
+
+static int test_map_read(mos6502_t *cpu)
+{
+    uint8_t ram[256] = {0};
+    const mos6502_page_map_t *pages = cpu->pages;
+    mos6502_page_map_t map;
+    mos6502_map_init(&map);
+    mos6502_map_pages(&map, 0x40, 1, ram, 0);
+    cpu->pages = &map;
+    ram[0x10] = 0x55;
+    int result = mos6502_read8(cpu, 0x4010) == 0x55 && cpu->read(cpu, 0x4010) == 0x00;
+    cpu->pages = pages;
+    return result;
+}
+
+static int test_map_write(mos6502_t *cpu)
+{
+    uint8_t ram[256] = {0};
+    const mos6502_page_map_t *pages = cpu->pages;
+    mos6502_page_map_t map;
+    mos6502_map_init(&map);
+    mos6502_map_pages(&map, 0x40, 1, ram, 0);
+    cpu->pages = &map;
+    mos6502_write8(cpu, 0x40FE, 0x66);
+    int result = ram[0xFE] == 0x66 && cpu->read(cpu, 0x40FE) == 0x00;
+    cpu->pages = pages;
+    return result;
+}
+
+static int test_map_read_only(mos6502_t *cpu)
+{
+    uint8_t rom[256] = {0};
+    const mos6502_page_map_t *pages = cpu->pages;
+    mos6502_page_map_t map;
+    mos6502_map_init(&map);
+    mos6502_map_pages(&map, 0x40, 1, rom, 1);
+    cpu->pages = &map;
+    rom[0x01] = 0x11;
+    mos6502_write8(cpu, 0x4001, 0x22);
+    int result = rom[0x01] == 0x11 && mos6502_read8(cpu, 0x4001) == 0x11 && cpu->read(cpu, 0x4001) == 0x22;
+    cpu->pages = pages;
+    return result;
+}
+
+static int test_map_unmapped(mos6502_t *cpu)
+{
+    uint8_t ram[512] = {0};
+    const mos6502_page_map_t *pages = cpu->pages;
+    mos6502_page_map_t map;
+    mos6502_map_init(&map);
+    mos6502_map_pages(&map, 0x40, 2, ram, 0);
+    mos6502_unmap_pages(&map, 0x41, 1);
+    cpu->pages = &map;
+    mos6502_write8(cpu, 0x4100, 0x33);
+    int result = ram[0x100] == 0x00 && mos6502_read8(cpu, 0x4100) == 0x33;
+    cpu->pages = pages;
+    return result;
+}
+
+static int test_map_read16_page_cross(mos6502_t *cpu)
+{
+    uint8_t ram[512] = {0};
+    const mos6502_page_map_t *pages = cpu->pages;
+    mos6502_page_map_t map;
+    mos6502_map_init(&map);
+    mos6502_map_pages(&map, 0x40, 1, ram, 0);
+    mos6502_map_pages(&map, 0x41, 1, ram + 256, 0);
+    cpu->pages = &map;
+    mos6502_write16(cpu, 0x40FF, 0x1234);
+    int result = ram[0xFF] == 0x34 && ram[0x100] == 0x12 && mos6502_read16(cpu, 0x40FF) == 0x1234;
+    cpu->pages = pages;
+    return result;
+}
+
+static int test_map_lda_zero_page(mos6502_t *cpu)
+{
+    uint8_t zero_page[256] = {0};
+    uint8_t rom[256] = {0};
+    const mos6502_page_map_t *pages = cpu->pages;
+    mos6502_page_map_t map;
+    mos6502_map_init(&map);
+    mos6502_map_pages(&map, 0x00, 1, zero_page, 0);
+    mos6502_map_pages(&map, 0x80, 1, rom, 1);
+    cpu->pages = &map;
+    zero_page[0x34] = 0x77;
+    rom[0x00] = 0xA5;
+    rom[0x01] = 0x34;
+    int ticks = mos6502_tick(cpu);
+    int result = ticks == 3 && cpu->a == 0x77 && cpu->pc == 0x8002;
+    cpu->pages = pages;
+    return result;
+}
+
+void test_mos6502_memory()
+{
+    RUN_TEST(test_map_read);
+    RUN_TEST(test_map_write);
+    RUN_TEST(test_map_read_only);
+    RUN_TEST(test_map_unmapped);
+    RUN_TEST(test_map_read16_page_cross);
+    RUN_TEST(test_map_lda_zero_page);
+}
+#endif
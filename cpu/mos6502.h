@@ -3,6 +3,27 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+struct mos6502;
+struct mos6502_jit;
+struct mos6502_predecode;
+struct mos6502_cow;
+struct mos6502_stats;
+struct mos6502_trace;
+struct mos6502_debug;
+struct mos6502_events;
+struct mos6502_replay;
+
+typedef int (*mos6502_opcode_t)(struct mos6502 *cpu);
+
+// direct host memory for each 256 byte guest page, NULL pages use the read/write
+// callbacks. read-only pages have a read pointer and no write pointer, so writes
+// to them reach the write callback
+typedef struct mos6502_page_map
+{
+    uint8_t *read[256];
+    uint8_t *write[256];
+} mos6502_page_map_t;
+
 typedef struct mos6502
 {
     uint8_t a;
@@ -18,97 +39,619 @@ typedef struct mos6502
     int rst;
     int rdy;
 
+    // total cycles executed since mos6502_init
+    uint64_t cycles;
+
+    // cycle the current mos6502_run stops at or its next event is due (0
+    // outside of it), idle loops fast-forward up to it
+    uint64_t end;
+
+    // state at the last taken backward branch, for idle loop detection
+    struct
+    {
+        uint64_t cycles;
+        uint32_t period;
+        uint16_t pc;
+        uint8_t a;
+        uint8_t x;
+        uint8_t y;
+        uint8_t sp;
+        uint8_t flags;
+    } idle;
+
+#ifdef MOS6502_LAZY_FLAGS
+    // N/Z/C/V as left by the last instruction, folded back into flags by
+    // mos6502_flags_sync: Z is set when the low byte of lazy_nz is 0, N is
+    // bit 7 of either byte, C is bit 0 of lazy_c and V bit 7 of lazy_v
+    uint16_t lazy_nz;
+    uint8_t lazy_c;
+    uint8_t lazy_v;
+#endif
+
     uint8_t (*read)(struct mos6502 *cpu, uint16_t address);
     void (*write)(struct mos6502 *cpu, uint16_t address, uint8_t value);
 
-    int (*opcodes[256])(struct mos6502 *cpu);
+    // page map consulted before the callbacks (mos6502_unmapped by default)
+    const mos6502_page_map_t *pages;
+
+    // shared, read-only dispatch table (mos6502_opcodes unless a variant is selected)
+    const mos6502_opcode_t *opcodes;
+
+    // translation cache while the jit is enabled, NULL otherwise
+    struct mos6502_jit *jit;
+
+    // decoded instruction cache while predecoding is enabled, NULL otherwise
+    struct mos6502_predecode *predecode;
+
+    // copy-on-write memory backing the whole address space, NULL if none
+    struct mos6502_cow *cow;
+
+    // execution counters while collecting with MOS6502_STATS, NULL otherwise
+    struct mos6502_stats *stats;
+
+    // ring buffer of the last instructions while tracing, NULL otherwise
+    struct mos6502_trace *trace;
+
+    // breakpoints and watchpoints while debugging, NULL otherwise
+    struct mos6502_debug *debug;
+
+    // pending scheduled events, NULL until the first is scheduled
+    struct mos6502_events *events;
+
+    // input log while recording or replaying, NULL otherwise
+    struct mos6502_replay *replay;
 } mos6502_t;
 
-#define CARRY 1
-#define ZERO 1 << 1
-#define INTERRUPT 1 << 2
-#define DECIMAL 1 << 3
-#define OVERFLOW 1 << 6
-#define NEGATIVE 1 << 7
+extern const mos6502_opcode_t mos6502_opcodes[256];
+extern const mos6502_page_map_t mos6502_unmapped;
+
+#define CARRY (1)
+#define ZERO (1 << 1)
+#define INTERRUPT (1 << 2)
+#define DECIMAL (1 << 3)
+#define OVERFLOW (1 << 6)
+#define NEGATIVE (1 << 7)
+
+#define MOS6502_LAZY_MASK (NEGATIVE | ZERO | CARRY | OVERFLOW)
+
+// with MOS6502_LAZY_FLAGS the N/Z/C/V bits of cpu->flags are only up to date
+// outside mos6502_tick/mos6502_run (or after mos6502_flags_sync). without it
+// these are no-ops and flags is always current
+static inline void mos6502_flags_sync(mos6502_t *cpu)
+{
+#ifdef MOS6502_LAZY_FLAGS
+    uint8_t flags = cpu->flags & ~MOS6502_LAZY_MASK;
+    flags |= (cpu->lazy_nz | (cpu->lazy_nz >> 8)) & NEGATIVE;
+    flags |= (cpu->lazy_nz & 0xFF) == 0 ? ZERO : 0;
+    flags |= cpu->lazy_c & CARRY;
+    flags |= (cpu->lazy_v & 0x80) >> 1;
+    cpu->flags = flags;
+#endif
+}
+
+#ifdef MOS6502_LAZY_FLAGS
+static inline uint16_t mos6502_lazy_nz(int negative, int zero)
+{
+    if (zero)
+    {
+        return negative ? 0x8000 : 0;
+    }
+    return negative ? 0x80 : 1;
+}
+#endif
 
-void mos6502_set_flag(mos6502_t *cpu, int flag, int value);
-int mos6502_get_flag(mos6502_t *cpu, int flag);
+static inline void mos6502_flags_load(mos6502_t *cpu)
+{
+#ifdef MOS6502_LAZY_FLAGS
+    cpu->lazy_nz = mos6502_lazy_nz(cpu->flags & NEGATIVE, cpu->flags & ZERO);
+    cpu->lazy_c = cpu->flags & CARRY;
+    cpu->lazy_v = (cpu->flags & OVERFLOW) << 1;
+#endif
+}
 
-uint8_t mos6502_read8(mos6502_t *cpu, uint16_t address);
-void mos6502_write8(mos6502_t *cpu, uint16_t address, uint8_t value);
+static inline int mos6502_get_flag(mos6502_t *cpu, int flag)
+{
+#ifdef MOS6502_LAZY_FLAGS
+    switch (flag)
+    {
+    case NEGATIVE:
+        return ((cpu->lazy_nz | (cpu->lazy_nz >> 8)) & NEGATIVE) != 0;
+    case ZERO:
+        return (cpu->lazy_nz & 0xFF) == 0;
+    case CARRY:
+        return cpu->lazy_c & CARRY;
+    case OVERFLOW:
+        return cpu->lazy_v >> 7;
+    }
+    if (flag & MOS6502_LAZY_MASK)
+    {
+        mos6502_flags_sync(cpu);
+    }
+#endif
+    return (cpu->flags & flag) != 0;
+}
 
-uint16_t mos6502_read16(mos6502_t *cpu, uint16_t address);
-void mos6502_write16(mos6502_t *cpu, uint16_t address, uint16_t value);
+static inline void mos6502_set_flag(mos6502_t *cpu, int flag, int value)
+{
+#ifdef MOS6502_LAZY_FLAGS
+    if (flag & (NEGATIVE | ZERO))
+    {
+        int negative = flag & NEGATIVE ? value : mos6502_get_flag(cpu, NEGATIVE);
+        int zero = flag & ZERO ? value : mos6502_get_flag(cpu, ZERO);
+        cpu->lazy_nz = mos6502_lazy_nz(negative, zero);
+    }
+    if (flag & CARRY)
+    {
+        cpu->lazy_c = value != 0;
+    }
+    if (flag & OVERFLOW)
+    {
+        cpu->lazy_v = value ? 0x80 : 0;
+    }
+#endif
+    if (value)
+    {
+        cpu->flags |= flag;
+    }
+    else
+    {
+        cpu->flags &= ~flag;
+    }
+}
+
+// N and Z from an instruction result
+static inline void mos6502_set_nz(mos6502_t *cpu, uint8_t value)
+{
+#ifdef MOS6502_LAZY_FLAGS
+    cpu->lazy_nz = value;
+#else
+    cpu->flags = (cpu->flags & ~(NEGATIVE | ZERO)) | (value & NEGATIVE) | (value == 0 ? ZERO : 0);
+#endif
+}
+
+// C from a 0/1 carry out
+static inline void mos6502_set_carry(mos6502_t *cpu, uint8_t carry)
+{
+#ifdef MOS6502_LAZY_FLAGS
+    cpu->lazy_c = carry;
+#else
+    cpu->flags = (cpu->flags & ~CARRY) | carry;
+#endif
+}
+
+// V from a 0/1 overflow
+static inline void mos6502_set_overflow(mos6502_t *cpu, uint8_t overflow)
+{
+#ifdef MOS6502_LAZY_FLAGS
+    cpu->lazy_v = overflow << 7;
+#else
+    cpu->flags = (cpu->flags & ~OVERFLOW) | (overflow << 6);
+#endif
+}
+
+static inline uint8_t mos6502_read8(mos6502_t *cpu, uint16_t address)
+{
+    const uint8_t *page = cpu->pages->read[address >> 8];
+    if (page)
+    {
+        return page[address & 0xFF];
+    }
+    return cpu->read(cpu, address);
+}
+
+static inline void mos6502_write8(mos6502_t *cpu, uint16_t address, uint8_t value)
+{
+    uint8_t *page = cpu->pages->write[address >> 8];
+    if (page)
+    {
+        page[address & 0xFF] = value;
+        return;
+    }
+    cpu->write(cpu, address, value);
+}
+
+static inline uint16_t mos6502_read16(mos6502_t *cpu, uint16_t address)
+{
+    const uint8_t *page = cpu->pages->read[address >> 8];
+    if (page && (address & 0xFF) != 0xFF)
+    {
+        return (uint16_t)page[address & 0xFF] | ((uint16_t)page[(address & 0xFF) + 1] << 8);
+    }
+    uint16_t low = (uint16_t)mos6502_read8(cpu, address);
+    uint16_t high = (uint16_t)mos6502_read8(cpu, address + 1);
+    return (high << 8) | low;
+}
+
+static inline void mos6502_write16(mos6502_t *cpu, uint16_t address, uint16_t value)
+{
+    mos6502_write8(cpu, address, (uint8_t)(value & 0xFF));
+    mos6502_write8(cpu, address + 1, (uint8_t)((value >> 8) & 0xFF));
+}
+
+void mos6502_map_init(mos6502_page_map_t *map);
+void mos6502_map_pages(mos6502_page_map_t *map, uint8_t first_page, int count, uint8_t *memory, int read_only);
+void mos6502_unmap_pages(mos6502_page_map_t *map, uint8_t first_page, int count);
 
 int mos6502_init(mos6502_t *cpu);
 
 int mos6502_tick(mos6502_t *cpu);
 
-void mos6502_register_opcode(mos6502_t *cpu, uint8_t opcode, int (*func)(mos6502_t *cpu));
-
-void mos6502_register_lda(mos6502_t *cpu);
-void mos6502_register_adc(mos6502_t *cpu);
-void mos6502_register_and(mos6502_t *cpu);
-void mos6502_register_asl(mos6502_t *cpu);
-void mos6502_register_bcc(mos6502_t *cpu);
-void mos6502_register_bcs(mos6502_t *cpu);
-void mos6502_register_beq(mos6502_t *cpu);
-void mos6502_register_bit(mos6502_t *cpu);
-void mos6502_register_bmi(mos6502_t *cpu);
-void mos6502_register_bne(mos6502_t *cpu);
-void mos6502_register_bpl(mos6502_t *cpu);
-void mos6502_register_brk(mos6502_t *cpu);
-void mos6502_register_bvc(mos6502_t *cpu);
-void mos6502_register_bvs(mos6502_t *cpu);
-void mos6502_register_clc(mos6502_t *cpu);
-void mos6502_register_cld(mos6502_t *cpu);
-void mos6502_register_cli(mos6502_t *cpu);
-void mos6502_register_clv(mos6502_t *cpu);
-void mos6502_register_cmp(mos6502_t *cpu);
-void mos6502_register_cpx(mos6502_t *cpu);
-void mos6502_register_cpy(mos6502_t *cpu);
-void mos6502_register_dec(mos6502_t *cpu);
-void mos6502_register_dex(mos6502_t *cpu);
-void mos6502_register_dey(mos6502_t *cpu);
-void mos6502_register_eor(mos6502_t *cpu);
-void mos6502_register_inc(mos6502_t *cpu);
-void mos6502_register_inx(mos6502_t *cpu);
-void mos6502_register_iny(mos6502_t *cpu);
-void mos6502_register_jmp(mos6502_t *cpu);
-void mos6502_register_jsr(mos6502_t *cpu);
-void mos6502_register_lda(mos6502_t *cpu);
-void mos6502_register_ldx(mos6502_t *cpu);
-void mos6502_register_ldy(mos6502_t *cpu);
-void mos6502_register_lsr(mos6502_t *cpu);
-void mos6502_register_nop(mos6502_t *cpu);
-void mos6502_register_ora(mos6502_t *cpu);
-void mos6502_register_pha(mos6502_t *cpu);
-void mos6502_register_php(mos6502_t *cpu);
-void mos6502_register_pla(mos6502_t *cpu);
-void mos6502_register_plp(mos6502_t *cpu);
-void mos6502_register_rol(mos6502_t *cpu);
-void mos6502_register_ror(mos6502_t *cpu);
-void mos6502_register_rti(mos6502_t *cpu);
-void mos6502_register_rts(mos6502_t *cpu);
-void mos6502_register_sbc(mos6502_t *cpu);
-void mos6502_register_sec(mos6502_t *cpu);
-void mos6502_register_sed(mos6502_t *cpu);
-void mos6502_register_sei(mos6502_t *cpu);
-void mos6502_register_sta(mos6502_t *cpu);
-void mos6502_register_stx(mos6502_t *cpu);
-void mos6502_register_sty(mos6502_t *cpu);
-void mos6502_register_tax(mos6502_t *cpu);
-void mos6502_register_tay(mos6502_t *cpu);
-void mos6502_register_tsx(mos6502_t *cpu);
-void mos6502_register_txa(mos6502_t *cpu);
-void mos6502_register_txs(mos6502_t *cpu);
-void mos6502_register_tya(mos6502_t *cpu);
+// reasons returned by mos6502_run
+#define MOS6502_STOP_BUDGET 0
+#define MOS6502_STOP_HALT 1
+#define MOS6502_STOP_UNKNOWN_OPCODE 2
+#define MOS6502_STOP_INTERRUPT 3
+#define MOS6502_STOP_BREAKPOINT 4
+
+// execute instructions until cycle_budget is spent (the last instruction may
+// overshoot it), rdy is low, an unknown opcode is fetched, an nmi/unmasked
+// interrupt is pending or a breakpoint is hit. returns the stop reason, cycles receives the cycles consumed.
+// spin loops that only read mapped memory and repeat with the same registers
+// (lda $xx / beq back, bne *) skip whole iterations up to the next event or
+// the end of the budget, unless stats are being collected
+int mos6502_run(mos6502_t *cpu, uint64_t cycle_budget, uint64_t *cycles);
+
+// translate basic blocks reached threshold times into native code that
+// mos6502_run executes (x86-64 System V hosts only). the jit takes over the
+// write callback and page map pointer to see writes to translated code, call
+// mos6502_jit_flush after changing the page map (mos6502_jit_flush_page when a
+// single page moved). returns 0, or -1 if unsupported or predecoding or
+// debugging is enabled
+int mos6502_jit_enable(mos6502_t *cpu, int threshold);
+void mos6502_jit_disable(mos6502_t *cpu);
+void mos6502_jit_flush(mos6502_t *cpu);
+void mos6502_jit_flush_page(mos6502_t *cpu, uint8_t page);
+
+// cache decoded instructions (handler, operand, length, cycles) per address so
+// mos6502_run skips the fetch and decode of code it has already seen. like the
+// jit it takes over the write callback and page map pointer, writes to decoded
+// bytes invalidate their page. call mos6502_predecode_flush after changing the
+// page map (or mos6502_predecode_flush_page for a single page). returns 0, or
+// -1 if out of memory or the jit or debugging is enabled
+int mos6502_predecode_enable(mos6502_t *cpu);
+void mos6502_predecode_disable(mos6502_t *cpu);
+void mos6502_predecode_flush(mos6502_t *cpu);
+void mos6502_predecode_flush_page(mos6502_t *cpu, uint8_t page);
+
+// many instances of the same program stored as structure of arrays, one entry
+// per lane. memory is plain ram (no page map or callbacks) interleaved by
+// address so the same address of every lane is contiguous:
+// memory[address * stride + lane]
+typedef struct mos6502_lanes
+{
+    int count;
+    // count rounded up to the widest vector, padding lanes never run
+    int stride;
+
+    uint8_t *a;
+    uint8_t *x;
+    uint8_t *y;
+    uint16_t *pc;
+    uint8_t *sp;
+    uint8_t *flags;
+    uint64_t *cycles;
+    // -1 while the lane can run, otherwise the MOS6502_STOP_* reason
+    int8_t *stop;
+
+    uint8_t *memory;
+
+    // per step scratch: 0xFF for the lanes executing the current instruction
+    uint8_t *active;
+
+    // instructions executed over all lanes since mos6502_lanes_init
+    uint64_t instructions;
+} mos6502_lanes_t;
+
+// allocate count lanes with zeroed registers and memory, returns 0 or -1
+int mos6502_lanes_init(mos6502_lanes_t *lanes, int count);
+void mos6502_lanes_free(mos6502_lanes_t *lanes);
+
+uint8_t mos6502_lanes_read8(mos6502_lanes_t *lanes, int lane, uint16_t address);
+void mos6502_lanes_write8(mos6502_lanes_t *lanes, int lane, uint16_t address, uint8_t value);
+
+// load pc of every lane from its reset vector
+void mos6502_lanes_reset(mos6502_lanes_t *lanes);
+
+// run every lane until its cycle counter reaches until or it stops. lanes at
+// the same pc execute each instruction together, with SIMD kernels for the
+// loads, stores, AND, ORA, ASL/LSR A, transfers and flag instructions and the
+// scalar handlers for the rest. returns how many lanes have not stopped
+int mos6502_lanes_run(mos6502_lanes_t *lanes, uint64_t until);
+
+// an independent run for mos6502_pool_run: cpu holds the initial state (from
+// mos6502_init and the caller's changes) and receives the final one. with
+// memory set, the 64K image is mapped as ram for the run, otherwise cpu keeps
+// its own page map and callbacks
+typedef struct mos6502_job
+{
+    mos6502_t cpu;
+    uint8_t *memory;
+    uint64_t cycle_budget;
+
+    // called on the worker thread once the job has run
+    void (*done)(struct mos6502_job *job);
+    void *user;
+
+    // mos6502_run results
+    int reason;
+    uint64_t cycles;
+
+    mos6502_page_map_t pages;
+} mos6502_job_t;
+
+typedef struct mos6502_pool mos6502_pool_t;
+
+// threads workers (0 for one per online cpu), the calling thread of
+// mos6502_pool_run being one of them. NULL if out of memory or threads
+mos6502_pool_t *mos6502_pool_create(int threads);
+void mos6502_pool_destroy(mos6502_pool_t *pool);
+
+// run count jobs across the workers and return when all are done. jobs are
+// dealt to per worker deques up front, idle workers steal from the others.
+// returns 0, or -1 if out of memory
+int mos6502_pool_run(mos6502_pool_t *pool, mos6502_job_t *jobs, int count);
+
+// back the whole address space of cpu with zeroed copy-on-write ram made of
+// reference counted 256 byte pages. cpu->pages and cpu->write are taken over,
+// shared pages have no write pointer and are copied on their first write.
+// returns 0, or -1 if out of memory or the jit, predecoding or debugging is
+// already enabled (they go on top of the copy-on-write memory)
+int mos6502_cow_init(mos6502_t *cpu);
+// drop the memory of cpu (pages still shared with forks stay alive). the jit,
+// predecoding and debugging hold on to the copy-on-write map and write callback,
+// disable them first. returns 0, or -1 if one of them is still enabled
+int mos6502_cow_free(mos6502_t *cpu);
+// writes lost because a shared page could not be copied (out of memory), the
+// written byte keeps its old value. 0 without copy-on-write memory
+uint64_t mos6502_cow_dropped(const mos6502_t *cpu);
+
+// make child a copy of parent (registers, lines, cycles, callbacks) sharing
+// all of parent's copy-on-write pages, so forking costs one page table and
+// memory is only copied as either side writes to it. the jit, predecode cache,
+// stats, trace, scheduled events and recording or replay are not inherited.
+// returns 0, or -1 if out of memory, parent has no copy-on-write memory or is
+// being debugged
+int mos6502_fork(mos6502_t *child, mos6502_t *parent);
+
+#define MOS6502_SNAPSHOT_VERSION 1
+
+// snapshots hold the registers, the interrupt/rst/rdy lines, the cycle counter
+// and the content of every page with direct host memory in the page map, in a
+// fixed little endian layout. callbacks, the dispatch table and the jit or
+// predecode cache belong to the cpu being restored and are kept.
+// mos6502_snapshot_size is the buffer size a save needs for the current map
+size_t mos6502_snapshot_size(const mos6502_t *cpu);
+// returns the snapshot size, or 0 if buffer is too small
+size_t mos6502_snapshot_save(mos6502_t *cpu, uint8_t *buffer, size_t size);
+// saved pages are copied into the mapped memory, or written byte by byte through
+// the write callback where the page has no write pointer. returns 0, or -1 if the
+// snapshot is truncated, of another version or has pages not mapped in cpu (cpu
+// is left untouched then)
+int mos6502_snapshot_restore(mos6502_t *cpu, const uint8_t *buffer, size_t size);
+
+typedef enum mos6502_mode
+{
+    MOS6502_MODE_IMPLIED,
+    MOS6502_MODE_ACCUMULATOR,
+    MOS6502_MODE_IMMEDIATE,
+    MOS6502_MODE_ZERO_PAGE,
+    MOS6502_MODE_ZERO_PAGE_X,
+    MOS6502_MODE_ZERO_PAGE_Y,
+    MOS6502_MODE_ABSOLUTE,
+    MOS6502_MODE_ABSOLUTE_X,
+    MOS6502_MODE_ABSOLUTE_Y,
+    MOS6502_MODE_INDIRECT,
+    MOS6502_MODE_INDIRECT_X,
+    MOS6502_MODE_INDIRECT_Y,
+    MOS6502_MODE_RELATIVE,
+    MOS6502_MODES
+} mos6502_mode_t;
+
+extern const char *const mos6502_mode_names[MOS6502_MODES];
+
+mos6502_mode_t mos6502_opcode_mode(uint8_t opcode);
+
+// instructions longer than this land in the last histogram bucket
+#define MOS6502_STATS_MAX_CYCLES 8
+
+typedef struct mos6502_stats
+{
+    uint64_t executed[256];
+    uint64_t cycles[256];
+
+    // instructions by the cycles they took
+    uint64_t histogram[MOS6502_STATS_MAX_CYCLES + 1];
+
+    uint64_t branches_taken;
+    uint64_t branches_not_taken;
+    // taken branches landing on another page
+    uint64_t branch_page_crosses;
+    // indexed reads paying the extra cycle for crossing a page
+    uint64_t page_crosses;
+} mos6502_stats_t;
+
+// count executions and cycles per opcode, branch outcomes and page crossings.
+// only available when built with MOS6502_STATS, otherwise returns -1 and the
+// counting code is compiled out. while collecting, mos6502_run executes on the
+// plain table interpreter (jit, predecode cache and switch core are bypassed)
+// so that every instruction is seen. returns 0, or -1 if out of memory
+int mos6502_stats_enable(mos6502_t *cpu);
+void mos6502_stats_disable(mos6502_t *cpu);
+void mos6502_stats_reset(mos6502_t *cpu);
+
+// executions and cycles summed per addressing mode
+void mos6502_stats_modes(const mos6502_stats_t *stats, uint64_t executed[MOS6502_MODES],
+                         uint64_t cycles[MOS6502_MODES]);
+
+// human readable report of the non zero counters
+void mos6502_stats_dump(const mos6502_stats_t *stats, FILE *out);
+
+// one executed instruction, with the registers before it ran. 16 bytes in
+// host byte order, cycles holds the low 32 bits of cpu->cycles
+typedef struct mos6502_trace_record
+{
+    uint32_t cycles;
+    uint16_t pc;
+    uint8_t opcode;
+    uint8_t operand[2];
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t flags;
+    uint8_t reserved[2];
+} mos6502_trace_record_t;
+
+typedef struct mos6502_trace
+{
+    mos6502_trace_record_t *records;
+    // capacity - 1, the capacity is a power of two
+    uint64_t mask;
+    // records written since mos6502_trace_enable, the last capacity are kept
+    uint64_t count;
+    // where the trace is dumped when an unknown opcode is fetched, or NULL
+    FILE *fault;
+} mos6502_trace_t;
+
+// record every instruction mos6502_tick and mos6502_run execute into a ring of
+// the last capacity (rounded up to a power of two) instructions. like the stats,
+// tracing makes mos6502_run use the table interpreter. operands are only read
+// through the page map, bytes behind the read callback are recorded as 0 so
+// tracing has no side effect on devices. when fault is set the trace is dumped
+// there (see mos6502_trace_dump) as soon as an unknown opcode is fetched.
+// returns 0, or -1 if out of memory
+int mos6502_trace_enable(mos6502_t *cpu, int capacity, FILE *fault);
+void mos6502_trace_disable(mos6502_t *cpu);
+
+// copy up to count of the most recent records, oldest first. returns how many
+int mos6502_trace_read(const mos6502_t *cpu, mos6502_trace_record_t *records, int count);
+
+// binary dump: the "65TR" magic, version and record size bytes, 2 reserved
+// bytes, the record count (32 bits) and cpu->cycles (64 bits), all little
+// endian, followed by the records oldest first. returns 0, or -1 on write errors
+int mos6502_trace_dump(const mos6502_t *cpu, FILE *out);
+
+// the same records as text, one instruction per line
+void mos6502_trace_print(const mos6502_t *cpu, FILE *out);
+
+// breakpoint kinds, combined as a mask
+#define MOS6502_BREAK_EXECUTE 1
+#define MOS6502_BREAK_READ (1 << 1)
+#define MOS6502_BREAK_WRITE (1 << 2)
+
+// optional test run on a hit, the breakpoint only fires when it returns non
+// zero. value is the opcode, the byte read or the byte being written
+typedef int (*mos6502_condition_t)(mos6502_t *cpu, uint16_t address, uint8_t value, void *user);
+
+typedef struct mos6502_breakpoint_hit
+{
+    int kind;
+    uint16_t address;
+    uint8_t value;
+} mos6502_breakpoint_hit_t;
+
+// breakpoints are one bit per address and kind. execute breakpoints are tested
+// in the fetch of mos6502_run, which stops with MOS6502_STOP_BREAKPOINT before
+// the instruction (the next run resumes with it). read and write watchpoints
+// take the pages holding them out of the page map, so only accesses to those
+// pages reach the bit test, and stop mos6502_run after the instruction that
+// touched them (fetches count as reads). while no breakpoint is set mos6502_run
+// is unaffected, while any is set it uses the table interpreter. like the jit,
+// debugging takes over the page map pointer and the callbacks, call
+// mos6502_debug_flush after changing the page map (mos6502_debug_flush_page for a
+// single page). returns 0, or -1 if out of memory or the jit or predecoding is
+// enabled
+int mos6502_debug_enable(mos6502_t *cpu);
+void mos6502_debug_disable(mos6502_t *cpu);
+void mos6502_debug_flush(mos6502_t *cpu);
+void mos6502_debug_flush_page(mos6502_t *cpu, uint8_t page);
+
+// set or replace the breakpoints of the kinds in mask at address, condition may
+// be NULL. returns 0, or -1 if out of memory or debugging is not enabled
+int mos6502_breakpoint_set(mos6502_t *cpu, int kinds, uint16_t address, mos6502_condition_t condition, void *user);
+void mos6502_breakpoint_clear(mos6502_t *cpu, int kinds, uint16_t address);
+
+// the breakpoint that stopped the last run, NULL if none did
+const mos6502_breakpoint_hit_t *mos6502_breakpoint_hit(const mos6502_t *cpu);
+
+// device callback, run at the first instruction boundary once cpu->cycles
+// reached the cycle it was scheduled for
+typedef void (*mos6502_event_t)(mos6502_t *cpu, void *user);
+
+// queue event for cycle (absolute, compare with cpu->cycles). mos6502_run runs
+// its core uninterrupted up to the next event (or the end of the budget), fires
+// the events due and goes on, and mos6502_tick fires them after its instruction.
+// event, read and write callbacks may schedule and cancel events (the core
+// stops in time for the ones they add) and change the lines: raising
+// interrupt or nmi stops the run as usual. events due at the same cycle fire in
+// the order they were scheduled. returns 0, or -1 if out of memory
+int mos6502_event_schedule(mos6502_t *cpu, uint64_t cycle, mos6502_event_t event, void *user);
+
+// remove every pending event with this callback and user, returns how many
+int mos6502_event_cancel(mos6502_t *cpu, mos6502_event_t event, void *user);
+
+// cycle of the next pending event, UINT64_MAX if none
+uint64_t mos6502_event_next(const mos6502_t *cpu);
+
+// drop all the pending events
+void mos6502_events_free(mos6502_t *cpu);
+
+// log every input the cpu can't compute itself to out as it runs: the values
+// the read callback returns, and the interrupt/nmi/rst/rdy lines whenever they
+// changed (looked at when mos6502_run or mos6502_tick start, after events and
+// after device callbacks), each with its cycle. the log streams through a 4K
+// buffer: a header ("65RP" magic, version byte, 3 reserved bytes, starting
+// cycle as 64 bits little endian) then records of a tag byte and the cycles
+// since the previous record (LEB128), reads adding the address and value in 3
+// bytes. recording takes over the read and write callbacks, forwarding to the
+// devices. returns 0, or -1 if out of memory or already recording or replaying
+int mos6502_record_start(mos6502_t *cpu, FILE *out);
+
+// feed a recording back from the same starting state (e.g. a snapshot taken
+// when the recording started): reads return the logged values and the lines
+// change at the logged cycles, scheduled as events, without calling any
+// device (the callbacks are taken over until mos6502_replay_stop). returns 0,
+// or -1 if out of memory, in is not a log or starts at another cycle
+int mos6502_replay_start(mos6502_t *cpu, FILE *in);
+
+// end the recording (flushing the log) or the replay and give the callbacks
+// back. returns 0, or -1 if a write failed, the replay diverged from the log
+// or nothing was recorded or replayed
+int mos6502_replay_stop(mos6502_t *cpu);
+
+// the replay read something the log does not have at that cycle (or a
+// recording failed to write), further reads return 0
+int mos6502_replay_failed(const mos6502_t *cpu);
 
 #ifdef _TEST
 void mos6502_test_wrapper(const char *name, int (*func)(mos6502_t *cpu));
 #define RUN_TEST(func) mos6502_test_wrapper(#func, func);
 
+// copy a test program to $8000, where the reset vector of every test points
+static inline void mos6502_test_program(mos6502_t *cpu, const uint8_t *program, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        mos6502_write8(cpu, 0x8000 + i, program[i]);
+    }
+}
+
 void test_mos6502_core();
+void test_mos6502_memory();
+void test_mos6502_jit();
+void test_mos6502_predecode();
+void test_mos6502_lanes();
+void test_mos6502_pool();
+void test_mos6502_cow();
+void test_mos6502_snapshot();
+void test_mos6502_stats();
+void test_mos6502_trace();
+void test_mos6502_debug();
+void test_mos6502_idle();
+void test_mos6502_events();
+void test_mos6502_replay();
+void test_mos6502_opcodes();
+void test_mos6502_decimal();
 void test_mos6502_adc(); 
 void test_mos6502_and(); // tommaso
 void test_mos6502_asl(); // nicola
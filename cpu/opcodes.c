@@ -0,0 +1,414 @@
+#include "operations.h"
+
+#define MOS6502_DEFINE_HANDLER(opcode, name, kind, operation, mode, cycles) \
+    int mos6502_##name(mos6502_t *cpu)                                      \
+    {                                                                       \
+        return mos6502_exec_##name(cpu, mos6502_fetch_##mode(cpu));         \
+    }
+
+MOS6502_OPCODES(MOS6502_DEFINE_HANDLER)
+
+#define MOS6502_TABLE_OPCODE(opcode, name, ...) [opcode] = mos6502_##name,
+
+const mos6502_opcode_t mos6502_opcodes[256] = {
+    MOS6502_OPCODES(MOS6502_TABLE_OPCODE)
+};
+
+#define MOS6502_TABLE_CYCLES(opcode, name, kind, operation, mode, cycles) [opcode] = cycles,
+
+const uint8_t mos6502_opcode_cycles[256] = {
+    MOS6502_OPCODES(MOS6502_TABLE_CYCLES)
+};
+
+#define MOS6502_TABLE_PAGE_PENALTY(opcode, name, kind, operation, mode, cycles) \
+    [opcode] = MOS6502_PAGE_PENALTY_##kind * MOS6502_PAGE_CROSSES_##mode,
+
+const uint8_t mos6502_opcode_page_penalty[256] = {
+    MOS6502_OPCODES(MOS6502_TABLE_PAGE_PENALTY)
+};
+
+// instruction length in bytes, opcode included (1 for undocumented opcodes)
+const uint8_t mos6502_opcode_length[256] = {
+    1, 2, 1, 1, 1, 2, 2, 1, 1, 2, 1, 1, 1, 3, 3, 1,
+    2, 2, 1, 1, 1, 2, 2, 1, 1, 3, 1, 1, 1, 3, 3, 1,
+    3, 2, 1, 1, 2, 2, 2, 1, 1, 2, 1, 1, 3, 3, 3, 1,
+    2, 2, 1, 1, 1, 2, 2, 1, 1, 3, 1, 1, 1, 3, 3, 1,
+    1, 2, 1, 1, 1, 2, 2, 1, 1, 2, 1, 1, 3, 3, 3, 1,
+    2, 2, 1, 1, 1, 2, 2, 1, 1, 3, 1, 1, 1, 3, 3, 1,
+    1, 2, 1, 1, 1, 2, 2, 1, 1, 2, 1, 1, 3, 3, 3, 1,
+    2, 2, 1, 1, 1, 2, 2, 1, 1, 3, 1, 1, 1, 3, 3, 1,
+    1, 2, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 3, 3, 3, 1,
+    2, 2, 1, 1, 2, 2, 2, 1, 1, 3, 1, 1, 1, 3, 1, 1,
+    2, 2, 2, 1, 2, 2, 2, 1, 1, 2, 1, 1, 3, 3, 3, 1,
+    2, 2, 1, 1, 2, 2, 2, 1, 1, 3, 1, 1, 3, 3, 3, 1,
+    2, 2, 1, 1, 2, 2, 2, 1, 1, 2, 1, 1, 3, 3, 3, 1,
+    2, 2, 1, 1, 1, 2, 2, 1, 1, 3, 1, 1, 1, 3, 3, 1,
+    2, 2, 1, 1, 2, 2, 2, 1, 1, 2, 1, 1, 3, 3, 3, 1,
+    2, 2, 1, 1, 1, 2, 2, 1, 1, 3, 1, 1, 1, 3, 3, 1,
+};
+
+
+const char *const mos6502_mode_names[MOS6502_MODES] = {
+    "implied", "accumulator", "immediate", "zero_page", "zero_page_x", "zero_page_y", "absolute",
+    "absolute_x", "absolute_y", "indirect", "indirect_x", "indirect_y", "relative",
+};
+
+// from the aaabbbcc layout of the opcode, undocumented opcodes included
+mos6502_mode_t mos6502_opcode_mode(uint8_t opcode)
+{
+    int aaa = opcode >> 5;
+    int bbb = (opcode >> 2) & 7;
+    int cc = opcode & 3;
+
+    if (opcode == 0x20)
+    {
+        return MOS6502_MODE_ABSOLUTE;
+    }
+    if (opcode == 0x6C)
+    {
+        return MOS6502_MODE_INDIRECT;
+    }
+    if (cc == 0 && bbb == 4)
+    {
+        return MOS6502_MODE_RELATIVE;
+    }
+    if (mos6502_opcode_length[opcode] == 1)
+    {
+        return cc == 2 && bbb == 2 && aaa < 4 ? MOS6502_MODE_ACCUMULATOR : MOS6502_MODE_IMPLIED;
+    }
+
+    switch (bbb)
+    {
+    case 0:
+        return cc == 1 ? MOS6502_MODE_INDIRECT_X : MOS6502_MODE_IMMEDIATE;
+    case 1:
+        return MOS6502_MODE_ZERO_PAGE;
+    case 2:
+        return MOS6502_MODE_IMMEDIATE;
+    case 3:
+        return MOS6502_MODE_ABSOLUTE;
+    case 4:
+        return MOS6502_MODE_INDIRECT_Y;
+    case 5:
+        return cc >= 2 && (aaa == 4 || aaa == 5) ? MOS6502_MODE_ZERO_PAGE_Y : MOS6502_MODE_ZERO_PAGE_X;
+    case 6:
+        return MOS6502_MODE_ABSOLUTE_Y;
+    default:
+        return cc >= 2 && aaa == 5 ? MOS6502_MODE_ABSOLUTE_Y : MOS6502_MODE_ABSOLUTE_X;
+    }
+}
+
+#ifdef _TEST
+
+#define TEST_OPCODES_ENTRY(opcode, name, kind, operation, mode, cycles) {opcode, #mode, MOS6502_LENGTH_##mode},
+
+static const struct
+{
+    uint8_t opcode;
+    const char *mode;
+    uint8_t length;
+} test_opcodes_entries[] = {MOS6502_OPCODES(TEST_OPCODES_ENTRY)};
+
+static int test_opcodes_table(mos6502_t *cpu)
+{
+    int count = sizeof(test_opcodes_entries) / sizeof(test_opcodes_entries[0]);
+    int registered = 0;
+    for (int opcode = 0; opcode < 256; opcode++)
+    {
+        registered += mos6502_opcodes[opcode] != NULL;
+    }
+
+    // the composed mode is the one the opcode encodes
+    int result = count == 151 && registered == 151;
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t opcode = test_opcodes_entries[i].opcode;
+        result &= !strcmp(test_opcodes_entries[i].mode, mos6502_mode_names[mos6502_opcode_mode(opcode)]) &&
+                  test_opcodes_entries[i].length == mos6502_opcode_length[opcode];
+    }
+    return result;
+}
+
+static int test_opcodes_adc(mos6502_t *cpu)
+{
+    // adc #$50 overflowing into the sign, then adc #$60 carrying out
+    static const uint8_t program[] = {0x69, 0x50, 0x69, 0x60};
+    mos6502_test_program(cpu, program, sizeof(program));
+    cpu->a = 0x50;
+    int ticks = mos6502_tick(cpu);
+    int result = ticks == 2 && cpu->a == 0xA0 && cpu->flags == (NEGATIVE | OVERFLOW);
+    ticks = mos6502_tick(cpu);
+    return result && ticks == 2 && cpu->a == 0x00 && cpu->flags == (ZERO | CARRY);
+}
+
+static int test_opcodes_adc_decimal(mos6502_t *cpu)
+{
+    // 58 + 46 + 1 = 105, N and V come from the high digit before its adjust
+    static const uint8_t program[] = {0x69, 0x46};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_set_flag(cpu, DECIMAL | CARRY, 1);
+    cpu->a = 0x58;
+    int ticks = mos6502_tick(cpu);
+    return ticks == 2 && cpu->a == 0x05 && cpu->flags == (DECIMAL | CARRY | NEGATIVE | OVERFLOW);
+}
+
+static int test_opcodes_sbc(mos6502_t *cpu)
+{
+    // -48 - 112 overflows
+    static const uint8_t program[] = {0xE9, 0x70};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_set_flag(cpu, CARRY, 1);
+    cpu->a = 0xD0;
+    int ticks = mos6502_tick(cpu);
+    return ticks == 2 && cpu->a == 0x60 && cpu->flags == (CARRY | OVERFLOW);
+}
+
+static int test_opcodes_sbc_decimal(mos6502_t *cpu)
+{
+    // 12 - 21 borrows: 91
+    static const uint8_t program[] = {0xE9, 0x21};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_set_flag(cpu, DECIMAL | CARRY, 1);
+    cpu->a = 0x12;
+    int ticks = mos6502_tick(cpu);
+    return ticks == 2 && cpu->a == 0x91 && cpu->flags == (DECIMAL | NEGATIVE);
+}
+
+static int test_opcodes_compare(mos6502_t *cpu)
+{
+    // cmp #$41, cpx $10, cpy #$00
+    static const uint8_t program[] = {0xC9, 0x41, 0xE4, 0x10, 0xC0, 0x00};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_write8(cpu, 0x0010, 0x20);
+    cpu->a = 0x40;
+    cpu->x = 0x20;
+    int result = mos6502_tick(cpu) == 2 && cpu->flags == NEGATIVE;
+    result &= mos6502_tick(cpu) == 3 && cpu->flags == (ZERO | CARRY);
+    result &= mos6502_tick(cpu) == 2 && cpu->flags == (ZERO | CARRY);
+    return result && cpu->a == 0x40 && cpu->x == 0x20;
+}
+
+static int test_opcodes_bit(mos6502_t *cpu)
+{
+    static const uint8_t program[] = {0x2C, 0x00, 0x03};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_write8(cpu, 0x0300, 0xC0);
+    cpu->a = 0x01;
+    int ticks = mos6502_tick(cpu);
+    return ticks == 4 && cpu->a == 0x01 && cpu->flags == (NEGATIVE | OVERFLOW | ZERO);
+}
+
+static int test_opcodes_inc_dec(mos6502_t *cpu)
+{
+    // inc $10, dec $0300,x, inx, dey
+    static const uint8_t program[] = {0xE6, 0x10, 0xDE, 0x00, 0x03, 0xE8, 0x88};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_write8(cpu, 0x0010, 0xFF);
+    mos6502_write8(cpu, 0x0302, 0x00);
+    cpu->x = 0x02;
+    int result = mos6502_tick(cpu) == 5 && mos6502_read8(cpu, 0x0010) == 0x00 && cpu->flags == ZERO;
+    result &= mos6502_tick(cpu) == 7 && mos6502_read8(cpu, 0x0302) == 0xFF && cpu->flags == NEGATIVE;
+    result &= mos6502_tick(cpu) == 2 && cpu->x == 0x03 && cpu->flags == 0;
+    result &= mos6502_tick(cpu) == 2 && cpu->y == 0xFF && cpu->flags == NEGATIVE;
+    return result;
+}
+
+static int test_opcodes_rotate(mos6502_t *cpu)
+{
+    // rol a, ror $10: the carry goes around
+    static const uint8_t program[] = {0x2A, 0x66, 0x10};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_write8(cpu, 0x0010, 0x02);
+    mos6502_set_flag(cpu, CARRY, 1);
+    cpu->a = 0x80;
+    int result = mos6502_tick(cpu) == 2 && cpu->a == 0x01 && cpu->flags == CARRY;
+    result &= mos6502_tick(cpu) == 5 && mos6502_read8(cpu, 0x0010) == 0x81 && cpu->flags == NEGATIVE;
+    return result;
+}
+
+static int test_opcodes_jsr_rts(mos6502_t *cpu)
+{
+    static const uint8_t program[] = {0x20, 0x00, 0x90};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_write8(cpu, 0x9000, 0x60);
+    cpu->sp = 0xFF;
+    int result = mos6502_tick(cpu) == 6 && cpu->pc == 0x9000 && cpu->sp == 0xFD &&
+                 mos6502_read8(cpu, 0x01FF) == 0x80 && mos6502_read8(cpu, 0x01FE) == 0x02;
+    result &= mos6502_tick(cpu) == 6 && cpu->pc == 0x8003 && cpu->sp == 0xFF;
+    return result;
+}
+
+static int test_opcodes_brk_rti(mos6502_t *cpu)
+{
+    static const uint8_t program[] = {0x00, 0xFF};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_write16(cpu, 0xFFFE, 0x9000);
+    mos6502_write8(cpu, 0x9000, 0x40);
+    mos6502_set_flag(cpu, CARRY, 1);
+    cpu->sp = 0xFF;
+    int result = mos6502_tick(cpu) == 7 && cpu->pc == 0x9000 && cpu->sp == 0xFC &&
+                 cpu->flags == (CARRY | INTERRUPT) && mos6502_read8(cpu, 0x01FF) == 0x80 &&
+                 mos6502_read8(cpu, 0x01FE) == 0x02 && mos6502_read8(cpu, 0x01FD) == (CARRY | 0x30);
+    result &= mos6502_tick(cpu) == 6 && cpu->pc == 0x8002 && cpu->sp == 0xFF && cpu->flags == CARRY;
+    return result;
+}
+
+static int test_opcodes_stack(mos6502_t *cpu)
+{
+    // pha, php, lda #$00, plp, pla, tsx, txs
+    static const uint8_t program[] = {0x48, 0x08, 0xA9, 0x00, 0x28, 0x68, 0xBA, 0x9A};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_set_flag(cpu, NEGATIVE, 1);
+    cpu->a = 0x80;
+    cpu->sp = 0xFF;
+    int result = mos6502_tick(cpu) == 3 && mos6502_tick(cpu) == 3 && cpu->sp == 0xFD &&
+                 mos6502_read8(cpu, 0x01FE) == (NEGATIVE | 0x30);
+    result &= mos6502_tick(cpu) == 2 && cpu->flags == ZERO;
+    result &= mos6502_tick(cpu) == 4 && cpu->flags == NEGATIVE;
+    result &= mos6502_tick(cpu) == 4 && cpu->a == 0x80 && cpu->sp == 0xFF;
+    result &= mos6502_tick(cpu) == 2 && cpu->x == 0xFF && cpu->flags == NEGATIVE;
+    cpu->x = 0x40;
+    result &= mos6502_tick(cpu) == 2 && cpu->sp == 0x40 && cpu->flags == NEGATIVE;
+    return result;
+}
+
+static int test_opcodes_jmp_indirect(mos6502_t *cpu)
+{
+    // the pointer at $10FF takes its high byte from $1000
+    static const uint8_t program[] = {0x6C, 0xFF, 0x10};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_write8(cpu, 0x10FF, 0x34);
+    mos6502_write8(cpu, 0x1000, 0x12);
+    mos6502_write8(cpu, 0x1100, 0x56);
+    int ticks = mos6502_tick(cpu);
+    return ticks == 5 && cpu->pc == 0x1234;
+}
+
+static int test_opcodes_indirect_y_page_cross(mos6502_t *cpu)
+{
+    // lda ($FF),y: the pointer wraps to $00, the index crosses into $0400
+    static const uint8_t program[] = {0xB1, 0xFF};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_write8(cpu, 0x00FF, 0xF0);
+    mos6502_write8(cpu, 0x0000, 0x03);
+    mos6502_write8(cpu, 0x0400, 0x7E);
+    cpu->y = 0x10;
+    int ticks = mos6502_tick(cpu);
+    return ticks == 6 && cpu->a == 0x7E && cpu->flags == 0;
+}
+
+static int test_opcodes_absolute_x_page_cross(mos6502_t *cpu)
+{
+    // ldy $03F0,x then eor $0300,x within the page
+    static const uint8_t program[] = {0xBC, 0xF0, 0x03, 0x5D, 0x00, 0x03};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_write8(cpu, 0x0400, 0x11);
+    mos6502_write8(cpu, 0x0310, 0x0F);
+    cpu->a = 0xFF;
+    cpu->x = 0x10;
+    int result = mos6502_tick(cpu) == 5 && cpu->y == 0x11;
+    result &= mos6502_tick(cpu) == 4 && cpu->a == 0xF0 && cpu->flags == NEGATIVE;
+    return result;
+}
+
+// NMOS timings as published in the MOS programming manual, 0 for the
+// undocumented opcodes
+static const uint8_t test_opcodes_reference_cycles[256] = {
+    7, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 0, 4, 6, 0,
+    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 4, 4, 6, 0,
+    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    6, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 3, 4, 6, 0,
+    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    6, 6, 0, 0, 0, 3, 5, 0, 4, 2, 2, 0, 5, 4, 6, 0,
+    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    0, 6, 0, 0, 3, 3, 3, 0, 2, 0, 2, 0, 4, 4, 4, 0,
+    2, 6, 0, 0, 4, 4, 4, 0, 2, 5, 2, 0, 0, 5, 0, 0,
+    2, 6, 2, 0, 3, 3, 3, 0, 2, 2, 2, 0, 4, 4, 4, 0,
+    2, 5, 0, 0, 4, 4, 4, 0, 2, 4, 2, 0, 4, 4, 4, 0,
+    2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0,
+    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    2, 6, 0, 0, 3, 3, 5, 0, 2, 2, 2, 0, 4, 4, 6, 0,
+    2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+};
+
+// the "+1 if page crossed" column of the same manual
+static const uint8_t test_opcodes_reference_penalty[] = {
+    0x11, 0x19, 0x1D, 0x31, 0x39, 0x3D, 0x51, 0x59, 0x5D, 0x71, 0x79, 0x7D,
+    0xB1, 0xB9, 0xBC, 0xBD, 0xBE, 0xD1, 0xD9, 0xDD, 0xF1, 0xF9, 0xFD,
+};
+
+static int test_opcodes_cycles_reference(mos6502_t *cpu)
+{
+    int result = 1;
+    for (int opcode = 0; opcode < 256; opcode++)
+    {
+        int penalty = 0;
+        for (int i = 0; i < sizeof(test_opcodes_reference_penalty); i++)
+        {
+            penalty |= test_opcodes_reference_penalty[i] == opcode;
+        }
+        result &= mos6502_opcode_cycles[opcode] == test_opcodes_reference_cycles[opcode] &&
+                  mos6502_opcode_page_penalty[opcode] == penalty &&
+                  (mos6502_opcodes[opcode] != NULL) == (mos6502_opcode_cycles[opcode] != 0);
+    }
+    return result;
+}
+
+// every indexed opcode run with its index landing on the same page and on the
+// next one, the handler has to take the cycles of the tables
+static int test_opcodes_cycles_page_cross(mos6502_t *cpu)
+{
+    int result = 1;
+    for (int opcode = 0; opcode < 256; opcode++)
+    {
+        mos6502_mode_t mode = mos6502_opcode_mode(opcode);
+        if (!mos6502_opcodes[opcode] ||
+            (mode != MOS6502_MODE_ABSOLUTE_X && mode != MOS6502_MODE_ABSOLUTE_Y && mode != MOS6502_MODE_INDIRECT_Y))
+        {
+            continue;
+        }
+
+        for (int crossed = 0; crossed < 2; crossed++)
+        {
+            uint16_t base = crossed ? 0x30F8 : 0x3000;
+            cpu->pc = 0x8000;
+            cpu->x = cpu->y = 0x10;
+            mos6502_write8(cpu, 0x8000, opcode);
+            if (mode == MOS6502_MODE_INDIRECT_Y)
+            {
+                mos6502_write8(cpu, 0x8001, 0x40);
+                mos6502_write16(cpu, 0x0040, base);
+            }
+            else
+            {
+                mos6502_write16(cpu, 0x8001, base);
+            }
+            int ticks = mos6502_tick(cpu);
+            result &= ticks == mos6502_opcode_cycles[opcode] + crossed * mos6502_opcode_page_penalty[opcode];
+        }
+    }
+    return result;
+}
+
+void test_mos6502_opcodes()
+{
+    RUN_TEST(test_opcodes_table);
+    RUN_TEST(test_opcodes_adc);
+    RUN_TEST(test_opcodes_adc_decimal);
+    RUN_TEST(test_opcodes_sbc);
+    RUN_TEST(test_opcodes_sbc_decimal);
+    RUN_TEST(test_opcodes_compare);
+    RUN_TEST(test_opcodes_bit);
+    RUN_TEST(test_opcodes_inc_dec);
+    RUN_TEST(test_opcodes_rotate);
+    RUN_TEST(test_opcodes_jsr_rts);
+    RUN_TEST(test_opcodes_brk_rti);
+    RUN_TEST(test_opcodes_stack);
+    RUN_TEST(test_opcodes_jmp_indirect);
+    RUN_TEST(test_opcodes_indirect_y_page_cross);
+    RUN_TEST(test_opcodes_absolute_x_page_cross);
+    RUN_TEST(test_opcodes_cycles_reference);
+    RUN_TEST(test_opcodes_cycles_page_cross);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,319 @@
+#include "mos6502.h"
+
+// every documented opcode, as OP(opcode, name, kind, operation, mode, cycles):
+// the handler mos6502_<name> composes the operation with the addressing mode
+// (operations.h) the way kind says, and takes cycles plus the page crossing
+// of indexed reads and taken branches
+#define MOS6502_OPCODES(OP)                                     \
+    OP(0x69, adc_immediate, read, adc, immediate, 2)            \
+    OP(0x65, adc_zero_page, read, adc, zero_page, 3)            \
+    OP(0x75, adc_zero_page_x, read, adc, zero_page_x, 4)        \
+    OP(0x6D, adc_absolute, read, adc, absolute, 4)              \
+    OP(0x7D, adc_absolute_x, read, adc, absolute_x, 4)          \
+    OP(0x79, adc_absolute_y, read, adc, absolute_y, 4)          \
+    OP(0x61, adc_indirect_x, read, adc, indirect_x, 6)          \
+    OP(0x71, adc_indirect_y, read, adc, indirect_y, 5)          \
+    OP(0x29, and_immediate, read, and, immediate, 2)            \
+    OP(0x25, and_zero_page, read, and, zero_page, 3)            \
+    OP(0x35, and_zero_page_x, read, and, zero_page_x, 4)        \
+    OP(0x2D, and_absolute, read, and, absolute, 4)              \
+    OP(0x3D, and_absolute_x, read, and, absolute_x, 4)          \
+    OP(0x39, and_absolute_y, read, and, absolute_y, 4)          \
+    OP(0x21, and_indirect_x, read, and, indirect_x, 6)          \
+    OP(0x31, and_indirect_y, read, and, indirect_y, 5)          \
+    OP(0x0A, asl_accumulator, accumulator, asl, accumulator, 2) \
+    OP(0x06, asl_zero_page, modify, asl, zero_page, 5)          \
+    OP(0x16, asl_zero_page_x, modify, asl, zero_page_x, 6)      \
+    OP(0x0E, asl_absolute, modify, asl, absolute, 6)            \
+    OP(0x1E, asl_absolute_x, modify, asl, absolute_x, 7)        \
+    OP(0x90, bcc, branch, bcc, relative, 2)                     \
+    OP(0xB0, bcs, branch, bcs, relative, 2)                     \
+    OP(0xF0, beq, branch, beq, relative, 2)                     \
+    OP(0x30, bmi, branch, bmi, relative, 2)                     \
+    OP(0xD0, bne, branch, bne, relative, 2)                     \
+    OP(0x10, bpl, branch, bpl, relative, 2)                     \
+    OP(0x50, bvc, branch, bvc, relative, 2)                     \
+    OP(0x70, bvs, branch, bvs, relative, 2)                     \
+    OP(0x24, bit_zero_page, read, bit, zero_page, 3)            \
+    OP(0x2C, bit_absolute, read, bit, absolute, 4)              \
+    OP(0x00, brk, implied, brk, implied, 7)                     \
+    OP(0x18, clc, implied, clc, implied, 2)                     \
+    OP(0xD8, cld, implied, cld, implied, 2)                     \
+    OP(0x58, cli, implied, cli, implied, 2)                     \
+    OP(0xB8, clv, implied, clv, implied, 2)                     \
+    OP(0xC9, cmp_immediate, read, cmp, immediate, 2)            \
+    OP(0xC5, cmp_zero_page, read, cmp, zero_page, 3)            \
+    OP(0xD5, cmp_zero_page_x, read, cmp, zero_page_x, 4)        \
+    OP(0xCD, cmp_absolute, read, cmp, absolute, 4)              \
+    OP(0xDD, cmp_absolute_x, read, cmp, absolute_x, 4)          \
+    OP(0xD9, cmp_absolute_y, read, cmp, absolute_y, 4)          \
+    OP(0xC1, cmp_indirect_x, read, cmp, indirect_x, 6)          \
+    OP(0xD1, cmp_indirect_y, read, cmp, indirect_y, 5)          \
+    OP(0xE0, cpx_immediate, read, cpx, immediate, 2)            \
+    OP(0xE4, cpx_zero_page, read, cpx, zero_page, 3)            \
+    OP(0xEC, cpx_absolute, read, cpx, absolute, 4)              \
+    OP(0xC0, cpy_immediate, read, cpy, immediate, 2)            \
+    OP(0xC4, cpy_zero_page, read, cpy, zero_page, 3)            \
+    OP(0xCC, cpy_absolute, read, cpy, absolute, 4)              \
+    OP(0xC6, dec_zero_page, modify, dec, zero_page, 5)          \
+    OP(0xD6, dec_zero_page_x, modify, dec, zero_page_x, 6)      \
+    OP(0xCE, dec_absolute, modify, dec, absolute, 6)            \
+    OP(0xDE, dec_absolute_x, modify, dec, absolute_x, 7)        \
+    OP(0xCA, dex, implied, dex, implied, 2)                     \
+    OP(0x88, dey, implied, dey, implied, 2)                     \
+    OP(0x49, eor_immediate, read, eor, immediate, 2)            \
+    OP(0x45, eor_zero_page, read, eor, zero_page, 3)            \
+    OP(0x55, eor_zero_page_x, read, eor, zero_page_x, 4)        \
+    OP(0x4D, eor_absolute, read, eor, absolute, 4)              \
+    OP(0x5D, eor_absolute_x, read, eor, absolute_x, 4)          \
+    OP(0x59, eor_absolute_y, read, eor, absolute_y, 4)          \
+    OP(0x41, eor_indirect_x, read, eor, indirect_x, 6)          \
+    OP(0x51, eor_indirect_y, read, eor, indirect_y, 5)          \
+    OP(0xE6, inc_zero_page, modify, inc, zero_page, 5)          \
+    OP(0xF6, inc_zero_page_x, modify, inc, zero_page_x, 6)      \
+    OP(0xEE, inc_absolute, modify, inc, absolute, 6)            \
+    OP(0xFE, inc_absolute_x, modify, inc, absolute_x, 7)        \
+    OP(0xE8, inx, implied, inx, implied, 2)                     \
+    OP(0xC8, iny, implied, iny, implied, 2)                     \
+    OP(0x4C, jmp_absolute, jump, jmp, absolute, 3)              \
+    OP(0x6C, jmp_indirect, jump, jmp, indirect, 5)              \
+    OP(0x20, jsr, jump, jsr, absolute, 6)                       \
+    OP(0xA9, lda_immediate, read, lda, immediate, 2)            \
+    OP(0xA5, lda_zero_page, read, lda, zero_page, 3)            \
+    OP(0xB5, lda_zero_page_x, read, lda, zero_page_x, 4)        \
+    OP(0xAD, lda_absolute, read, lda, absolute, 4)              \
+    OP(0xBD, lda_absolute_x, read, lda, absolute_x, 4)          \
+    OP(0xB9, lda_absolute_y, read, lda, absolute_y, 4)          \
+    OP(0xA1, lda_indirect_x, read, lda, indirect_x, 6)          \
+    OP(0xB1, lda_indirect_y, read, lda, indirect_y, 5)          \
+    OP(0xA2, ldx_immediate, read, ldx, immediate, 2)            \
+    OP(0xA6, ldx_zero_page, read, ldx, zero_page, 3)            \
+    OP(0xB6, ldx_zero_page_y, read, ldx, zero_page_y, 4)        \
+    OP(0xAE, ldx_absolute, read, ldx, absolute, 4)              \
+    OP(0xBE, ldx_absolute_y, read, ldx, absolute_y, 4)          \
+    OP(0xA0, ldy_immediate, read, ldy, immediate, 2)            \
+    OP(0xA4, ldy_zero_page, read, ldy, zero_page, 3)            \
+    OP(0xB4, ldy_zero_page_x, read, ldy, zero_page_x, 4)        \
+    OP(0xAC, ldy_absolute, read, ldy, absolute, 4)              \
+    OP(0xBC, ldy_absolute_x, read, ldy, absolute_x, 4)          \
+    OP(0x4A, lsr_accumulator, accumulator, lsr, accumulator, 2) \
+    OP(0x46, lsr_zero_page, modify, lsr, zero_page, 5)          \
+    OP(0x56, lsr_zero_page_x, modify, lsr, zero_page_x, 6)      \
+    OP(0x4E, lsr_absolute, modify, lsr, absolute, 6)            \
+    OP(0x5E, lsr_absolute_x, modify, lsr, absolute_x, 7)        \
+    OP(0xEA, nop, implied, nop, implied, 2)                     \
+    OP(0x09, ora_immediate, read, ora, immediate, 2)            \
+    OP(0x05, ora_zero_page, read, ora, zero_page, 3)            \
+    OP(0x15, ora_zero_page_x, read, ora, zero_page_x, 4)        \
+    OP(0x0D, ora_absolute, read, ora, absolute, 4)              \
+    OP(0x1D, ora_absolute_x, read, ora, absolute_x, 4)          \
+    OP(0x19, ora_absolute_y, read, ora, absolute_y, 4)          \
+    OP(0x01, ora_indirect_x, read, ora, indirect_x, 6)          \
+    OP(0x11, ora_indirect_y, read, ora, indirect_y, 5)          \
+    OP(0x48, pha, implied, pha, implied, 3)                     \
+    OP(0x08, php, implied, php, implied, 3)                     \
+    OP(0x68, pla, implied, pla, implied, 4)                     \
+    OP(0x28, plp, implied, plp, implied, 4)                     \
+    OP(0x2A, rol_accumulator, accumulator, rol, accumulator, 2) \
+    OP(0x26, rol_zero_page, modify, rol, zero_page, 5)          \
+    OP(0x36, rol_zero_page_x, modify, rol, zero_page_x, 6)      \
+    OP(0x2E, rol_absolute, modify, rol, absolute, 6)            \
+    OP(0x3E, rol_absolute_x, modify, rol, absolute_x, 7)        \
+    OP(0x6A, ror_accumulator, accumulator, ror, accumulator, 2) \
+    OP(0x66, ror_zero_page, modify, ror, zero_page, 5)          \
+    OP(0x76, ror_zero_page_x, modify, ror, zero_page_x, 6)      \
+    OP(0x6E, ror_absolute, modify, ror, absolute, 6)            \
+    OP(0x7E, ror_absolute_x, modify, ror, absolute_x, 7)        \
+    OP(0x40, rti, implied, rti, implied, 6)                     \
+    OP(0x60, rts, implied, rts, implied, 6)                     \
+    OP(0xE9, sbc_immediate, read, sbc, immediate, 2)            \
+    OP(0xE5, sbc_zero_page, read, sbc, zero_page, 3)            \
+    OP(0xF5, sbc_zero_page_x, read, sbc, zero_page_x, 4)        \
+    OP(0xED, sbc_absolute, read, sbc, absolute, 4)              \
+    OP(0xFD, sbc_absolute_x, read, sbc, absolute_x, 4)          \
+    OP(0xF9, sbc_absolute_y, read, sbc, absolute_y, 4)          \
+    OP(0xE1, sbc_indirect_x, read, sbc, indirect_x, 6)          \
+    OP(0xF1, sbc_indirect_y, read, sbc, indirect_y, 5)          \
+    OP(0x38, sec, implied, sec, implied, 2)                     \
+    OP(0xF8, sed, implied, sed, implied, 2)                     \
+    OP(0x78, sei, implied, sei, implied, 2)                     \
+    OP(0x85, sta_zero_page, write, sta, zero_page, 3)           \
+    OP(0x95, sta_zero_page_x, write, sta, zero_page_x, 4)       \
+    OP(0x8D, sta_absolute, write, sta, absolute, 4)             \
+    OP(0x9D, sta_absolute_x, write, sta, absolute_x, 5)         \
+    OP(0x99, sta_absolute_y, write, sta, absolute_y, 5)         \
+    OP(0x81, sta_indirect_x, write, sta, indirect_x, 6)         \
+    OP(0x91, sta_indirect_y, write, sta, indirect_y, 6)         \
+    OP(0x86, stx_zero_page, write, stx, zero_page, 3)           \
+    OP(0x96, stx_zero_page_y, write, stx, zero_page_y, 4)       \
+    OP(0x8E, stx_absolute, write, stx, absolute, 4)             \
+    OP(0x84, sty_zero_page, write, sty, zero_page, 3)           \
+    OP(0x94, sty_zero_page_x, write, sty, zero_page_x, 4)       \
+    OP(0x8C, sty_absolute, write, sty, absolute, 4)             \
+    OP(0xAA, tax, implied, tax, implied, 2)                     \
+    OP(0xA8, tay, implied, tay, implied, 2)                     \
+    OP(0xBA, tsx, implied, tsx, implied, 2)                     \
+    OP(0x8A, txa, implied, txa, implied, 2)                     \
+    OP(0x9A, txs, implied, txs, implied, 2)                     \
+    OP(0x98, tya, implied, tya, implied, 2)
+
+extern const uint8_t mos6502_opcode_length[256];
+
+// extra cycles an indexed operand costs when it crosses a page, by kind: reads
+// pay for fixing up the high byte, writes and read-modify-writes always do
+#define MOS6502_PAGE_PENALTY_read 1
+#define MOS6502_PAGE_PENALTY_write 0
+#define MOS6502_PAGE_PENALTY_modify 0
+#define MOS6502_PAGE_PENALTY_accumulator 0
+#define MOS6502_PAGE_PENALTY_implied 0
+#define MOS6502_PAGE_PENALTY_branch 0
+#define MOS6502_PAGE_PENALTY_jump 0
+
+// the modes whose indexing can carry into the high byte
+#define MOS6502_PAGE_CROSSES_implied 0
+#define MOS6502_PAGE_CROSSES_accumulator 0
+#define MOS6502_PAGE_CROSSES_immediate 0
+#define MOS6502_PAGE_CROSSES_zero_page 0
+#define MOS6502_PAGE_CROSSES_zero_page_x 0
+#define MOS6502_PAGE_CROSSES_zero_page_y 0
+#define MOS6502_PAGE_CROSSES_relative 0
+#define MOS6502_PAGE_CROSSES_indirect_x 0
+#define MOS6502_PAGE_CROSSES_indirect_y 1
+#define MOS6502_PAGE_CROSSES_absolute 0
+#define MOS6502_PAGE_CROSSES_absolute_x 1
+#define MOS6502_PAGE_CROSSES_absolute_y 1
+#define MOS6502_PAGE_CROSSES_indirect 0
+
+// base cycles of each opcode (0 for undocumented ones) and its page penalty,
+// both from MOS6502_OPCODES. taken branches add 1, and 1 more across a page
+extern const uint8_t mos6502_opcode_cycles[256];
+extern const uint8_t mos6502_opcode_page_penalty[256];
+
+#define MOS6502_DECLARE_OPCODE(opcode, name, ...) int mos6502_##name(mos6502_t *cpu);
+
+MOS6502_OPCODES(MOS6502_DECLARE_OPCODE)
+
+// stop reason raised by the nmi/interrupt/rdy lines, -1 when execution can go on.
+// a single test of all the lines keeps the common case to one branch
+static inline int mos6502_lines_stop(mos6502_t *cpu)
+{
+    if (cpu->nmi | cpu->interrupt | !cpu->rdy)
+    {
+        if (!cpu->rdy)
+        {
+            return MOS6502_STOP_HALT;
+        }
+        if (cpu->nmi || !mos6502_get_flag(cpu, INTERRUPT))
+        {
+            return MOS6502_STOP_INTERRUPT;
+        }
+    }
+    return -1;
+}
+
+// every core runs until cpu->cycles reaches cpu->end, which mos6502_run sets
+// and scheduling an earlier event lowers
+
+// the inlined core (interp.c): mos6502_opcodes handlers called directly from a
+// single function instead of through the table. mos6502_run only takes it with
+// computed goto (GCC/Clang), a plain switch loop is no faster than the table
+#if defined(__GNUC__) && !defined(MOS6502_NO_COMPUTED_GOTO)
+#define MOS6502_COMPUTED_GOTO
+#endif
+
+int mos6502_execute_inline(mos6502_t *cpu, uint8_t opcode);
+#ifdef MOS6502_COMPUTED_GOTO
+int mos6502_run_inline(mos6502_t *cpu);
+#endif
+
+// the jit core (jit.c), used by mos6502_run while a jit is enabled
+int mos6502_jit_run(mos6502_t *cpu);
+
+// the predecoded core (predecode.c), used by mos6502_run while predecoding is enabled
+int mos6502_predecode_run(mos6502_t *cpu);
+
+
+// the stats core (stats.c), used by mos6502_run while collecting stats
+int mos6502_stats_run(mos6502_t *cpu);
+
+// counting hooks for the handlers, nothing is left of them without MOS6502_STATS
+#ifdef MOS6502_STATS
+static inline void mos6502_stats_instruction(mos6502_t *cpu, uint8_t opcode, int ticks)
+{
+    mos6502_stats_t *stats = cpu->stats;
+    if (stats)
+    {
+        stats->executed[opcode]++;
+        stats->cycles[opcode] += ticks;
+        stats->histogram[ticks < MOS6502_STATS_MAX_CYCLES ? ticks : MOS6502_STATS_MAX_CYCLES]++;
+    }
+}
+#define MOS6502_STATS_COUNT(cpu, counter) \
+    do                                    \
+    {                                     \
+        if ((cpu)->stats)                 \
+        {                                 \
+            (cpu)->stats->counter++;      \
+        }                                 \
+    } while (0)
+#else
+#define mos6502_stats_instruction(cpu, opcode, ticks) ((void)0)
+#define MOS6502_STATS_COUNT(cpu, counter) ((void)0)
+#endif
+
+// decimal mode ADC and SBC (decimal.c), indexed [carry][a << 8 | operand]: the
+// result in the low byte, N, V, Z and C at their flag bits in the high one
+extern uint16_t mos6502_decimal_adc[2][65536];
+extern uint16_t mos6502_decimal_sbc[2][65536];
+
+// fills the decimal tables, the first call for the whole process
+void mos6502_decimal_init(void);
+
+// the tracing core (trace.c), used by mos6502_run while tracing
+int mos6502_trace_run(mos6502_t *cpu);
+
+// bytes for the trace, only through the page map so devices never see the read
+static inline uint8_t mos6502_trace_peek(mos6502_t *cpu, uint16_t address)
+{
+    const uint8_t *page = cpu->pages->read[address >> 8];
+    return page ? page[address & 0xFF] : 0;
+}
+
+// log the instruction at pc (already fetched) into the ring, flags must be current
+static inline void mos6502_trace_instruction(mos6502_t *cpu, uint16_t pc, uint8_t opcode)
+{
+    mos6502_trace_t *trace = cpu->trace;
+    mos6502_trace_record_t *record = &trace->records[trace->count++ & trace->mask];
+    uint8_t length = mos6502_opcode_length[opcode];
+
+    record->cycles = (uint32_t)cpu->cycles;
+    record->pc = pc;
+    record->opcode = opcode;
+    record->operand[0] = length > 1 ? mos6502_trace_peek(cpu, pc + 1) : 0;
+    record->operand[1] = length > 2 ? mos6502_trace_peek(cpu, pc + 2) : 0;
+    record->a = cpu->a;
+    record->x = cpu->x;
+    record->y = cpu->y;
+    record->sp = cpu->sp;
+    record->flags = cpu->flags;
+}
+
+// the debugging core (debug.c), used by mos6502_run while breakpoints are set
+int mos6502_debug_armed(const mos6502_t *cpu);
+int mos6502_debug_run(mos6502_t *cpu);
+
+// idle loop detection (idle.c), called by taken backward branches: cycles to
+// add when the loop from target to branch can't change before the run ends
+uint32_t mos6502_idle_skip(mos6502_t *cpu, uint16_t branch, uint16_t target, int ticks);
+
+// fire the events due at cpu->cycles (events.c)
+void mos6502_events_fire(mos6502_t *cpu);
+
+// where the lines were looked at for record/replay (replay.c): at the start of
+// mos6502_run and mos6502_tick, after the events fired, after device callbacks
+#define MOS6502_REPLAY_HOST 0x10
+#define MOS6502_REPLAY_EVENTS 0x20
+#define MOS6502_REPLAY_DEVICE 0x30
+
+// log the lines while recording, apply the logged ones while replaying
+void mos6502_replay_sync(mos6502_t *cpu, int source);
\ No newline at end of file
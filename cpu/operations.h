@@ -0,0 +1,630 @@
+#include "opcodes.h"
+
+// what the handlers of MOS6502_OPCODES are composed of: addressing modes,
+// operations and the kinds of instruction joining the two. every handler is
+// the fetch of its mode followed by mos6502_exec_<name>, which the predecoded
+// core runs on the operand it fetched at decode time
+
+// instruction length (opcode included) of each mode
+#define MOS6502_LENGTH_implied 1
+#define MOS6502_LENGTH_accumulator 1
+#define MOS6502_LENGTH_immediate 2
+#define MOS6502_LENGTH_zero_page 2
+#define MOS6502_LENGTH_zero_page_x 2
+#define MOS6502_LENGTH_zero_page_y 2
+#define MOS6502_LENGTH_relative 2
+#define MOS6502_LENGTH_indirect_x 2
+#define MOS6502_LENGTH_indirect_y 2
+#define MOS6502_LENGTH_absolute 3
+#define MOS6502_LENGTH_absolute_x 3
+#define MOS6502_LENGTH_absolute_y 3
+#define MOS6502_LENGTH_indirect 3
+
+// bits 4 (break) and 5 only exist in the flags php and brk push
+#define MOS6502_PUSHED_FLAGS 0x30
+
+// operand fetch: the bytes after the opcode, pc stepped past them
+
+static inline uint16_t mos6502_fetch_none(mos6502_t *cpu)
+{
+    return 0;
+}
+
+static inline uint16_t mos6502_fetch_byte(mos6502_t *cpu)
+{
+    return mos6502_read8(cpu, cpu->pc++);
+}
+
+static inline uint16_t mos6502_fetch_word(mos6502_t *cpu)
+{
+    uint16_t operand = mos6502_read16(cpu, cpu->pc);
+    cpu->pc += 2;
+    return operand;
+}
+
+#define mos6502_fetch_implied mos6502_fetch_none
+#define mos6502_fetch_accumulator mos6502_fetch_none
+#define mos6502_fetch_immediate mos6502_fetch_byte
+#define mos6502_fetch_zero_page mos6502_fetch_byte
+#define mos6502_fetch_zero_page_x mos6502_fetch_byte
+#define mos6502_fetch_zero_page_y mos6502_fetch_byte
+#define mos6502_fetch_relative mos6502_fetch_byte
+#define mos6502_fetch_indirect_x mos6502_fetch_byte
+#define mos6502_fetch_indirect_y mos6502_fetch_byte
+#define mos6502_fetch_absolute mos6502_fetch_word
+#define mos6502_fetch_absolute_x mos6502_fetch_word
+#define mos6502_fetch_absolute_y mos6502_fetch_word
+#define mos6502_fetch_indirect mos6502_fetch_word
+
+// effective address of the operand. crossed is set to 1 when indexing carried
+// into the high byte, the extra cycle of indexed reads
+
+// 1 when address is on another page than base, without a branch
+static inline int mos6502_page_crossed(uint16_t base, uint16_t address)
+{
+    return ((base ^ address) >> 8) & 1;
+}
+
+// a pointer in zero page, its high byte wraps around to $00
+static inline uint16_t mos6502_read_pointer(mos6502_t *cpu, uint8_t pointer)
+{
+    return mos6502_read8(cpu, pointer) | (mos6502_read8(cpu, (uint8_t)(pointer + 1)) << 8);
+}
+
+static inline uint16_t mos6502_index(uint16_t base, uint8_t index, int *crossed)
+{
+    uint16_t address = base + index;
+    *crossed = mos6502_page_crossed(base, address);
+    return address;
+}
+
+static inline uint16_t mos6502_address_zero_page(mos6502_t *cpu, uint16_t operand, int *crossed)
+{
+    return operand;
+}
+
+static inline uint16_t mos6502_address_zero_page_x(mos6502_t *cpu, uint16_t operand, int *crossed)
+{
+    return (uint8_t)(operand + cpu->x);
+}
+
+static inline uint16_t mos6502_address_zero_page_y(mos6502_t *cpu, uint16_t operand, int *crossed)
+{
+    return (uint8_t)(operand + cpu->y);
+}
+
+static inline uint16_t mos6502_address_absolute(mos6502_t *cpu, uint16_t operand, int *crossed)
+{
+    return operand;
+}
+
+static inline uint16_t mos6502_address_absolute_x(mos6502_t *cpu, uint16_t operand, int *crossed)
+{
+    return mos6502_index(operand, cpu->x, crossed);
+}
+
+static inline uint16_t mos6502_address_absolute_y(mos6502_t *cpu, uint16_t operand, int *crossed)
+{
+    return mos6502_index(operand, cpu->y, crossed);
+}
+
+static inline uint16_t mos6502_address_indirect_x(mos6502_t *cpu, uint16_t operand, int *crossed)
+{
+    return mos6502_read_pointer(cpu, operand + cpu->x);
+}
+
+static inline uint16_t mos6502_address_indirect_y(mos6502_t *cpu, uint16_t operand, int *crossed)
+{
+    return mos6502_index(mos6502_read_pointer(cpu, operand), cpu->y, crossed);
+}
+
+// jmp ($xxFF) takes the high byte from $xx00, the pointer never leaves its page
+static inline uint16_t mos6502_address_indirect(mos6502_t *cpu, uint16_t operand, int *crossed)
+{
+    uint16_t high = (operand & 0xFF00) | (uint8_t)(operand + 1);
+    return mos6502_read8(cpu, operand) | (mos6502_read8(cpu, high) << 8);
+}
+
+// the value read instructions work on
+static inline uint8_t mos6502_load_immediate(mos6502_t *cpu, uint16_t operand, int *crossed)
+{
+    return operand;
+}
+
+#define MOS6502_LOAD(mode)                                                                    \
+    static inline uint8_t mos6502_load_##mode(mos6502_t *cpu, uint16_t operand, int *crossed) \
+    {                                                                                         \
+        return mos6502_read8(cpu, mos6502_address_##mode(cpu, operand, crossed));             \
+    }
+
+MOS6502_LOAD(zero_page)
+MOS6502_LOAD(zero_page_x)
+MOS6502_LOAD(zero_page_y)
+MOS6502_LOAD(absolute)
+MOS6502_LOAD(absolute_x)
+MOS6502_LOAD(absolute_y)
+MOS6502_LOAD(indirect_x)
+MOS6502_LOAD(indirect_y)
+
+// the stack lives in page 1, sp points below the top
+
+static inline void mos6502_push(mos6502_t *cpu, uint8_t value)
+{
+    mos6502_write8(cpu, 0x0100 | cpu->sp--, value);
+}
+
+static inline uint8_t mos6502_pull(mos6502_t *cpu)
+{
+    return mos6502_read8(cpu, 0x0100 | ++cpu->sp);
+}
+
+static inline void mos6502_push16(mos6502_t *cpu, uint16_t value)
+{
+    mos6502_push(cpu, value >> 8);
+    mos6502_push(cpu, value & 0xFF);
+}
+
+static inline uint16_t mos6502_pull16(mos6502_t *cpu)
+{
+    uint16_t low = mos6502_pull(cpu);
+    return low | (mos6502_pull(cpu) << 8);
+}
+
+// read operations, on the value of the operand
+
+static inline void mos6502_adc_binary(mos6502_t *cpu, uint8_t value)
+{
+    unsigned sum = cpu->a + value + mos6502_get_flag(cpu, CARRY);
+    mos6502_set_overflow(cpu, ((cpu->a ^ sum) & (value ^ sum) & 0x80) >> 7);
+    mos6502_set_carry(cpu, sum >> 8);
+    cpu->a = sum;
+    mos6502_set_nz(cpu, cpu->a);
+}
+
+// decimal mode is one load from the tables of decimal.c, result and NVZC
+static inline void mos6502_decimal(mos6502_t *cpu, uint16_t entry)
+{
+    cpu->a = entry & 0xFF;
+    cpu->flags = (cpu->flags & ~(NEGATIVE | OVERFLOW | ZERO | CARRY)) | (entry >> 8);
+    mos6502_flags_load(cpu);
+}
+
+static inline void mos6502_op_adc(mos6502_t *cpu, uint8_t value)
+{
+    if (cpu->flags & DECIMAL)
+    {
+        mos6502_decimal(cpu, mos6502_decimal_adc[mos6502_get_flag(cpu, CARRY)][cpu->a << 8 | value]);
+        return;
+    }
+    mos6502_adc_binary(cpu, value);
+}
+
+static inline void mos6502_op_sbc(mos6502_t *cpu, uint8_t value)
+{
+    if (cpu->flags & DECIMAL)
+    {
+        mos6502_decimal(cpu, mos6502_decimal_sbc[mos6502_get_flag(cpu, CARRY)][cpu->a << 8 | value]);
+        return;
+    }
+    mos6502_adc_binary(cpu, value ^ 0xFF);
+}
+
+static inline void mos6502_op_and(mos6502_t *cpu, uint8_t value)
+{
+    cpu->a &= value;
+    mos6502_set_nz(cpu, cpu->a);
+}
+
+static inline void mos6502_op_ora(mos6502_t *cpu, uint8_t value)
+{
+    cpu->a |= value;
+    mos6502_set_nz(cpu, cpu->a);
+}
+
+static inline void mos6502_op_eor(mos6502_t *cpu, uint8_t value)
+{
+    cpu->a ^= value;
+    mos6502_set_nz(cpu, cpu->a);
+}
+
+// N and V are bits 7 and 6 of the value, Z is set when a & value is 0
+static inline void mos6502_op_bit(mos6502_t *cpu, uint8_t value)
+{
+#ifdef MOS6502_LAZY_FLAGS
+    cpu->lazy_nz = mos6502_lazy_nz(value & NEGATIVE, (cpu->a & value) == 0);
+    cpu->lazy_v = value << 1;
+#else
+    cpu->flags = (cpu->flags & ~(NEGATIVE | OVERFLOW | ZERO)) | (value & (NEGATIVE | OVERFLOW)) |
+                 ((cpu->a & value) == 0 ? ZERO : 0);
+#endif
+}
+
+static inline void mos6502_compare(mos6502_t *cpu, uint8_t reg, uint8_t value)
+{
+    mos6502_set_carry(cpu, reg >= value);
+    mos6502_set_nz(cpu, reg - value);
+}
+
+static inline void mos6502_op_cmp(mos6502_t *cpu, uint8_t value)
+{
+    mos6502_compare(cpu, cpu->a, value);
+}
+
+static inline void mos6502_op_cpx(mos6502_t *cpu, uint8_t value)
+{
+    mos6502_compare(cpu, cpu->x, value);
+}
+
+static inline void mos6502_op_cpy(mos6502_t *cpu, uint8_t value)
+{
+    mos6502_compare(cpu, cpu->y, value);
+}
+
+static inline void mos6502_op_lda(mos6502_t *cpu, uint8_t value)
+{
+    cpu->a = value;
+    mos6502_set_nz(cpu, value);
+}
+
+static inline void mos6502_op_ldx(mos6502_t *cpu, uint8_t value)
+{
+    cpu->x = value;
+    mos6502_set_nz(cpu, value);
+}
+
+static inline void mos6502_op_ldy(mos6502_t *cpu, uint8_t value)
+{
+    cpu->y = value;
+    mos6502_set_nz(cpu, value);
+}
+
+// write operations, the value stored
+
+static inline uint8_t mos6502_op_sta(mos6502_t *cpu)
+{
+    return cpu->a;
+}
+
+static inline uint8_t mos6502_op_stx(mos6502_t *cpu)
+{
+    return cpu->x;
+}
+
+static inline uint8_t mos6502_op_sty(mos6502_t *cpu)
+{
+    return cpu->y;
+}
+
+// read-modify-write operations, the new value of memory or a
+
+static inline uint8_t mos6502_op_asl(mos6502_t *cpu, uint8_t value)
+{
+    mos6502_set_carry(cpu, value >> 7);
+    value <<= 1;
+    mos6502_set_nz(cpu, value);
+    return value;
+}
+
+static inline uint8_t mos6502_op_lsr(mos6502_t *cpu, uint8_t value)
+{
+    mos6502_set_carry(cpu, value & 1);
+    value >>= 1;
+    mos6502_set_nz(cpu, value);
+    return value;
+}
+
+static inline uint8_t mos6502_op_rol(mos6502_t *cpu, uint8_t value)
+{
+    uint8_t result = (value << 1) | mos6502_get_flag(cpu, CARRY);
+    mos6502_set_carry(cpu, value >> 7);
+    mos6502_set_nz(cpu, result);
+    return result;
+}
+
+static inline uint8_t mos6502_op_ror(mos6502_t *cpu, uint8_t value)
+{
+    uint8_t result = (value >> 1) | (mos6502_get_flag(cpu, CARRY) << 7);
+    mos6502_set_carry(cpu, value & 1);
+    mos6502_set_nz(cpu, result);
+    return result;
+}
+
+static inline uint8_t mos6502_op_inc(mos6502_t *cpu, uint8_t value)
+{
+    mos6502_set_nz(cpu, ++value);
+    return value;
+}
+
+static inline uint8_t mos6502_op_dec(mos6502_t *cpu, uint8_t value)
+{
+    mos6502_set_nz(cpu, --value);
+    return value;
+}
+
+// implied operations
+
+static inline void mos6502_op_nop(mos6502_t *cpu)
+{
+}
+
+static inline void mos6502_op_clc(mos6502_t *cpu)
+{
+    mos6502_set_carry(cpu, 0);
+}
+
+static inline void mos6502_op_sec(mos6502_t *cpu)
+{
+    mos6502_set_carry(cpu, 1);
+}
+
+static inline void mos6502_op_cld(mos6502_t *cpu)
+{
+    cpu->flags &= ~DECIMAL;
+}
+
+static inline void mos6502_op_sed(mos6502_t *cpu)
+{
+    cpu->flags |= DECIMAL;
+}
+
+static inline void mos6502_op_cli(mos6502_t *cpu)
+{
+    cpu->flags &= ~INTERRUPT;
+}
+
+static inline void mos6502_op_sei(mos6502_t *cpu)
+{
+    cpu->flags |= INTERRUPT;
+}
+
+static inline void mos6502_op_clv(mos6502_t *cpu)
+{
+    mos6502_set_overflow(cpu, 0);
+}
+
+static inline void mos6502_op_dex(mos6502_t *cpu)
+{
+    mos6502_set_nz(cpu, --cpu->x);
+}
+
+static inline void mos6502_op_dey(mos6502_t *cpu)
+{
+    mos6502_set_nz(cpu, --cpu->y);
+}
+
+static inline void mos6502_op_inx(mos6502_t *cpu)
+{
+    mos6502_set_nz(cpu, ++cpu->x);
+}
+
+static inline void mos6502_op_iny(mos6502_t *cpu)
+{
+    mos6502_set_nz(cpu, ++cpu->y);
+}
+
+static inline void mos6502_op_tax(mos6502_t *cpu)
+{
+    cpu->x = cpu->a;
+    mos6502_set_nz(cpu, cpu->x);
+}
+
+static inline void mos6502_op_tay(mos6502_t *cpu)
+{
+    cpu->y = cpu->a;
+    mos6502_set_nz(cpu, cpu->y);
+}
+
+static inline void mos6502_op_txa(mos6502_t *cpu)
+{
+    cpu->a = cpu->x;
+    mos6502_set_nz(cpu, cpu->a);
+}
+
+static inline void mos6502_op_tya(mos6502_t *cpu)
+{
+    cpu->a = cpu->y;
+    mos6502_set_nz(cpu, cpu->a);
+}
+
+static inline void mos6502_op_tsx(mos6502_t *cpu)
+{
+    cpu->x = cpu->sp;
+    mos6502_set_nz(cpu, cpu->x);
+}
+
+static inline void mos6502_op_txs(mos6502_t *cpu)
+{
+    cpu->sp = cpu->x;
+}
+
+static inline void mos6502_op_pha(mos6502_t *cpu)
+{
+    mos6502_push(cpu, cpu->a);
+}
+
+static inline void mos6502_op_pla(mos6502_t *cpu)
+{
+    cpu->a = mos6502_pull(cpu);
+    mos6502_set_nz(cpu, cpu->a);
+}
+
+static inline void mos6502_op_php(mos6502_t *cpu)
+{
+    mos6502_flags_sync(cpu);
+    mos6502_push(cpu, cpu->flags | MOS6502_PUSHED_FLAGS);
+}
+
+static inline void mos6502_op_plp(mos6502_t *cpu)
+{
+    cpu->flags = mos6502_pull(cpu) & ~MOS6502_PUSHED_FLAGS;
+    mos6502_flags_load(cpu);
+}
+
+// the byte after brk is skipped, rti comes back past it
+static inline void mos6502_op_brk(mos6502_t *cpu)
+{
+    mos6502_push16(cpu, cpu->pc + 1);
+    mos6502_op_php(cpu);
+    cpu->flags |= INTERRUPT;
+    cpu->pc = mos6502_read16(cpu, 0xFFFE);
+}
+
+static inline void mos6502_op_rti(mos6502_t *cpu)
+{
+    mos6502_op_plp(cpu);
+    cpu->pc = mos6502_pull16(cpu);
+}
+
+static inline void mos6502_op_rts(mos6502_t *cpu)
+{
+    cpu->pc = mos6502_pull16(cpu) + 1;
+}
+
+// jump operations, on the effective address
+
+static inline void mos6502_op_jmp(mos6502_t *cpu, uint16_t address)
+{
+    cpu->pc = address;
+}
+
+// pushes the address of its last byte, rts adds the 1
+static inline void mos6502_op_jsr(mos6502_t *cpu, uint16_t address)
+{
+    mos6502_push16(cpu, cpu->pc - 1);
+    cpu->pc = address;
+}
+
+// branch conditions
+
+static inline int mos6502_op_bpl(mos6502_t *cpu)
+{
+    return !mos6502_get_flag(cpu, NEGATIVE);
+}
+
+static inline int mos6502_op_bmi(mos6502_t *cpu)
+{
+    return mos6502_get_flag(cpu, NEGATIVE);
+}
+
+static inline int mos6502_op_bvc(mos6502_t *cpu)
+{
+    return !mos6502_get_flag(cpu, OVERFLOW);
+}
+
+static inline int mos6502_op_bvs(mos6502_t *cpu)
+{
+    return mos6502_get_flag(cpu, OVERFLOW);
+}
+
+static inline int mos6502_op_bcc(mos6502_t *cpu)
+{
+    return !mos6502_get_flag(cpu, CARRY);
+}
+
+static inline int mos6502_op_bcs(mos6502_t *cpu)
+{
+    return mos6502_get_flag(cpu, CARRY);
+}
+
+static inline int mos6502_op_bne(mos6502_t *cpu)
+{
+    return !mos6502_get_flag(cpu, ZERO);
+}
+
+static inline int mos6502_op_beq(mos6502_t *cpu)
+{
+    return mos6502_get_flag(cpu, ZERO);
+}
+
+// a taken branch costs a cycle, two when it lands on another page. taken
+// backward branches may be spin loops whose iterations can be skipped
+static inline int mos6502_branch(mos6502_t *cpu, int taken, uint8_t offset, int cycles)
+{
+    if (!taken)
+    {
+        MOS6502_STATS_COUNT(cpu, branches_not_taken);
+        return cycles;
+    }
+
+    uint16_t branch = cpu->pc - 2;
+    uint16_t target = cpu->pc + (int8_t)offset;
+    int crossed = mos6502_page_crossed(cpu->pc, target);
+    int ticks = cycles + 1 + crossed;
+
+    MOS6502_STATS_COUNT(cpu, branches_taken);
+    if (crossed)
+    {
+        MOS6502_STATS_COUNT(cpu, branch_page_crosses);
+    }
+
+    cpu->pc = target;
+    if (offset & 0x80)
+    {
+        ticks += mos6502_idle_skip(cpu, branch, target, ticks);
+    }
+    return ticks;
+}
+
+// the kinds of instruction, each defines mos6502_exec_<name>(cpu, operand)
+// returning the cycles taken: the base cycles plus the kind's page penalty
+
+#define MOS6502_EXEC(opcode, name, kind, operation, mode, cycles) MOS6502_EXEC_##kind(name, operation, mode, cycles)
+
+#define MOS6502_EXEC_read(name, operation, mode, cycles)                          \
+    static inline int mos6502_exec_##name(mos6502_t *cpu, uint16_t operand)       \
+    {                                                                             \
+        int crossed = 0;                                                          \
+        mos6502_op_##operation(cpu, mos6502_load_##mode(cpu, operand, &crossed)); \
+        if (crossed)                                                              \
+        {                                                                         \
+            MOS6502_STATS_COUNT(cpu, page_crosses);                               \
+        }                                                                         \
+        return cycles + MOS6502_PAGE_PENALTY_read * crossed;                      \
+    }
+
+#define MOS6502_EXEC_write(name, operation, mode, cycles)                                                 \
+    static inline int mos6502_exec_##name(mos6502_t *cpu, uint16_t operand)                               \
+    {                                                                                                     \
+        int crossed = 0;                                                                                  \
+        mos6502_write8(cpu, mos6502_address_##mode(cpu, operand, &crossed), mos6502_op_##operation(cpu)); \
+        return cycles + MOS6502_PAGE_PENALTY_write * crossed;                                             \
+    }
+
+#define MOS6502_EXEC_modify(name, operation, mode, cycles)                                      \
+    static inline int mos6502_exec_##name(mos6502_t *cpu, uint16_t operand)                     \
+    {                                                                                           \
+        int crossed = 0;                                                                        \
+        uint16_t address = mos6502_address_##mode(cpu, operand, &crossed);                      \
+        mos6502_write8(cpu, address, mos6502_op_##operation(cpu, mos6502_read8(cpu, address))); \
+        return cycles + MOS6502_PAGE_PENALTY_modify * crossed;                                  \
+    }
+
+#define MOS6502_EXEC_accumulator(name, operation, mode, cycles)             \
+    static inline int mos6502_exec_##name(mos6502_t *cpu, uint16_t operand) \
+    {                                                                       \
+        cpu->a = mos6502_op_##operation(cpu, cpu->a);                       \
+        return cycles;                                                      \
+    }
+
+#define MOS6502_EXEC_implied(name, operation, mode, cycles)                 \
+    static inline int mos6502_exec_##name(mos6502_t *cpu, uint16_t operand) \
+    {                                                                       \
+        mos6502_op_##operation(cpu);                                        \
+        return cycles;                                                      \
+    }
+
+#define MOS6502_EXEC_branch(name, operation, mode, cycles)                        \
+    static inline int mos6502_exec_##name(mos6502_t *cpu, uint16_t operand)       \
+    {                                                                             \
+        return mos6502_branch(cpu, mos6502_op_##operation(cpu), operand, cycles); \
+    }
+
+#define MOS6502_EXEC_jump(name, operation, mode, cycles)                             \
+    static inline int mos6502_exec_##name(mos6502_t *cpu, uint16_t operand)          \
+    {                                                                                \
+        int crossed = 0;                                                             \
+        mos6502_op_##operation(cpu, mos6502_address_##mode(cpu, operand, &crossed)); \
+        return cycles;                                                               \
+    }
+
+MOS6502_OPCODES(MOS6502_EXEC)
@@ -0,0 +1,366 @@
+#include "mos6502.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+// jobs of one worker for the current batch. the owner pops from the bottom and
+// the other workers steal from the top (Chase-Lev, without pushes: the deque
+// is filled before the batch starts)
+typedef struct mos6502_pool_deque
+{
+    _Alignas(64) atomic_int_fast64_t top;
+    _Alignas(64) atomic_int_fast64_t bottom;
+    mos6502_job_t **jobs;
+    int capacity;
+} mos6502_pool_deque_t;
+
+typedef struct mos6502_pool_worker
+{
+    mos6502_pool_t *pool;
+    int index;
+    pthread_t thread;
+} mos6502_pool_worker_t;
+
+struct mos6502_pool
+{
+    int threads;
+    mos6502_pool_deque_t *deques;
+    // workers[0] is the thread calling mos6502_pool_run
+    mos6502_pool_worker_t *workers;
+
+    // only taken to start and finish a batch, never per job
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t finish;
+    uint64_t batch;
+    int finished;
+    int quit;
+};
+
+static mos6502_job_t *mos6502_pool_pop(mos6502_pool_deque_t *deque)
+{
+    int_fast64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int_fast64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    mos6502_job_t *job = deque->jobs[bottom];
+    if (top == bottom)
+    {
+        // last job, race the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+        {
+            job = NULL;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return job;
+}
+
+static mos6502_job_t *mos6502_pool_steal(mos6502_pool_deque_t *deque)
+{
+    for (;;)
+    {
+        int_fast64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int_fast64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+        if (top >= bottom)
+        {
+            return NULL;
+        }
+
+        mos6502_job_t *job = deque->jobs[top];
+        if (atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+        {
+            return job;
+        }
+    }
+}
+
+static void mos6502_pool_execute(mos6502_job_t *job)
+{
+    if (job->memory)
+    {
+        mos6502_map_init(&job->pages);
+        mos6502_map_pages(&job->pages, 0x00, 256, job->memory, 0);
+        job->cpu.pages = &job->pages;
+    }
+
+    job->reason = mos6502_run(&job->cpu, job->cycle_budget, &job->cycles);
+
+    if (job->done)
+    {
+        job->done(job);
+    }
+}
+
+// run the own jobs, then steal until every deque is empty. nothing is pushed
+// during a batch, so one empty sweep means the batch is over for this worker
+static void mos6502_pool_work(mos6502_pool_t *pool, int index)
+{
+    for (;;)
+    {
+        mos6502_job_t *job = mos6502_pool_pop(&pool->deques[index]);
+
+        for (int i = 1; !job && i < pool->threads; i++)
+        {
+            job = mos6502_pool_steal(&pool->deques[(index + i) % pool->threads]);
+        }
+
+        if (!job)
+        {
+            return;
+        }
+        mos6502_pool_execute(job);
+    }
+}
+
+static void *mos6502_pool_thread(void *arg)
+{
+    mos6502_pool_worker_t *worker = arg;
+    mos6502_pool_t *pool = worker->pool;
+    uint64_t batch = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (pool->batch == batch && !pool->quit)
+        {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->quit)
+        {
+            break;
+        }
+        batch = pool->batch;
+        pthread_mutex_unlock(&pool->lock);
+
+        mos6502_pool_work(pool, worker->index);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->finished++;
+        pthread_cond_signal(&pool->finish);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int mos6502_pool_run(mos6502_pool_t *pool, mos6502_job_t *jobs, int count)
+{
+    int share = (count + pool->threads - 1) / pool->threads;
+
+    for (int i = 0; i < pool->threads; i++)
+    {
+        mos6502_pool_deque_t *deque = &pool->deques[i];
+        if (deque->capacity < share)
+        {
+            mos6502_job_t **grown = realloc(deque->jobs, share * sizeof(mos6502_job_t *));
+            if (!grown)
+            {
+                return -1;
+            }
+            deque->jobs = grown;
+            deque->capacity = share;
+        }
+        atomic_store_explicit(&deque->top, 0, memory_order_relaxed);
+        atomic_store_explicit(&deque->bottom, 0, memory_order_relaxed);
+    }
+
+    // deal the jobs round robin, so neighbours (often similar in cost) spread out
+    for (int i = 0; i < count; i++)
+    {
+        mos6502_pool_deque_t *deque = &pool->deques[i % pool->threads];
+        int_fast64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+        deque->jobs[bottom] = &jobs[i];
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->finished = 0;
+    pool->batch++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    mos6502_pool_work(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->finished < pool->threads - 1)
+    {
+        pthread_cond_wait(&pool->finish, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+mos6502_pool_t *mos6502_pool_create(int threads)
+{
+    if (threads <= 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+
+    mos6502_pool_t *pool = calloc(1, sizeof(mos6502_pool_t));
+    if (!pool)
+    {
+        return NULL;
+    }
+    pool->threads = threads;
+    pool->deques = aligned_alloc(64, (threads * sizeof(mos6502_pool_deque_t) + 63) / 64 * 64);
+    pool->workers = calloc(threads, sizeof(mos6502_pool_worker_t));
+    if (!pool->deques || !pool->workers)
+    {
+        free(pool->deques);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    memset(pool->deques, 0, threads * sizeof(mos6502_pool_deque_t));
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->finish, NULL);
+
+    pool->workers[0].pool = pool;
+    for (int i = 1; i < threads; i++)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        if (pthread_create(&pool->workers[i].thread, NULL, mos6502_pool_thread, &pool->workers[i]))
+        {
+            // keep the workers already running, destroy joins them
+            pool->threads = i;
+            mos6502_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void mos6502_pool_destroy(mos6502_pool_t *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->threads; i++)
+    {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for (int i = 0; i < pool->threads; i++)
+    {
+        free(pool->deques[i].jobs);
+    }
+
+    pthread_cond_destroy(&pool->finish);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool);
+}
+
+#ifdef _TEST
+
+#define TEST_POOL_JOBS 64
+
+static atomic_int test_pool_done;
+
+static void test_pool_count(mos6502_job_t *job)
+{
+    atomic_fetch_add(&test_pool_done, 1);
+}
+
+// lda $10, and #$0F, tax, sta $11, then an unknown opcode
+static int test_pool_jobs(mos6502_pool_t *pool)
+{
+    static const uint8_t program[] = {0xA5, 0x10, 0x29, 0x0F, 0xAA, 0x85, 0x11, 0x02};
+    mos6502_job_t *jobs = calloc(TEST_POOL_JOBS, sizeof(mos6502_job_t));
+    uint8_t *memory = calloc(TEST_POOL_JOBS, 65536);
+    if (!jobs || !memory)
+    {
+        free(jobs);
+        free(memory);
+        return 0;
+    }
+
+    for (int i = 0; i < TEST_POOL_JOBS; i++)
+    {
+        uint8_t *image = memory + i * 65536;
+        memcpy(image + 0x8000, program, sizeof(program));
+        image[0xFFFD] = 0x80;
+        image[0x10] = i * 5;
+        mos6502_init(&jobs[i].cpu);
+        jobs[i].memory = image;
+        jobs[i].cycle_budget = 100;
+        jobs[i].done = test_pool_count;
+    }
+
+    atomic_store(&test_pool_done, 0);
+    int result = mos6502_pool_run(pool, jobs, TEST_POOL_JOBS) == 0 && atomic_load(&test_pool_done) == TEST_POOL_JOBS;
+    for (int i = 0; i < TEST_POOL_JOBS; i++)
+    {
+        uint8_t value = (i * 5) & 0x0F;
+        result &= jobs[i].reason == MOS6502_STOP_UNKNOWN_OPCODE && jobs[i].cycles == 10 &&
+                  jobs[i].cpu.a == value && jobs[i].cpu.x == value && memory[i * 65536 + 0x11] == value &&
+                  jobs[i].cpu.pc == 0x8008;
+    }
+
+    free(jobs);
+    free(memory);
+    return result;
+}
+
+static int test_pool_threads(mos6502_t *cpu)
+{
+    mos6502_pool_t *pool = mos6502_pool_create(4);
+    if (!pool)
+    {
+        return 0;
+    }
+    // the pool is reused across batches
+    int result = test_pool_jobs(pool) && test_pool_jobs(pool);
+    mos6502_pool_destroy(pool);
+    return result;
+}
+
+static int test_pool_single_thread(mos6502_t *cpu)
+{
+    mos6502_pool_t *pool = mos6502_pool_create(1);
+    if (!pool)
+    {
+        return 0;
+    }
+    int result = test_pool_jobs(pool);
+    mos6502_pool_destroy(pool);
+    return result;
+}
+
+static int test_pool_empty(mos6502_t *cpu)
+{
+    mos6502_pool_t *pool = mos6502_pool_create(3);
+    if (!pool)
+    {
+        return 0;
+    }
+    int result = mos6502_pool_run(pool, NULL, 0) == 0;
+    mos6502_pool_destroy(pool);
+    return result;
+}
+
+void test_mos6502_pool()
+{
+    RUN_TEST(test_pool_threads);
+    RUN_TEST(test_pool_single_thread);
+    RUN_TEST(test_pool_empty);
+}
+#endif
@@ -0,0 +1,354 @@
+#include "operations.h"
+
+struct mos6502_predecoded;
+
+// runs a decoded instruction and steps pc past it like the handler would, returns
+// the cycles taken
+typedef int (*mos6502_predecoded_exec_t)(mos6502_t *cpu, const struct mos6502_predecoded *record);
+
+typedef struct mos6502_predecoded
+{
+    mos6502_predecoded_exec_t exec;
+    mos6502_opcode_t handler;
+    uint16_t operand;
+    uint8_t length;
+    // valid while equal to the generation of its page
+    uint32_t generation;
+} mos6502_predecoded_t;
+
+typedef struct mos6502_predecode
+{
+    // the map and write callback the host installed, and the map the cpu uses
+    // while predecoding: pages holding decoded bytes have no write pointer
+    // there, so every write to them goes through mos6502_predecode_write
+    const mos6502_page_map_t *pages;
+    void (*write)(struct mos6502 *cpu, uint16_t address, uint8_t value);
+    mos6502_page_map_t shadow;
+
+    // bumped when a decoded byte of the page is written
+    uint32_t generation[256];
+    // bytes covered by a valid record
+    uint8_t decoded[65536];
+    // records of each page, allocated on first decode
+    mos6502_predecoded_t *records[256];
+} mos6502_predecode_t;
+
+static void mos6502_predecode_invalidate(mos6502_predecode_t *predecode, uint8_t page)
+{
+    if (++predecode->generation[page] == 0)
+    {
+        predecode->generation[page] = 1;
+    }
+    memset(predecode->decoded + page * 256, 0, 256);
+    predecode->shadow.write[page] = predecode->pages->write[page];
+}
+
+static void mos6502_predecode_write(mos6502_t *cpu, uint16_t address, uint8_t value)
+{
+    mos6502_predecode_t *predecode = cpu->predecode;
+    uint8_t page = address >> 8;
+
+    // data sharing a page with code only pays for the detour
+    if (predecode->decoded[address])
+    {
+        mos6502_predecode_invalidate(predecode, page);
+    }
+
+    uint8_t *memory = predecode->pages->write[page];
+    if (memory)
+    {
+        memory[address & 0xFF] = value;
+        return;
+    }
+    predecode->write(cpu, address, value);
+}
+
+// the handler fetches its own operands
+static int mos6502_predecoded_handler(mos6502_t *cpu, const mos6502_predecoded_t *record)
+{
+    cpu->pc++;
+    return record->handler(cpu);
+}
+
+// the default handlers with the operand fetch done at decode time, composed
+// from the same table as mos6502_opcodes. each one steps pc by a constant so
+// the next fetch does not wait for the record's length to load
+
+#define MOS6502_PREDECODED(opcode, name, kind, operation, mode, cycles)                       \
+    static int mos6502_predecoded_##name(mos6502_t *cpu, const mos6502_predecoded_t *record) \
+    {                                                                                         \
+        cpu->pc += MOS6502_LENGTH_##mode;                                                     \
+        return mos6502_exec_##name(cpu, record->operand);                                     \
+    }
+
+MOS6502_OPCODES(MOS6502_PREDECODED)
+
+#define MOS6502_PREDECODED_ENTRY(opcode, name, ...) [opcode] = mos6502_predecoded_##name,
+
+static const mos6502_predecoded_exec_t mos6502_predecoded[256] = {
+    MOS6502_OPCODES(MOS6502_PREDECODED_ENTRY)
+};
+
+// decode the instruction at pc, NULL if it has to be fetched the normal way:
+// unknown opcodes, code outside mapped memory or crossing a page
+static mos6502_predecoded_t *mos6502_predecode_decode(mos6502_t *cpu, mos6502_predecode_t *predecode, uint16_t pc)
+{
+    uint8_t page = pc >> 8;
+    const uint8_t *memory = predecode->shadow.read[page];
+    if (!memory)
+    {
+        return NULL;
+    }
+
+    uint8_t opcode = memory[pc & 0xFF];
+    uint8_t length = mos6502_opcode_length[opcode];
+    mos6502_opcode_t handler = cpu->opcodes[opcode];
+    if (!handler || (pc & 0xFF) + length > 256)
+    {
+        return NULL;
+    }
+
+    if (!predecode->records[page])
+    {
+        predecode->records[page] = calloc(256, sizeof(mos6502_predecoded_t));
+        if (!predecode->records[page])
+        {
+            return NULL;
+        }
+    }
+
+    mos6502_predecoded_t *record = &predecode->records[page][pc & 0xFF];
+    record->handler = handler;
+    record->length = length;
+    record->operand = 0;
+    for (int i = length - 1; i > 0; i--)
+    {
+        record->operand = (record->operand << 8) | memory[(pc & 0xFF) + i];
+    }
+    record->exec = handler == mos6502_opcodes[opcode] ? mos6502_predecoded[opcode] : mos6502_predecoded_handler;
+    record->generation = predecode->generation[page];
+
+    memset(predecode->decoded + pc, 1, length);
+    predecode->shadow.write[page] = NULL;
+    return record;
+}
+
+int mos6502_predecode_run(mos6502_t *cpu)
+{
+    mos6502_predecode_t *predecode = cpu->predecode;
+
+    while (cpu->cycles < cpu->end)
+    {
+        int reason = mos6502_lines_stop(cpu);
+        if (reason >= 0)
+        {
+            return reason;
+        }
+
+        uint8_t page = cpu->pc >> 8;
+        mos6502_predecoded_t *record = predecode->records[page] ? &predecode->records[page][cpu->pc & 0xFF] : NULL;
+        if (!record || record->generation != predecode->generation[page])
+        {
+            record = mos6502_predecode_decode(cpu, predecode, cpu->pc);
+        }
+
+        if (record)
+        {
+            cpu->cycles += record->exec(cpu, record);
+            continue;
+        }
+
+        mos6502_opcode_t handler = cpu->opcodes[mos6502_read8(cpu, cpu->pc++)];
+        if (!handler)
+        {
+            return MOS6502_STOP_UNKNOWN_OPCODE;
+        }
+        cpu->cycles += handler(cpu);
+    }
+
+    return MOS6502_STOP_BUDGET;
+}
+
+int mos6502_predecode_enable(mos6502_t *cpu)
+{
+    if (cpu->predecode)
+    {
+        return 0;
+    }
+    if (cpu->jit || cpu->debug)
+    {
+        return -1;
+    }
+
+    mos6502_predecode_t *predecode = calloc(1, sizeof(mos6502_predecode_t));
+    if (!predecode)
+    {
+        return -1;
+    }
+
+    // records start zeroed, generation 0 is never current
+    for (int page = 0; page < 256; page++)
+    {
+        predecode->generation[page] = 1;
+    }
+    predecode->pages = cpu->pages;
+    predecode->write = cpu->write;
+    predecode->shadow = *cpu->pages;
+
+    cpu->predecode = predecode;
+    cpu->pages = &predecode->shadow;
+    cpu->write = mos6502_predecode_write;
+    return 0;
+}
+
+void mos6502_predecode_disable(mos6502_t *cpu)
+{
+    mos6502_predecode_t *predecode = cpu->predecode;
+    if (!predecode)
+    {
+        return;
+    }
+
+    cpu->pages = predecode->pages;
+    cpu->write = predecode->write;
+    cpu->predecode = NULL;
+
+    for (int page = 0; page < 256; page++)
+    {
+        free(predecode->records[page]);
+    }
+    free(predecode);
+}
+
+void mos6502_predecode_flush(mos6502_t *cpu)
+{
+    mos6502_predecode_t *predecode = cpu->predecode;
+    if (!predecode)
+    {
+        return;
+    }
+
+    memcpy(predecode->shadow.read, predecode->pages->read, sizeof(predecode->shadow.read));
+    for (int page = 0; page < 256; page++)
+    {
+        mos6502_predecode_invalidate(predecode, page);
+    }
+}
+
+void mos6502_predecode_flush_page(mos6502_t *cpu, uint8_t page)
+{
+    mos6502_predecode_t *predecode = cpu->predecode;
+    if (!predecode)
+    {
+        return;
+    }
+
+    predecode->shadow.read[page] = predecode->pages->read[page];
+    mos6502_predecode_invalidate(predecode, page);
+}
+
+#ifdef _TEST
+
+static int test_predecode_straight_line(mos6502_t *cpu)
+{
+    if (mos6502_predecode_enable(cpu))
+    {
+        return 0;
+    }
+    uint8_t program[] = {0xA9, 0x81, 0x85, 0x10, 0xA6, 0x10, 0x8A, 0x29, 0x0F, 0xA8, 0x8C, 0x00, 0x02, 0x38, 0xF8, 0xEA, 0x02};
+    mos6502_test_program(cpu, program, sizeof(program));
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 100, &cycles);
+    mos6502_predecode_disable(cpu);
+    return reason == MOS6502_STOP_UNKNOWN_OPCODE && cycles == 24 && cpu->pc == 0x8011 &&
+           cpu->a == 0x01 && cpu->x == 0x81 && cpu->y == 0x01 && mos6502_read8(cpu, 0x0010) == 0x81 &&
+           mos6502_read8(cpu, 0x0200) == 0x01 && cpu->flags == (CARRY | DECIMAL);
+}
+
+static int test_predecode_self_modifying(mos6502_t *cpu)
+{
+    if (mos6502_predecode_enable(cpu))
+    {
+        return 0;
+    }
+    mos6502_write8(cpu, 0x8000, 0xA9);
+    mos6502_write8(cpu, 0x8001, 0x01);
+    mos6502_run(cpu, 2, NULL);
+    // rewrite the operand of the decoded lda #
+    mos6502_write8(cpu, 0x8001, 0x02);
+    cpu->pc = 0x8000;
+    mos6502_run(cpu, 2, NULL);
+    mos6502_predecode_disable(cpu);
+    return cpu->a == 0x02;
+}
+
+static int test_predecode_data_write(mos6502_t *cpu)
+{
+    if (mos6502_predecode_enable(cpu))
+    {
+        return 0;
+    }
+    // sta $80F0 writes into the page of the code but not over it
+    uint8_t program[] = {0xA9, 0x42, 0x8D, 0xF0, 0x80};
+    mos6502_test_program(cpu, program, sizeof(program));
+    uint32_t generation = cpu->predecode->generation[0x80];
+    mos6502_run(cpu, 6, NULL);
+    int kept = cpu->predecode->generation[0x80] == generation;
+    mos6502_predecode_disable(cpu);
+    return kept && mos6502_read8(cpu, 0x80F0) == 0x42;
+}
+
+static int test_predecode_unmapped(mos6502_t *cpu)
+{
+    // code outside the page map is fetched through the read callback
+    mos6502_unmap_pages((mos6502_page_map_t *)cpu->pages, 0x80, 1);
+    if (mos6502_predecode_enable(cpu))
+    {
+        return 0;
+    }
+    cpu->write(cpu, 0x8000, 0xA2);
+    cpu->write(cpu, 0x8001, 0x33);
+    uint64_t cycles = 0;
+    mos6502_run(cpu, 2, &cycles);
+    int cached = cpu->predecode->records[0x80] != NULL;
+    mos6502_predecode_disable(cpu);
+    return !cached && cycles == 2 && cpu->x == 0x33;
+}
+
+static int test_predecode_cow_copy(mos6502_t *cpu)
+{
+    if (mos6502_cow_init(cpu))
+    {
+        return 0;
+    }
+    // sta $0210, the store copies the page shared with the code
+    uint8_t program[] = {0xA9, 0x42, 0x8D, 0x10, 0x02};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_write8(cpu, 0xFFFD, 0x80);
+    if (mos6502_predecode_enable(cpu))
+    {
+        mos6502_cow_free(cpu);
+        return 0;
+    }
+    uint32_t generation = cpu->predecode->generation[0x80];
+    mos6502_run(cpu, 6, NULL);
+    int result = cpu->predecode->generation[0x80] == generation && cpu->pages->read[0x02] != cpu->pages->read[0x03] &&
+                 mos6502_read8(cpu, 0x0210) == 0x42;
+
+    // the predecode cache still holds the copy-on-write map
+    result &= mos6502_cow_free(cpu) == -1;
+    mos6502_predecode_disable(cpu);
+    result &= mos6502_cow_free(cpu) == 0;
+    mos6502_write8(cpu, 0x0210, 0x00);
+    return result;
+}
+
+void test_mos6502_predecode()
+{
+    RUN_TEST(test_predecode_straight_line);
+    RUN_TEST(test_predecode_self_modifying);
+    RUN_TEST(test_predecode_data_write);
+    RUN_TEST(test_predecode_unmapped);
+    RUN_TEST(test_predecode_cow_copy);
+}
+#endif
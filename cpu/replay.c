@@ -0,0 +1,489 @@
+#include "opcodes.h"
+
+#define MOS6502_REPLAY_MAGIC "65RP"
+#define MOS6502_REPLAY_VERSION 1
+
+// magic, version, 3 reserved bytes, cycles at the start of the recording
+#define MOS6502_REPLAY_HEADER (4 + 1 + 3 + 8)
+
+// record tags, each followed by the cycles since the previous record (LEB128).
+// reads then hold the address (little endian) and the value. line changes have
+// the lines in the low bits of their tag and where they were seen (the
+// MOS6502_REPLAY_HOST/EVENTS/DEVICE sources of opcodes.h) in the high bits
+#define MOS6502_REPLAY_READ 0x00
+#define MOS6502_REPLAY_END 0xFF
+
+#define MOS6502_REPLAY_INTERRUPT (1)
+#define MOS6502_REPLAY_NMI (1 << 1)
+#define MOS6502_REPLAY_RST (1 << 2)
+#define MOS6502_REPLAY_RDY (1 << 3)
+
+// longest record: tag, 10 byte LEB128, address and value
+#define MOS6502_REPLAY_RECORD (1 + 10 + 3)
+
+typedef struct mos6502_replay
+{
+    FILE *file;
+    int replaying;
+    // recording: a write failed, replaying: the cpu went another way than the log
+    int failed;
+
+    // cycles of the last record written or read
+    uint64_t cycles;
+    // recording: the lines as last logged
+    uint8_t lines;
+
+    // replaying: the next record, decoded
+    uint8_t tag;
+    uint64_t tag_cycles;
+    uint16_t address;
+    uint8_t value;
+    // the cycle the replay event is scheduled for, 0 if none
+    uint64_t scheduled;
+
+    uint8_t (*previous_read)(mos6502_t *cpu, uint16_t address);
+    void (*previous_write)(mos6502_t *cpu, uint16_t address, uint8_t value);
+
+    size_t used;
+    size_t position;
+    uint8_t buffer[4096];
+} mos6502_replay_t;
+
+static uint8_t mos6502_replay_lines_mask(const mos6502_t *cpu)
+{
+    return (cpu->interrupt ? MOS6502_REPLAY_INTERRUPT : 0) | (cpu->nmi ? MOS6502_REPLAY_NMI : 0) |
+           (cpu->rst ? MOS6502_REPLAY_RST : 0) | (cpu->rdy ? MOS6502_REPLAY_RDY : 0);
+}
+
+static void mos6502_replay_flush(mos6502_replay_t *replay)
+{
+    if (replay->used && fwrite(replay->buffer, replay->used, 1, replay->file) != 1)
+    {
+        replay->failed = 1;
+    }
+    replay->used = 0;
+}
+
+static void mos6502_replay_put(mos6502_replay_t *replay, uint8_t tag, uint64_t cycles)
+{
+    if (replay->used + MOS6502_REPLAY_RECORD > sizeof(replay->buffer))
+    {
+        mos6502_replay_flush(replay);
+    }
+
+    uint8_t *out = &replay->buffer[replay->used];
+    *out++ = tag;
+    uint64_t delta = cycles - replay->cycles;
+    while (delta >= 0x80)
+    {
+        *out++ = (delta & 0x7F) | 0x80;
+        delta >>= 7;
+    }
+    *out++ = delta;
+    replay->used = out - replay->buffer;
+    replay->cycles = cycles;
+}
+
+static void mos6502_replay_sample(mos6502_t *cpu, int source)
+{
+    mos6502_replay_t *replay = cpu->replay;
+    uint8_t lines = mos6502_replay_lines_mask(cpu);
+    if (lines != replay->lines)
+    {
+        mos6502_replay_put(replay, source | lines, cpu->cycles);
+        replay->lines = lines;
+    }
+}
+
+static uint8_t mos6502_record_read(mos6502_t *cpu, uint16_t address)
+{
+    mos6502_replay_t *replay = cpu->replay;
+    uint8_t value = replay->previous_read(cpu, address);
+
+    mos6502_replay_put(replay, MOS6502_REPLAY_READ, cpu->cycles);
+    replay->buffer[replay->used++] = address & 0xFF;
+    replay->buffer[replay->used++] = address >> 8;
+    replay->buffer[replay->used++] = value;
+
+    // the device may have raised or dropped a line
+    mos6502_replay_sample(cpu, MOS6502_REPLAY_DEVICE);
+    return value;
+}
+
+static void mos6502_record_write(mos6502_t *cpu, uint16_t address, uint8_t value)
+{
+    cpu->replay->previous_write(cpu, address, value);
+    mos6502_replay_sample(cpu, MOS6502_REPLAY_DEVICE);
+}
+
+// decode the next record into tag/tag_cycles/address/value, a truncated log
+// reads as its end
+static void mos6502_replay_decode(mos6502_replay_t *replay)
+{
+    if (replay->used - replay->position < MOS6502_REPLAY_RECORD && !feof(replay->file))
+    {
+        size_t left = replay->used - replay->position;
+        memmove(replay->buffer, &replay->buffer[replay->position], left);
+        replay->used = left + fread(&replay->buffer[left], 1, sizeof(replay->buffer) - left, replay->file);
+        replay->position = 0;
+    }
+
+    const uint8_t *in = &replay->buffer[replay->position];
+    const uint8_t *end = &replay->buffer[replay->used];
+    replay->tag = MOS6502_REPLAY_END;
+    if (in == end || *in == MOS6502_REPLAY_END)
+    {
+        return;
+    }
+
+    uint8_t tag = *in++;
+    uint64_t delta = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *in++;
+        delta |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            break;
+        }
+    }
+    if (tag == MOS6502_REPLAY_READ)
+    {
+        if (end - in < 3)
+        {
+            return;
+        }
+        replay->address = in[0] | (in[1] << 8);
+        replay->value = in[2];
+        in += 3;
+    }
+    replay->tag = tag;
+    replay->tag_cycles = replay->cycles + delta;
+    replay->cycles = replay->tag_cycles;
+    replay->position = in - replay->buffer;
+}
+
+static void mos6502_replay_event(mos6502_t *cpu, void *user);
+
+// apply the line changes seen at source that are due by now, then have the
+// scheduler stop the run at the next change seen by the events, so it lands on
+// the instruction boundary it was recorded at
+static void mos6502_replay_apply(mos6502_t *cpu, int source)
+{
+    mos6502_replay_t *replay = cpu->replay;
+    while ((replay->tag & 0xF0) == source && replay->tag_cycles <= cpu->cycles)
+    {
+        cpu->interrupt = (replay->tag & MOS6502_REPLAY_INTERRUPT) != 0;
+        cpu->nmi = (replay->tag & MOS6502_REPLAY_NMI) != 0;
+        cpu->rst = (replay->tag & MOS6502_REPLAY_RST) != 0;
+        cpu->rdy = (replay->tag & MOS6502_REPLAY_RDY) != 0;
+        mos6502_replay_decode(replay);
+    }
+
+    if ((replay->tag & 0xF0) == MOS6502_REPLAY_EVENTS && replay->scheduled != replay->tag_cycles)
+    {
+        mos6502_event_cancel(cpu, mos6502_replay_event, replay);
+        if (mos6502_event_schedule(cpu, replay->tag_cycles, mos6502_replay_event, replay))
+        {
+            replay->failed = 1;
+        }
+        replay->scheduled = replay->tag_cycles;
+    }
+}
+
+static void mos6502_replay_event(mos6502_t *cpu, void *user)
+{
+    cpu->replay->scheduled = 0;
+    mos6502_replay_apply(cpu, MOS6502_REPLAY_EVENTS);
+}
+
+static uint8_t mos6502_replay_read(mos6502_t *cpu, uint16_t address)
+{
+    mos6502_replay_t *replay = cpu->replay;
+    if (replay->tag != MOS6502_REPLAY_READ || replay->tag_cycles != cpu->cycles || replay->address != address)
+    {
+        // past the divergence the log means nothing, reads return 0
+        replay->failed = 1;
+        return 0x00;
+    }
+
+    uint8_t value = replay->value;
+    mos6502_replay_decode(replay);
+    mos6502_replay_apply(cpu, MOS6502_REPLAY_DEVICE);
+    return value;
+}
+
+// the device is gone, but what its writes did to the lines is in the log
+static void mos6502_replay_write(mos6502_t *cpu, uint16_t address, uint8_t value)
+{
+    mos6502_replay_apply(cpu, MOS6502_REPLAY_DEVICE);
+}
+
+void mos6502_replay_sync(mos6502_t *cpu, int source)
+{
+    if (cpu->replay->replaying)
+    {
+        mos6502_replay_apply(cpu, source);
+    }
+    else
+    {
+        mos6502_replay_sample(cpu, source);
+    }
+}
+
+static mos6502_replay_t *mos6502_replay_open(mos6502_t *cpu, FILE *file, int replaying)
+{
+    if (cpu->replay)
+    {
+        return NULL;
+    }
+
+    mos6502_replay_t *replay = calloc(1, sizeof(mos6502_replay_t));
+    if (!replay)
+    {
+        return NULL;
+    }
+    replay->file = file;
+    replay->replaying = replaying;
+    replay->cycles = cpu->cycles;
+    replay->previous_read = cpu->read;
+    replay->previous_write = cpu->write;
+    return replay;
+}
+
+int mos6502_record_start(mos6502_t *cpu, FILE *out)
+{
+    mos6502_replay_t *replay = mos6502_replay_open(cpu, out, 0);
+    if (!replay)
+    {
+        return -1;
+    }
+
+    memcpy(replay->buffer, MOS6502_REPLAY_MAGIC, 4);
+    replay->buffer[4] = MOS6502_REPLAY_VERSION;
+    for (int i = 0; i < 8; i++)
+    {
+        replay->buffer[8 + i] = cpu->cycles >> (i * 8);
+    }
+    replay->used = MOS6502_REPLAY_HEADER;
+
+    // the lines at the start are the first record
+    mos6502_replay_put(replay, MOS6502_REPLAY_HOST | mos6502_replay_lines_mask(cpu), cpu->cycles);
+    replay->lines = mos6502_replay_lines_mask(cpu);
+
+    cpu->replay = replay;
+    cpu->read = mos6502_record_read;
+    cpu->write = mos6502_record_write;
+    return 0;
+}
+
+int mos6502_replay_start(mos6502_t *cpu, FILE *in)
+{
+    mos6502_replay_t *replay = mos6502_replay_open(cpu, in, 1);
+    if (!replay)
+    {
+        return -1;
+    }
+
+    uint8_t header[MOS6502_REPLAY_HEADER];
+    uint64_t cycles = 0;
+    if (fread(header, sizeof(header), 1, in) != 1 || memcmp(header, MOS6502_REPLAY_MAGIC, 4) ||
+        header[4] != MOS6502_REPLAY_VERSION)
+    {
+        free(replay);
+        return -1;
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        cycles |= (uint64_t)header[8 + i] << (i * 8);
+    }
+    if (cycles != cpu->cycles)
+    {
+        free(replay);
+        return -1;
+    }
+
+    cpu->replay = replay;
+    cpu->read = mos6502_replay_read;
+    cpu->write = mos6502_replay_write;
+    mos6502_replay_decode(replay);
+    mos6502_replay_apply(cpu, MOS6502_REPLAY_HOST);
+    return 0;
+}
+
+int mos6502_replay_stop(mos6502_t *cpu)
+{
+    mos6502_replay_t *replay = cpu->replay;
+    if (!replay)
+    {
+        return -1;
+    }
+
+    if (replay->replaying)
+    {
+        mos6502_event_cancel(cpu, mos6502_replay_event, replay);
+    }
+    else
+    {
+        replay->buffer[replay->used++] = MOS6502_REPLAY_END;
+        mos6502_replay_flush(replay);
+        if (fflush(replay->file))
+        {
+            replay->failed = 1;
+        }
+    }
+
+    int result = replay->failed ? -1 : 0;
+    cpu->read = replay->previous_read;
+    cpu->write = replay->previous_write;
+    cpu->replay = NULL;
+    free(replay);
+    return result;
+}
+
+int mos6502_replay_failed(const mos6502_t *cpu)
+{
+    return cpu->replay && cpu->replay->failed;
+}
+
+#ifdef _TEST
+
+// polls $D010 until it is not 0, then stores $D011 at $0200
+static const uint8_t test_replay_program[] = {
+    0xAE, 0x10, 0xD0, // loop: ldx $D010
+    0xF0, 0xFB,       //       beq loop
+    0xAE, 0x11, 0xD0, //       ldx $D011
+    0x8A,             //       txa
+    0x8D, 0x00, 0x02, //       sta $0200
+    0x02,
+};
+
+typedef struct test_replay_machine
+{
+    mos6502_page_map_t pages;
+    int polls;
+} test_replay_machine_t;
+
+static test_replay_machine_t test_replay_machine;
+
+static uint8_t test_replay_device(mos6502_t *cpu, uint16_t address)
+{
+    if (address == 0xD011)
+    {
+        return 0x42;
+    }
+    return ++test_replay_machine.polls < 6 ? 0x00 : 0x07;
+}
+
+static uint8_t test_replay_unplugged(mos6502_t *cpu, uint16_t address)
+{
+    return 0xFF;
+}
+
+static void test_replay_irq(mos6502_t *cpu, void *user)
+{
+    cpu->interrupt = 1;
+}
+
+static void test_replay_setup(mos6502_t *cpu)
+{
+    test_replay_machine_t *machine = &test_replay_machine;
+    machine->pages = *cpu->pages;
+    machine->pages.read[0xD0] = NULL;
+    machine->pages.write[0xD0] = NULL;
+    cpu->pages = &machine->pages;
+    machine->polls = 0;
+
+    mos6502_test_program(cpu, test_replay_program, sizeof(test_replay_program));
+}
+
+static int test_replay_roundtrip(mos6502_t *cpu)
+{
+    static uint8_t snapshot[65536 + 64];
+    FILE *log = tmpfile();
+    if (!log)
+    {
+        return 0;
+    }
+
+    test_replay_setup(cpu);
+    size_t size = mos6502_snapshot_save(cpu, snapshot, sizeof(snapshot));
+
+    // recorded: the device answers, an event raises the interrupt, the host
+    // acknowledges it between runs
+    cpu->read = test_replay_device;
+    int result = mos6502_record_start(cpu, log) == 0;
+    mos6502_event_schedule(cpu, 20, test_replay_irq, NULL);
+    uint64_t first = 0, second = 0;
+    int stop = mos6502_run(cpu, 1000, &first);
+    cpu->interrupt = 0;
+    int end = mos6502_run(cpu, 1000, &second);
+    result &= mos6502_replay_stop(cpu) == 0 && cpu->read == test_replay_device;
+    result &= stop == MOS6502_STOP_INTERRUPT && first == 21 && end == MOS6502_STOP_UNKNOWN_OPCODE;
+
+    uint8_t x = cpu->x;
+    uint64_t cycles = cpu->cycles;
+    uint8_t stored = mos6502_read8(cpu, 0x0200);
+    mos6502_events_free(cpu);
+
+    // the log is 16 bytes of header, 6 per poll and a few line changes
+    long length = ftell(log);
+    result &= length > 0 && length < 80;
+
+    // replayed: no device and no event, the same runs end the same way
+    rewind(log);
+    result &= mos6502_snapshot_restore(cpu, snapshot, size) == 0;
+    cpu->read = test_replay_unplugged;
+    result &= mos6502_replay_start(cpu, log) == 0;
+    uint64_t replayed_first = 0, replayed_second = 0;
+    result &= mos6502_run(cpu, 1000, &replayed_first) == MOS6502_STOP_INTERRUPT && replayed_first == first;
+    result &= mos6502_run(cpu, 1000, &replayed_second) == MOS6502_STOP_UNKNOWN_OPCODE && replayed_second == second;
+    result &= !mos6502_replay_failed(cpu) && cpu->x == x && cpu->cycles == cycles &&
+              mos6502_read8(cpu, 0x0200) == stored && stored == 0x42 && !cpu->interrupt;
+    result &= mos6502_replay_stop(cpu) == 0 && cpu->read == test_replay_unplugged && cpu->events != NULL &&
+              mos6502_event_next(cpu) == UINT64_MAX;
+
+    mos6502_events_free(cpu);
+    fclose(log);
+    return result;
+}
+
+static int test_replay_divergence(mos6502_t *cpu)
+{
+    FILE *log = tmpfile();
+    if (!log)
+    {
+        return 0;
+    }
+
+    test_replay_setup(cpu);
+    cpu->read = test_replay_device;
+    int result = mos6502_record_start(cpu, log) == 0 && mos6502_record_start(cpu, log) == -1;
+    mos6502_run(cpu, 1000, NULL);
+    result &= mos6502_replay_stop(cpu) == 0;
+
+    // different code reads somewhere else
+    rewind(log);
+    cpu->cycles = 0;
+    cpu->pc = 0x8000;
+    mos6502_write8(cpu, 0x8001, 0x20);
+    result &= mos6502_replay_start(cpu, log) == 0;
+    mos6502_run(cpu, 1000, NULL);
+    result &= mos6502_replay_failed(cpu) && mos6502_replay_stop(cpu) == -1;
+
+    // a log of another start cycle is refused
+    rewind(log);
+    cpu->cycles = 5;
+    result &= mos6502_replay_start(cpu, log) == -1 && cpu->replay == NULL;
+
+    mos6502_events_free(cpu);
+    fclose(log);
+    return result;
+}
+
+void test_mos6502_replay()
+{
+    RUN_TEST(test_replay_roundtrip);
+    RUN_TEST(test_replay_divergence);
+}
+#endif
\ No newline at end of file
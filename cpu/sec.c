@@ -1,15 +1,4 @@
-#include "mos6502.h"
-
-static int sec(mos6502_t *cpu)
-{
-    mos6502_set_flag(cpu, CARRY, 1);
-    return 2;
-}
-
-void mos6502_register_sec(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0x38, sec);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
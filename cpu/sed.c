@@ -1,15 +1,4 @@
-#include "mos6502.h"
-
-static int sed(mos6502_t *cpu)
-{
-    mos6502_set_flag(cpu, DECIMAL, 1);
-    return 2;
-}
-
-void mos6502_register_sed(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0xF8, sed);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
@@ -0,0 +1,287 @@
+#include "mos6502.h"
+
+#define MOS6502_SNAPSHOT_MAGIC "6502"
+
+// magic, version, a, x, y, sp, flags, pc, lines, cycles, page bitmap
+#define MOS6502_SNAPSHOT_HEADER (4 + 1 + 5 + 2 + 1 + 8 + 32)
+
+#define MOS6502_SNAPSHOT_INTERRUPT (1)
+#define MOS6502_SNAPSHOT_NMI (1 << 1)
+#define MOS6502_SNAPSHOT_RST (1 << 2)
+#define MOS6502_SNAPSHOT_RDY (1 << 3)
+
+// memory is saved for the pages with direct host memory, callback pages are
+// devices owned by the host
+static int mos6502_snapshot_pages(const mos6502_t *cpu)
+{
+    int count = 0;
+    for (int page = 0; page < 256; page++)
+    {
+        count += cpu->pages->read[page] != NULL;
+    }
+    return count;
+}
+
+size_t mos6502_snapshot_size(const mos6502_t *cpu)
+{
+    return MOS6502_SNAPSHOT_HEADER + (size_t)mos6502_snapshot_pages(cpu) * 256;
+}
+
+size_t mos6502_snapshot_save(mos6502_t *cpu, uint8_t *buffer, size_t size)
+{
+    size_t needed = mos6502_snapshot_size(cpu);
+    if (size < needed)
+    {
+        return 0;
+    }
+
+    mos6502_flags_sync(cpu);
+
+    uint8_t *out = buffer;
+    memcpy(out, MOS6502_SNAPSHOT_MAGIC, 4);
+    out += 4;
+    *out++ = MOS6502_SNAPSHOT_VERSION;
+    *out++ = cpu->a;
+    *out++ = cpu->x;
+    *out++ = cpu->y;
+    *out++ = cpu->sp;
+    *out++ = cpu->flags;
+    *out++ = cpu->pc & 0xFF;
+    *out++ = cpu->pc >> 8;
+    *out++ = (cpu->interrupt ? MOS6502_SNAPSHOT_INTERRUPT : 0) | (cpu->nmi ? MOS6502_SNAPSHOT_NMI : 0) |
+             (cpu->rst ? MOS6502_SNAPSHOT_RST : 0) | (cpu->rdy ? MOS6502_SNAPSHOT_RDY : 0);
+    for (int i = 0; i < 8; i++)
+    {
+        *out++ = cpu->cycles >> (i * 8);
+    }
+
+    uint8_t *bitmap = out;
+    out += 32;
+    memset(bitmap, 0, 32);
+    for (int page = 0; page < 256; page++)
+    {
+        const uint8_t *memory = cpu->pages->read[page];
+        if (memory)
+        {
+            bitmap[page >> 3] |= 1 << (page & 7);
+            memcpy(out, memory, 256);
+            out += 256;
+        }
+    }
+
+    return out - buffer;
+}
+
+int mos6502_snapshot_restore(mos6502_t *cpu, const uint8_t *buffer, size_t size)
+{
+    if (size < MOS6502_SNAPSHOT_HEADER || memcmp(buffer, MOS6502_SNAPSHOT_MAGIC, 4) ||
+        buffer[4] != MOS6502_SNAPSHOT_VERSION)
+    {
+        return -1;
+    }
+
+    // check everything before touching cpu, a rejected snapshot leaves it as is
+    const uint8_t *bitmap = buffer + MOS6502_SNAPSHOT_HEADER - 32;
+    size_t needed = MOS6502_SNAPSHOT_HEADER;
+    for (int page = 0; page < 256; page++)
+    {
+        if (bitmap[page >> 3] & (1 << (page & 7)))
+        {
+            if (!cpu->pages->read[page])
+            {
+                return -1;
+            }
+            needed += 256;
+        }
+    }
+    if (size < needed)
+    {
+        return -1;
+    }
+
+    const uint8_t *in = buffer + 5;
+    cpu->a = *in++;
+    cpu->x = *in++;
+    cpu->y = *in++;
+    cpu->sp = *in++;
+    cpu->flags = *in++;
+    cpu->pc = in[0] | (in[1] << 8);
+    in += 2;
+    uint8_t lines = *in++;
+    cpu->interrupt = (lines & MOS6502_SNAPSHOT_INTERRUPT) != 0;
+    cpu->nmi = (lines & MOS6502_SNAPSHOT_NMI) != 0;
+    cpu->rst = (lines & MOS6502_SNAPSHOT_RST) != 0;
+    cpu->rdy = (lines & MOS6502_SNAPSHOT_RDY) != 0;
+    cpu->cycles = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        cpu->cycles |= (uint64_t)*in++ << (i * 8);
+    }
+    mos6502_flags_load(cpu);
+
+    in += 32;
+    for (int page = 0; page < 256; page++)
+    {
+        if (!(bitmap[page >> 3] & (1 << (page & 7))))
+        {
+            continue;
+        }
+
+        uint8_t *memory = cpu->pages->write[page];
+        if (memory)
+        {
+            memcpy(memory, in, 256);
+        }
+        else if (memcmp(cpu->pages->read[page], in, 256))
+        {
+            // read-only, copy-on-write or watched by the jit/predecode cache:
+            // only the bytes that changed go through the write callback
+            for (int i = 0; i < 256; i++)
+            {
+                if (cpu->pages->read[page][i] != in[i])
+                {
+                    mos6502_write8(cpu, (page << 8) | i, in[i]);
+                }
+            }
+        }
+        in += 256;
+    }
+
+    return 0;
+}
+
+#ifdef _TEST
+
+static int test_snapshot_roundtrip(mos6502_t *cpu)
+{
+    static uint8_t buffer[MOS6502_SNAPSHOT_HEADER + 65536];
+
+    cpu->a = 0x12;
+    cpu->x = 0x34;
+    cpu->y = 0x56;
+    cpu->sp = 0xFD;
+    cpu->pc = 0xABCD;
+    cpu->flags = NEGATIVE | CARRY;
+    cpu->rst = 0;
+    cpu->nmi = 1;
+    cpu->cycles = 0x0102030405060708;
+    mos6502_flags_load(cpu);
+    mos6502_write8(cpu, 0x1234, 0x99);
+
+    size_t size = mos6502_snapshot_save(cpu, buffer, sizeof(buffer));
+    if (size != mos6502_snapshot_size(cpu) || size != MOS6502_SNAPSHOT_HEADER + 65536)
+    {
+        return 0;
+    }
+
+    cpu->a = cpu->x = cpu->y = 0;
+    cpu->pc = 0;
+    cpu->flags = 0;
+    cpu->nmi = 0;
+    cpu->rdy = 0;
+    cpu->cycles = 0;
+    mos6502_flags_load(cpu);
+    mos6502_write8(cpu, 0x1234, 0x00);
+
+    return mos6502_snapshot_restore(cpu, buffer, size) == 0 && cpu->a == 0x12 && cpu->x == 0x34 &&
+           cpu->y == 0x56 && cpu->sp == 0xFD && cpu->pc == 0xABCD && cpu->flags == (NEGATIVE | CARRY) &&
+           mos6502_get_flag(cpu, NEGATIVE) && !mos6502_get_flag(cpu, ZERO) && cpu->nmi && cpu->rdy &&
+           !cpu->rst && !cpu->interrupt && cpu->cycles == 0x0102030405060708 &&
+           mos6502_read8(cpu, 0x1234) == 0x99;
+}
+
+static int test_snapshot_resume(mos6502_t *cpu)
+{
+    static uint8_t buffer[MOS6502_SNAPSHOT_HEADER + 65536];
+
+    // lda $10, sta $11, lda #$01, sta $10
+    static const uint8_t program[] = {0xA5, 0x10, 0x85, 0x11, 0xA9, 0x01, 0x85, 0x10};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_write8(cpu, 0x0010, 0x42);
+    mos6502_run(cpu, 6, NULL);
+
+    size_t size = mos6502_snapshot_save(cpu, buffer, sizeof(buffer));
+    mos6502_run(cpu, 5, NULL);
+    uint8_t a = cpu->a;
+    uint64_t cycles = cpu->cycles;
+    uint8_t value = mos6502_read8(cpu, 0x0010);
+
+    // running from the snapshot again ends in the same state
+    if (mos6502_snapshot_restore(cpu, buffer, size) || mos6502_read8(cpu, 0x0010) != 0x42 || cpu->pc != 0x8004)
+    {
+        return 0;
+    }
+    mos6502_run(cpu, 5, NULL);
+    return cpu->a == a && a == 0x01 && cpu->cycles == cycles && mos6502_read8(cpu, 0x0010) == value && value == 0x01;
+}
+
+static int test_snapshot_sparse(mos6502_t *cpu)
+{
+    uint8_t ram[512] = {0};
+    uint8_t rom[256] = {0};
+    uint8_t buffer[MOS6502_SNAPSHOT_HEADER + 3 * 256];
+    mos6502_page_map_t map;
+    mos6502_map_init(&map);
+    mos6502_map_pages(&map, 0x00, 2, ram, 0);
+    mos6502_map_pages(&map, 0xFF, 1, rom, 1);
+    cpu->pages = &map;
+
+    // only mapped pages are saved, callback pages are left to the host
+    rom[0xFC] = 0x80;
+    ram[0x1FF] = 0x77;
+    size_t size = mos6502_snapshot_save(cpu, buffer, sizeof(buffer));
+    if (size != sizeof(buffer) || mos6502_snapshot_save(cpu, buffer, sizeof(buffer) - 1) != 0)
+    {
+        return 0;
+    }
+
+    ram[0x1FF] = 0x00;
+    if (mos6502_snapshot_restore(cpu, buffer, size) || ram[0x1FF] != 0x77)
+    {
+        return 0;
+    }
+
+    // truncated, wrong version and unmapped pages are rejected
+    int result = mos6502_snapshot_restore(cpu, buffer, size - 1) == -1;
+    mos6502_unmap_pages(&map, 0x01, 1);
+    result &= mos6502_snapshot_restore(cpu, buffer, size) == -1;
+    mos6502_map_pages(&map, 0x01, 1, ram + 256, 0);
+    buffer[4]++;
+    result &= mos6502_snapshot_restore(cpu, buffer, size) == -1;
+    return result;
+}
+
+static int test_snapshot_cow(mos6502_t *cpu)
+{
+    static uint8_t buffer[MOS6502_SNAPSHOT_HEADER + 65536];
+    mos6502_t child;
+    if (mos6502_cow_init(cpu))
+    {
+        return 0;
+    }
+    mos6502_write8(cpu, 0x2000, 0x11);
+    size_t size = mos6502_snapshot_save(cpu, buffer, sizeof(buffer));
+    mos6502_write8(cpu, 0x2000, 0x22);
+    if (mos6502_fork(&child, cpu))
+    {
+        mos6502_cow_free(cpu);
+        return 0;
+    }
+
+    // restoring into a shared page copies it instead of writing through
+    int result = mos6502_snapshot_restore(&child, buffer, size) == 0 && mos6502_read8(&child, 0x2000) == 0x11 &&
+                 mos6502_read8(cpu, 0x2000) == 0x22;
+
+    mos6502_cow_free(&child);
+    mos6502_cow_free(cpu);
+    return result;
+}
+
+void test_mos6502_snapshot()
+{
+    RUN_TEST(test_snapshot_roundtrip);
+    RUN_TEST(test_snapshot_resume);
+    RUN_TEST(test_snapshot_sparse);
+    RUN_TEST(test_snapshot_cow);
+}
+#endif
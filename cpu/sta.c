@@ -1,69 +1,4 @@
-#include "mos6502.h"
-
-static int sta_zeropage(mos6502_t *cpu)
-{
-    uint8_t zp_address = mos6502_read8(cpu, cpu->pc++);
-    mos6502_write8(cpu, (uint16_t)zp_address, cpu->a);
-    return 3;
-}
-
-static int sta_zeropage_x(mos6502_t *cpu)
-{
-    uint8_t zp_address = (mos6502_read8(cpu, cpu->pc++)) + cpu->x;
-    mos6502_write8(cpu, (uint16_t)zp_address, cpu->a);
-    return 4;
-}
-
-static int sta_absolute(mos6502_t *cpu)
-{
-    uint16_t address = mos6502_read16(cpu, cpu->pc);
-    cpu->pc+=2;
-    mos6502_write8(cpu, address, cpu->a);
-    return 4;
-}
-
-static int sta_absolute_x(mos6502_t *cpu)
-{
-    uint16_t address = (mos6502_read16(cpu, cpu->pc)) + cpu->x;
-    cpu->pc+=2;
-    mos6502_write8(cpu, address, cpu->a);
-    return 5;
-}
-
-static int sta_absolute_y(mos6502_t *cpu)
-{
-    uint16_t address = (mos6502_read16(cpu, cpu->pc)) + cpu->y;
-    cpu->pc+=2;
-    mos6502_write8(cpu, address, cpu->a);
-    return 5;
-}
-
-static int sta_indirect_x(mos6502_t *cpu)
-{
-    uint8_t zp_address = (mos6502_read8(cpu, cpu->pc++)) + cpu->x;
-    uint16_t address = mos6502_read16(cpu, (uint16_t)zp_address);
-    mos6502_write8(cpu, address, cpu->a);
-    return 6;
-}
-
-static int sta_indirect_y(mos6502_t *cpu)
-{
-    uint8_t zp_address = mos6502_read8(cpu, cpu->pc++);
-    uint16_t address = (mos6502_read16(cpu, (uint16_t)zp_address)) + cpu->y;
-    mos6502_write8(cpu, address, cpu->a);
-    return 6;
-}
-
-void mos6502_register_sta(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0x85, sta_zeropage);
-    mos6502_register_opcode(cpu, 0x95, sta_zeropage_x);
-    mos6502_register_opcode(cpu, 0x8D, sta_absolute);
-    mos6502_register_opcode(cpu, 0x9D, sta_absolute_x);
-    mos6502_register_opcode(cpu, 0x99, sta_absolute_y);
-    mos6502_register_opcode(cpu, 0x81, sta_indirect_x);
-    mos6502_register_opcode(cpu, 0x91, sta_indirect_y);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
@@ -0,0 +1,266 @@
+#include "opcodes.h"
+
+#define MOS6502_STATS_NAME(opcode, name, ...) [opcode] = #name,
+
+static const char *const mos6502_stats_names[256] = {
+    MOS6502_OPCODES(MOS6502_STATS_NAME)
+};
+
+#ifdef MOS6502_STATS
+
+int mos6502_stats_run(mos6502_t *cpu)
+{
+    const mos6502_opcode_t *opcodes = cpu->opcodes;
+
+    while (cpu->cycles < cpu->end)
+    {
+        int reason = mos6502_lines_stop(cpu);
+        if (reason >= 0)
+        {
+            return reason;
+        }
+
+        uint8_t opcode = mos6502_read8(cpu, cpu->pc++);
+        mos6502_opcode_t handler = opcodes[opcode];
+        if (!handler)
+        {
+            return MOS6502_STOP_UNKNOWN_OPCODE;
+        }
+
+        int ticks = handler(cpu);
+        cpu->cycles += ticks;
+        mos6502_stats_instruction(cpu, opcode, ticks);
+    }
+
+    return MOS6502_STOP_BUDGET;
+}
+
+int mos6502_stats_enable(mos6502_t *cpu)
+{
+    if (cpu->stats)
+    {
+        return 0;
+    }
+    cpu->stats = calloc(1, sizeof(mos6502_stats_t));
+    return cpu->stats ? 0 : -1;
+}
+
+#else
+
+int mos6502_stats_run(mos6502_t *cpu)
+{
+    return MOS6502_STOP_BUDGET;
+}
+
+int mos6502_stats_enable(mos6502_t *cpu)
+{
+    return -1;
+}
+
+#endif
+
+void mos6502_stats_disable(mos6502_t *cpu)
+{
+    free(cpu->stats);
+    cpu->stats = NULL;
+}
+
+void mos6502_stats_reset(mos6502_t *cpu)
+{
+    if (cpu->stats)
+    {
+        memset(cpu->stats, 0, sizeof(mos6502_stats_t));
+    }
+}
+
+void mos6502_stats_modes(const mos6502_stats_t *stats, uint64_t executed[MOS6502_MODES],
+                         uint64_t cycles[MOS6502_MODES])
+{
+    memset(executed, 0, MOS6502_MODES * sizeof(uint64_t));
+    memset(cycles, 0, MOS6502_MODES * sizeof(uint64_t));
+    for (int opcode = 0; opcode < 256; opcode++)
+    {
+        mos6502_mode_t mode = mos6502_opcode_mode(opcode);
+        executed[mode] += stats->executed[opcode];
+        cycles[mode] += stats->cycles[opcode];
+    }
+}
+
+void mos6502_stats_dump(const mos6502_stats_t *stats, FILE *out)
+{
+    uint64_t executed[MOS6502_MODES];
+    uint64_t cycles[MOS6502_MODES];
+    uint64_t total_executed = 0;
+    uint64_t total_cycles = 0;
+
+    mos6502_stats_modes(stats, executed, cycles);
+    for (int mode = 0; mode < MOS6502_MODES; mode++)
+    {
+        total_executed += executed[mode];
+        total_cycles += cycles[mode];
+    }
+
+    fprintf(out, "instructions %llu cycles %llu\n", (unsigned long long)total_executed,
+            (unsigned long long)total_cycles);
+
+    fprintf(out, "opcode name                 mode         executed         cycles\n");
+    for (int opcode = 0; opcode < 256; opcode++)
+    {
+        if (stats->executed[opcode])
+        {
+            const char *name = mos6502_stats_names[opcode] ? mos6502_stats_names[opcode] : "";
+            fprintf(out, "$%02X    %-20s %-12s %-16llu %llu\n", opcode, name,
+                    mos6502_mode_names[mos6502_opcode_mode(opcode)], (unsigned long long)stats->executed[opcode],
+                    (unsigned long long)stats->cycles[opcode]);
+        }
+    }
+
+    fprintf(out, "mode         executed         cycles\n");
+    for (int mode = 0; mode < MOS6502_MODES; mode++)
+    {
+        if (executed[mode])
+        {
+            fprintf(out, "%-12s %-16llu %llu\n", mos6502_mode_names[mode], (unsigned long long)executed[mode],
+                    (unsigned long long)cycles[mode]);
+        }
+    }
+
+    fprintf(out, "cycles       instructions\n");
+    for (int ticks = 0; ticks <= MOS6502_STATS_MAX_CYCLES; ticks++)
+    {
+        if (stats->histogram[ticks])
+        {
+            fprintf(out, "%d%-11s %llu\n", ticks, ticks == MOS6502_STATS_MAX_CYCLES ? "+" : "",
+                    (unsigned long long)stats->histogram[ticks]);
+        }
+    }
+
+    fprintf(out, "branches taken %llu not taken %llu page crosses %llu\n",
+            (unsigned long long)stats->branches_taken, (unsigned long long)stats->branches_not_taken,
+            (unsigned long long)stats->branch_page_crosses);
+    fprintf(out, "indexed page crosses %llu\n", (unsigned long long)stats->page_crosses);
+}
+
+#ifdef _TEST
+
+#ifdef MOS6502_STATS
+
+static int test_stats_counts(mos6502_t *cpu)
+{
+    // lda #$00, beq +0, bne +0, lda #$FF, tay, ldx $0301,y
+    static const uint8_t program[] = {0xA9, 0x00, 0xF0, 0x00, 0xD0, 0x00, 0xA9, 0xFF, 0xA8, 0xBE, 0x01, 0x03, 0x02};
+    mos6502_test_program(cpu, program, sizeof(program));
+    if (mos6502_stats_enable(cpu))
+    {
+        return 0;
+    }
+
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 100, &cycles);
+    mos6502_stats_t *stats = cpu->stats;
+    uint64_t executed[MOS6502_MODES];
+    uint64_t mode_cycles[MOS6502_MODES];
+    mos6502_stats_modes(stats, executed, mode_cycles);
+
+    int result = reason == MOS6502_STOP_UNKNOWN_OPCODE && cycles == 16 && stats->executed[0xA9] == 2 &&
+                 stats->cycles[0xA9] == 4 && stats->executed[0xBE] == 1 && stats->cycles[0xBE] == 5 &&
+                 stats->executed[0x02] == 0 && stats->branches_taken == 1 && stats->branches_not_taken == 1 &&
+                 stats->branch_page_crosses == 0 && stats->page_crosses == 1 && stats->histogram[2] == 4 &&
+                 stats->histogram[3] == 1 && stats->histogram[5] == 1 && executed[MOS6502_MODE_IMMEDIATE] == 2 &&
+                 executed[MOS6502_MODE_RELATIVE] == 2 && mode_cycles[MOS6502_MODE_RELATIVE] == 5 &&
+                 executed[MOS6502_MODE_IMPLIED] == 1 && executed[MOS6502_MODE_ABSOLUTE_Y] == 1;
+
+    mos6502_stats_reset(cpu);
+    result &= stats->executed[0xA9] == 0 && stats->branches_taken == 0;
+    mos6502_stats_disable(cpu);
+    return result && cpu->stats == NULL;
+}
+
+static int test_stats_bypass_jit(mos6502_t *cpu)
+{
+    // lda #$01, beq +0 (not taken), then from $80F0: lda #$00, beq $80FC, beq $8103
+    static const uint8_t program[] = {0xA9, 0x01, 0xF0, 0x00, 0x02};
+    mos6502_test_program(cpu, program, sizeof(program));
+    mos6502_write8(cpu, 0x80F0, 0xA9);
+    mos6502_write8(cpu, 0x80F1, 0x00);
+    mos6502_write8(cpu, 0x80F2, 0xF0);
+    mos6502_write8(cpu, 0x80F3, 0x08);
+    mos6502_write8(cpu, 0x80FC, 0xF0);
+    mos6502_write8(cpu, 0x80FD, 0x05);
+    mos6502_write8(cpu, 0x8103, 0x02);
+
+    // the jit would run this block natively, the stats core sees it all
+    int jit = mos6502_jit_enable(cpu, 1) == 0;
+    if (mos6502_stats_enable(cpu))
+    {
+        mos6502_jit_disable(cpu);
+        return 0;
+    }
+    mos6502_run(cpu, 100, NULL);
+    cpu->pc = 0x80F0;
+    mos6502_run(cpu, 100, NULL);
+
+    mos6502_stats_t *stats = cpu->stats;
+    int result = stats->executed[0xA9] == 2 && stats->executed[0xF0] == 3 && stats->branches_not_taken == 1 &&
+                 stats->branches_taken == 2 && stats->branch_page_crosses == 1 && cpu->pc == 0x8104;
+
+    FILE *out = tmpfile();
+    if (out)
+    {
+        char line[128] = {0};
+        mos6502_stats_dump(stats, out);
+        rewind(out);
+        result &= fgets(line, sizeof(line), out) && !strcmp(line, "instructions 5 cycles 13\n");
+        fclose(out);
+    }
+
+    if (jit)
+    {
+        mos6502_jit_disable(cpu);
+    }
+    mos6502_stats_disable(cpu);
+    return result;
+}
+
+static int test_stats_poll_loop(mos6502_t *cpu)
+{
+    // loop: lda $10, beq loop
+    static const uint8_t program[] = {0xA5, 0x10, 0xF0, 0xFC};
+    mos6502_test_program(cpu, program, sizeof(program));
+    if (mos6502_stats_enable(cpu))
+    {
+        return 0;
+    }
+
+    // idle loops are not skipped, every iteration is counted
+    uint64_t cycles = 0;
+    int reason = mos6502_run(cpu, 10000, &cycles);
+    mos6502_stats_t *stats = cpu->stats;
+    int result = reason == MOS6502_STOP_BUDGET && cycles == 10002 && stats->executed[0xA5] == 1667 &&
+                 stats->executed[0xF0] == 1667 && stats->cycles[0xF0] == 1667 * 3 && stats->histogram[3] == 1667 * 2 &&
+                 stats->histogram[MOS6502_STATS_MAX_CYCLES] == 0 && stats->branches_taken == 1667;
+    mos6502_stats_disable(cpu);
+    return result;
+}
+
+void test_mos6502_stats()
+{
+    RUN_TEST(test_stats_counts);
+    RUN_TEST(test_stats_poll_loop);
+    RUN_TEST(test_stats_bypass_jit);
+}
+
+#else
+
+static int test_stats_compiled_out(mos6502_t *cpu)
+{
+    return mos6502_stats_enable(cpu) == -1 && cpu->stats == NULL;
+}
+
+void test_mos6502_stats()
+{
+    RUN_TEST(test_stats_compiled_out);
+}
+
+#endif
+#endif
@@ -1,39 +1,4 @@
-#include "mos6502.h"
-
-
-static int sty_zero_page(mos6502_t *cpu)
-{
-    uint8_t zp_address = mos6502_read8(cpu, cpu->pc++);
-    mos6502_write8(cpu, (uint16_t)zp_address, cpu->y);
-    return 3;
-}
-
-static int sty_zeropage_x(mos6502_t *cpu)
-{
-    uint8_t zp_address = (mos6502_read8(cpu, cpu->pc++)) + cpu->x;
-    mos6502_write8(cpu, (uint16_t)zp_address, cpu->y);
-    return 4;
-}
-
-
-static int sty_absolute(mos6502_t *cpu)
-{
-    uint16_t address = mos6502_read16(cpu, cpu->pc);
-    cpu->pc+=2;
-    
-    mos6502_write8(cpu, address, cpu->y);
-
-    return 4;
-}
-
-
-
-void mos6502_register_sty(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0x84, sty_zero_page);
-    mos6502_register_opcode(cpu, 0x94, sty_zeropage_x);
-    mos6502_register_opcode(cpu, 0x8C, sty_absolute);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
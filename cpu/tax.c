@@ -1,16 +1,4 @@
-#include "mos6502.h"
-
-static int tax_transfer(mos6502_t *cpu)
-{
-    cpu->x = cpu->a;
-    return 2;
-}
-
-
-void mos6502_register_tax(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0xAA, tax_transfer);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
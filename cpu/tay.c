@@ -1,16 +1,4 @@
-#include "mos6502.h"
-
-static int tay_transfer(mos6502_t *cpu)
-{
-    cpu->y = cpu->a;
-    return 2;
-}
-
-
-void mos6502_register_tay(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0xA8, tay_transfer);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
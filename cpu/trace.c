@@ -0,0 +1,287 @@
+#include "opcodes.h"
+
+#define MOS6502_TRACE_MAGIC "65TR"
+#define MOS6502_TRACE_VERSION 1
+
+int mos6502_trace_run(mos6502_t *cpu)
+{
+    const mos6502_opcode_t *opcodes = cpu->opcodes;
+
+    while (cpu->cycles < cpu->end)
+    {
+        int reason = mos6502_lines_stop(cpu);
+        if (reason >= 0)
+        {
+            return reason;
+        }
+
+        uint16_t pc = cpu->pc++;
+        uint8_t opcode = mos6502_read8(cpu, pc);
+        mos6502_flags_sync(cpu);
+        mos6502_trace_instruction(cpu, pc, opcode);
+
+        mos6502_opcode_t handler = opcodes[opcode];
+        if (!handler)
+        {
+            if (cpu->trace->fault)
+            {
+                mos6502_trace_dump(cpu, cpu->trace->fault);
+            }
+            return MOS6502_STOP_UNKNOWN_OPCODE;
+        }
+
+        int ticks = handler(cpu);
+        cpu->cycles += ticks;
+        mos6502_stats_instruction(cpu, opcode, ticks);
+    }
+
+    return MOS6502_STOP_BUDGET;
+}
+
+int mos6502_trace_enable(mos6502_t *cpu, int capacity, FILE *fault)
+{
+    uint64_t size = 1;
+    while (size < (uint64_t)capacity)
+    {
+        size <<= 1;
+    }
+
+    mos6502_trace_t *trace = malloc(sizeof(mos6502_trace_t));
+    // zeroed so the reserved bytes of the records stay 0
+    mos6502_trace_record_t *records = calloc(size, sizeof(mos6502_trace_record_t));
+    if (!trace || !records)
+    {
+        free(trace);
+        free(records);
+        return -1;
+    }
+
+    mos6502_trace_disable(cpu);
+    trace->records = records;
+    trace->mask = size - 1;
+    trace->count = 0;
+    trace->fault = fault;
+    cpu->trace = trace;
+    return 0;
+}
+
+void mos6502_trace_disable(mos6502_t *cpu)
+{
+    if (cpu->trace)
+    {
+        free(cpu->trace->records);
+        free(cpu->trace);
+        cpu->trace = NULL;
+    }
+}
+
+int mos6502_trace_read(const mos6502_t *cpu, mos6502_trace_record_t *records, int count)
+{
+    const mos6502_trace_t *trace = cpu->trace;
+    if (!trace || count <= 0)
+    {
+        return 0;
+    }
+
+    uint64_t available = trace->count < trace->mask + 1 ? trace->count : trace->mask + 1;
+    if ((uint64_t)count > available)
+    {
+        count = (int)available;
+    }
+
+    uint64_t first = trace->count - count;
+    for (int i = 0; i < count; i++)
+    {
+        records[i] = trace->records[(first + i) & trace->mask];
+    }
+    return count;
+}
+
+int mos6502_trace_dump(const mos6502_t *cpu, FILE *out)
+{
+    const mos6502_trace_t *trace = cpu->trace;
+    if (!trace)
+    {
+        return -1;
+    }
+
+    uint64_t capacity = trace->mask + 1;
+    uint32_t count = trace->count < capacity ? (uint32_t)trace->count : (uint32_t)capacity;
+    uint8_t header[20];
+    memcpy(header, MOS6502_TRACE_MAGIC, 4);
+    header[4] = MOS6502_TRACE_VERSION;
+    header[5] = sizeof(mos6502_trace_record_t);
+    header[6] = 0;
+    header[7] = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        header[8 + i] = count >> (i * 8);
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        header[12 + i] = cpu->cycles >> (i * 8);
+    }
+    if (fwrite(header, sizeof(header), 1, out) != 1)
+    {
+        return -1;
+    }
+
+    // oldest first: the part of the ring after the newest record, then the start
+    uint64_t first = (trace->count - count) & trace->mask;
+    uint64_t tail = capacity - first < count ? capacity - first : count;
+    if (fwrite(&trace->records[first], sizeof(mos6502_trace_record_t), tail, out) != tail ||
+        fwrite(trace->records, sizeof(mos6502_trace_record_t), count - tail, out) != count - tail)
+    {
+        return -1;
+    }
+    return fflush(out) ? -1 : 0;
+}
+
+void mos6502_trace_print(const mos6502_t *cpu, FILE *out)
+{
+    const mos6502_trace_t *trace = cpu->trace;
+    if (!trace)
+    {
+        return;
+    }
+
+    uint64_t capacity = trace->mask + 1;
+    uint64_t count = trace->count < capacity ? trace->count : capacity;
+    for (uint64_t i = trace->count - count; i < trace->count; i++)
+    {
+        const mos6502_trace_record_t *record = &trace->records[i & trace->mask];
+        int length = mos6502_opcode_length[record->opcode];
+
+        fprintf(out, "%04X  %02X", record->pc, record->opcode);
+        for (int byte = 0; byte < 2; byte++)
+        {
+            if (byte + 1 < length)
+            {
+                fprintf(out, " %02X", record->operand[byte]);
+            }
+            else
+            {
+                fprintf(out, "   ");
+            }
+        }
+        fprintf(out, "  A:%02X X:%02X Y:%02X SP:%02X P:%02X CYC:%u\n", record->a, record->x, record->y, record->sp,
+                record->flags, record->cycles);
+    }
+}
+
+#ifdef _TEST
+
+// lda #$01, ldx #$02, and #$03, tax, sec, nop, then an unknown opcode
+static const uint8_t test_trace_program[] = {0xA9, 0x01, 0xA2, 0x02, 0x29, 0x03, 0xAA, 0x38, 0xEA, 0x02};
+
+static void test_trace_load(mos6502_t *cpu)
+{
+    mos6502_test_program(cpu, test_trace_program, sizeof(test_trace_program));
+}
+
+static int test_trace_ring(mos6502_t *cpu)
+{
+    mos6502_trace_record_t records[8];
+    test_trace_load(cpu);
+    if (mos6502_trace_enable(cpu, 3, NULL))
+    {
+        return 0;
+    }
+
+    // the capacity is rounded up to 4, so the last 4 of 6 instructions remain
+    int reason = mos6502_run(cpu, 100, NULL);
+    int count = mos6502_trace_read(cpu, records, 8);
+    int result = reason == MOS6502_STOP_UNKNOWN_OPCODE && cpu->trace->mask == 3 && cpu->trace->count == 7 &&
+                 count == 4 && records[0].pc == 0x8006 && records[0].opcode == 0xAA && records[0].a == 0x01 &&
+                 records[0].x == 0x02 && records[0].cycles == 6 && records[1].opcode == 0x38 &&
+                 records[1].x == 0x01 && records[2].flags == CARRY && records[3].pc == 0x8009 &&
+                 records[3].opcode == 0x02;
+
+    // fewer than asked for: the newest ones
+    result &= mos6502_trace_read(cpu, records, 2) == 2 && records[0].opcode == 0xEA && records[1].opcode == 0x02;
+    mos6502_trace_disable(cpu);
+    return result && cpu->trace == NULL;
+}
+
+static int test_trace_tick_fault(mos6502_t *cpu)
+{
+    test_trace_load(cpu);
+    FILE *fault = tmpfile();
+    if (!fault || mos6502_trace_enable(cpu, 16, fault))
+    {
+        if (fault)
+        {
+            fclose(fault);
+        }
+        return 0;
+    }
+
+    int ticks = 0;
+    while (ticks >= 0)
+    {
+        ticks = mos6502_tick(cpu);
+    }
+
+    // the unknown opcode dumped the trace on its own
+    uint8_t header[20];
+    mos6502_trace_record_t records[7];
+    rewind(fault);
+    int result = fread(header, sizeof(header), 1, fault) == 1 && !memcmp(header, "65TR", 4) && header[4] == 1 &&
+                 header[5] == sizeof(mos6502_trace_record_t) && header[8] == 7 && header[9] == 0 &&
+                 header[12] == 12 && fread(records, sizeof(records[0]), 7, fault) == 7 &&
+                 fgetc(fault) == EOF && records[0].pc == 0x8000 && records[0].operand[0] == 0x01 &&
+                 records[1].opcode == 0xA2 && records[1].a == 0x01 && records[4].flags == 0 &&
+                 records[5].flags == CARRY && records[6].opcode == 0x02;
+
+    fclose(fault);
+    mos6502_trace_disable(cpu);
+    return result;
+}
+
+static int test_trace_dump_wrapped(mos6502_t *cpu)
+{
+    test_trace_load(cpu);
+    FILE *out = tmpfile();
+    if (!out || mos6502_trace_enable(cpu, 4, NULL))
+    {
+        if (out)
+        {
+            fclose(out);
+        }
+        return 0;
+    }
+
+    // jit or not, the traced run sees every instruction
+    int jit = mos6502_jit_enable(cpu, 1) == 0;
+    mos6502_run(cpu, 100, NULL);
+
+    uint8_t header[20];
+    mos6502_trace_record_t records[4];
+    int result = mos6502_trace_dump(cpu, out) == 0;
+    rewind(out);
+    result &= fread(header, sizeof(header), 1, out) == 1 && header[8] == 4 &&
+              fread(records, sizeof(records[0]), 4, out) == 4 && records[0].pc == 0x8006 &&
+              records[3].pc == 0x8009;
+
+    char line[80] = {0};
+    rewind(out);
+    mos6502_trace_print(cpu, out);
+    rewind(out);
+    result &= fgets(line, sizeof(line), out) && !strcmp(line, "8006  AA        A:01 X:02 Y:00 SP:00 P:00 CYC:6\n");
+
+    fclose(out);
+    if (jit)
+    {
+        mos6502_jit_disable(cpu);
+    }
+    mos6502_trace_disable(cpu);
+    return result;
+}
+
+void test_mos6502_trace()
+{
+    RUN_TEST(test_trace_ring);
+    RUN_TEST(test_trace_tick_fault);
+    RUN_TEST(test_trace_dump_wrapped);
+}
+#endif
@@ -1,15 +1,4 @@
-#include "mos6502.h"
-
-static int txa(mos6502_t *cpu)
-{
-    cpu->a = cpu->x;
-    return 2;
-}
-
-void mos6502_register_txa(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0x8A, txa);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
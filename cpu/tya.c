@@ -1,15 +1,4 @@
-#include "mos6502.h"
-
-static int tya(mos6502_t *cpu)
-{
-    cpu->a = cpu->y;
-    return 2;
-}
-
-void mos6502_register_tya(mos6502_t *cpu)
-{
-    mos6502_register_opcode(cpu, 0x98, tya);
-}
+#include "opcodes.h"
 
 #ifdef _TEST
 
@@ -0,0 +1,218 @@
+#include "cpu/mos6502.h"
+
+#include <time.h>
+
+// Klaus Dormann's 6502_functional_test.bin: a 64K image loaded at $0000,
+// started at $0400, that ends in a branch or jump to itself. the trap at
+// $3469 means every test passed, any other trap marks the failing test
+#define FUNCTIONAL_LOAD 0x0000
+#define FUNCTIONAL_START 0x0400
+#define FUNCTIONAL_SUCCESS 0x3469
+
+// cycles per mos6502_run between trap checks, the reported cycles can overshoot
+// the trap by up to this much
+#define FUNCTIONAL_BATCH 10000
+#define FUNCTIONAL_MAX_CYCLES 1000000000ULL
+
+#define FUNCTIONAL_CORES 3
+
+typedef struct functional_options
+{
+    const char *path;
+    uint16_t load;
+    uint16_t start;
+    uint16_t success;
+    uint64_t max_cycles;
+    int core;
+} functional_options_t;
+
+static const char *functional_core_names[FUNCTIONAL_CORES] = {"interp", "predecode", "jit"};
+
+static uint8_t functional_memory[65536];
+static mos6502_page_map_t functional_pages;
+
+static uint8_t functional_read(mos6502_t *cpu, uint16_t address)
+{
+    return functional_memory[address];
+}
+
+static void functional_write(mos6502_t *cpu, uint16_t address, uint8_t value)
+{
+    functional_memory[address] = value;
+}
+
+static double functional_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void functional_usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s FILE [--load ADDR] [--start ADDR] [--success ADDR] [--max-cycles N] "
+            "[--core interp|predecode|jit]\n",
+            name);
+}
+
+static int functional_parse(functional_options_t *options, int argc, char **argv)
+{
+    options->path = NULL;
+    options->load = FUNCTIONAL_LOAD;
+    options->start = FUNCTIONAL_START;
+    options->success = FUNCTIONAL_SUCCESS;
+    options->max_cycles = FUNCTIONAL_MAX_CYCLES;
+    options->core = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--load") && i + 1 < argc)
+        {
+            options->load = strtoul(argv[++i], NULL, 0);
+        }
+        else if (!strcmp(argv[i], "--start") && i + 1 < argc)
+        {
+            options->start = strtoul(argv[++i], NULL, 0);
+        }
+        else if (!strcmp(argv[i], "--success") && i + 1 < argc)
+        {
+            options->success = strtoul(argv[++i], NULL, 0);
+        }
+        else if (!strcmp(argv[i], "--max-cycles") && i + 1 < argc && strtoull(argv[i + 1], NULL, 0) > 0)
+        {
+            options->max_cycles = strtoull(argv[++i], NULL, 0);
+        }
+        else if (!strcmp(argv[i], "--core") && i + 1 < argc)
+        {
+            i++;
+            int core = 0;
+            while (core < FUNCTIONAL_CORES && strcmp(argv[i], functional_core_names[core]))
+            {
+                core++;
+            }
+            if (core == FUNCTIONAL_CORES)
+            {
+                return -1;
+            }
+            options->core = core;
+        }
+        else if (argv[i][0] != '-' && !options->path)
+        {
+            options->path = argv[i];
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return options->path ? 0 : -1;
+}
+
+static int functional_load(const functional_options_t *options)
+{
+    FILE *file = fopen(options->path, "rb");
+    if (!file)
+    {
+        perror(options->path);
+        return -1;
+    }
+
+    size_t size = fread(&functional_memory[options->load], 1, sizeof(functional_memory) - options->load, file);
+    int error = ferror(file);
+    fclose(file);
+    if (error || size == 0)
+    {
+        fprintf(stderr, "%s: nothing loaded\n", options->path);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    functional_options_t options;
+    if (functional_parse(&options, argc, argv))
+    {
+        functional_usage(argv[0]);
+        return 2;
+    }
+    if (functional_load(&options))
+    {
+        return 1;
+    }
+
+    mos6502_map_init(&functional_pages);
+    mos6502_map_pages(&functional_pages, 0x00, 256, functional_memory, 0);
+
+    mos6502_t cpu;
+    mos6502_init(&cpu);
+    cpu.read = functional_read;
+    cpu.write = functional_write;
+    cpu.pages = &functional_pages;
+    cpu.rst = 0;
+    cpu.pc = options.start;
+    if ((options.core == 1 && mos6502_predecode_enable(&cpu)) || (options.core == 2 && mos6502_jit_enable(&cpu, 1)))
+    {
+        fprintf(stderr, "the %s core is not available\n", functional_core_names[options.core]);
+        return 1;
+    }
+
+    // batches of the run loop; after each, one more instruction that leaves pc
+    // where it was is the trap
+    int reason = MOS6502_STOP_BUDGET;
+    int trapped = 0;
+    double start = functional_now();
+    while (cpu.cycles < options.max_cycles)
+    {
+        reason = mos6502_run(&cpu, FUNCTIONAL_BATCH, NULL);
+        if (reason != MOS6502_STOP_BUDGET)
+        {
+            break;
+        }
+
+        uint16_t pc = cpu.pc;
+        if (mos6502_tick(&cpu) < 0)
+        {
+            reason = MOS6502_STOP_UNKNOWN_OPCODE;
+            break;
+        }
+        if (cpu.pc == pc)
+        {
+            trapped = 1;
+            break;
+        }
+    }
+    double elapsed = functional_now() - start;
+
+    mos6502_jit_disable(&cpu);
+    mos6502_predecode_disable(&cpu);
+
+    printf("core %s: %llu cycles in %.3f s, %.1f MHz\n", functional_core_names[options.core],
+           (unsigned long long)cpu.cycles, elapsed, cpu.cycles / elapsed / 1e6);
+    if (trapped && cpu.pc == options.success)
+    {
+        printf("PASS: success trap at $%04X\n", cpu.pc);
+        return 0;
+    }
+
+    if (trapped)
+    {
+        printf("FAIL: trapped at $%04X", cpu.pc);
+    }
+    else if (reason == MOS6502_STOP_UNKNOWN_OPCODE)
+    {
+        printf("FAIL: unknown opcode $%02X at $%04X", functional_memory[(uint16_t)(cpu.pc - 1)],
+               (uint16_t)(cpu.pc - 1));
+    }
+    else if (reason != MOS6502_STOP_BUDGET)
+    {
+        printf("FAIL: stopped (reason %d) at $%04X", reason, cpu.pc);
+    }
+    else
+    {
+        printf("FAIL: no trap within %llu cycles, at $%04X", (unsigned long long)options.max_cycles, cpu.pc);
+    }
+    printf(" A:%02X X:%02X Y:%02X SP:%02X P:%02X\n", cpu.a, cpu.x, cpu.y, cpu.sp, cpu.flags);
+    return 1;
+}
\ No newline at end of file
@@ -1,8 +1,14 @@
 #include "cpu/mos6502.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
 typedef struct mos6502_test
 {
     mos6502_t base;
+    mos6502_page_map_t pages;
     uint8_t memory[65536];
 } mos6502_test_t;
 
@@ -18,50 +24,232 @@ void mos6502_test_write(mos6502_t *cpu, uint16_t address, uint8_t value)
     cpu_test->memory[address] = value;
 }
 
-static uint64_t tests_succeded = 0;
-static uint64_t tests_failed = 0;
+#define MOS6502_TESTS_MAX 4096
+#define MOS6502_TEST_THREADS_MAX 64
 
-void mos6502_test_wrapper(const char *name, int (*func)(mos6502_t *cpu))
+typedef struct mos6502_test_case
 {
-    mos6502_test_t cpu;
-    mos6502_init((mos6502_t *)&cpu);
+    const char *name;
+    int (*func)(mos6502_t *cpu);
+    int passed;
+    uint64_t ns;
+} mos6502_test_case_t;
 
-    cpu.base.read = mos6502_test_read;
-    cpu.base.write = mos6502_test_write;
+// RUN_TEST only registers, the tests run once all the suites are listed
+static mos6502_test_case_t tests[MOS6502_TESTS_MAX];
+static int tests_count = 0;
 
-    memset(cpu.memory, 0, 65536);
+// the tests of a suite share its statics, so a suite runs on one thread in
+// order. its tests are suites_first[suite] up to suites_first[suite + 1]
+static int suites_first[MOS6502_TESTS_MAX + 1];
+static int suites_count = 0;
+static atomic_int suites_next;
 
-    mos6502_write16((mos6502_t *)&cpu, 0xfffc, 0x8000);
+// one instance per thread, reset between tests instead of built from scratch
+static mos6502_test_t instances[MOS6502_TEST_THREADS_MAX];
+static mos6502_t cpu_template;
 
-    if (!func((mos6502_t *)&cpu))
+void mos6502_test_wrapper(const char *name, int (*func)(mos6502_t *cpu))
+{
+    if (tests_count == MOS6502_TESTS_MAX)
     {
-        fprintf(stderr, "TEST %s FAILED\n", name);
-        tests_failed++;
+        fprintf(stderr, "TEST %s not run, more than %d tests\n", name, MOS6502_TESTS_MAX);
+        return;
     }
-    else
+
+    tests[tests_count].name = name;
+    tests[tests_count].func = func;
+    tests_count++;
+}
+
+// what every test starts from: a new cpu, all of memory mapped and zeroed and
+// the reset vector at $8000. memory is zeroed once, after that only the pages a
+// test left non zero are cleared
+static void mos6502_test_reset(mos6502_test_t *cpu)
+{
+    cpu->base = cpu_template;
+    cpu->base.read = mos6502_test_read;
+    cpu->base.write = mos6502_test_write;
+
+    for (int page = 0; page < 256; page++)
     {
-        tests_succeded++;
+        const uint64_t *words = (const uint64_t *)&cpu->memory[page * 256];
+        uint64_t bits = 0;
+        for (int i = 0; i < 256 / 8; i++)
+        {
+            bits |= words[i];
+        }
+        if (bits)
+        {
+            memset(&cpu->memory[page * 256], 0, 256);
+        }
     }
+
+    mos6502_map_init(&cpu->pages);
+    mos6502_map_pages(&cpu->pages, 0x00, 256, cpu->memory, 0);
+    cpu->base.pages = &cpu->pages;
+
+    mos6502_write16((mos6502_t *)cpu, 0xfffc, 0x8000);
 }
 
+static uint64_t mos6502_test_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void *mos6502_test_worker(void *arg)
+{
+    mos6502_test_t *cpu = arg;
+
+    for (;;)
+    {
+        int suite = atomic_fetch_add(&suites_next, 1);
+        if (suite >= suites_count)
+        {
+            return NULL;
+        }
+
+        for (int i = suites_first[suite]; i < suites_first[suite + 1]; i++)
+        {
+            mos6502_test_reset(cpu);
+            uint64_t start = mos6502_test_now();
+            tests[i].passed = tests[i].func((mos6502_t *)cpu) != 0;
+            tests[i].ns = mos6502_test_now() - start;
+        }
+    }
+}
+
+static void (*const suites[])(void) = {
+    test_mos6502_core,
+    test_mos6502_memory,
+    test_mos6502_jit,
+    test_mos6502_predecode,
+    test_mos6502_lanes,
+    test_mos6502_pool,
+    test_mos6502_cow,
+    test_mos6502_snapshot,
+    test_mos6502_stats,
+    test_mos6502_trace,
+    test_mos6502_debug,
+    test_mos6502_idle,
+    test_mos6502_events,
+    test_mos6502_replay,
+    test_mos6502_opcodes,
+    test_mos6502_decimal,
+    test_mos6502_lda,
+    test_mos6502_sta,
+    test_mos6502_stx,
+    test_mos6502_sty,
+    test_mos6502_ldx,
+    test_mos6502_and,
+    test_mos6502_ora,
+    test_mos6502_asl,
+    test_mos6502_lsr,
+    test_mos6502_nop,
+    test_mos6502_clc,
+    test_mos6502_cld,
+    test_mos6502_clv,
+    test_mos6502_sec,
+    test_mos6502_sed,
+    test_mos6502_dex,
+    test_mos6502_dey,
+    test_mos6502_tax,
+    test_mos6502_tay,
+    test_mos6502_txa,
+    test_mos6502_tya,
+    test_mos6502_bpl,
+    test_mos6502_bmi,
+    test_mos6502_bvc,
+    test_mos6502_bvs,
+    test_mos6502_bcc,
+    test_mos6502_bcs,
+    test_mos6502_bne,
+    test_mos6502_beq,
+};
+
+// tests [-j threads] [--timing]: the suites are shared out between the threads
+// (one per cpu by default), --timing lists how long each test took
 int main(int argc, char **argv)
 {
-    test_mos6502_core();
-    test_mos6502_lda();
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int timing = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        {
+            threads = strtol(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], "--timing"))
+        {
+            timing = 1;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-j threads] [--timing]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (threads < 1)
+    {
+        threads = 1;
+    }
 
-    test_mos6502_stx();
+    for (int suite = 0; suite < (int)(sizeof(suites) / sizeof(suites[0])); suite++)
+    {
+        suites_first[suites_count++] = tests_count;
+        suites[suite]();
+    }
+    suites_first[suites_count] = tests_count;
+    if (threads > suites_count)
+    {
+        threads = suites_count;
+    }
+    if (threads > MOS6502_TEST_THREADS_MAX)
+    {
+        threads = MOS6502_TEST_THREADS_MAX;
+    }
 
-    test_mos6502_ldx();
-    test_mos6502_and();
-    test_mos6502_nop();
-    test_mos6502_clc();
-    test_mos6502_cld();
-    test_mos6502_tay();
-    test_mos6502_lsr();
-    test_mos6502_sec();
-    test_mos6502_sed();
+    mos6502_init(&cpu_template);
 
+    // the calling thread is the first worker
+    pthread_t workers[MOS6502_TEST_THREADS_MAX];
+    uint64_t start = mos6502_test_now();
+    int started = 1;
+    while (started < threads &&
+           pthread_create(&workers[started], NULL, mos6502_test_worker, &instances[started]) == 0)
+    {
+        started++;
+    }
+    mos6502_test_worker(&instances[0]);
+    for (int i = 1; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    uint64_t elapsed = mos6502_test_now() - start;
+
+    uint64_t tests_succeded = 0;
+    uint64_t tests_failed = 0;
+    for (int i = 0; i < tests_count; i++)
+    {
+        if (!tests[i].passed)
+        {
+            fprintf(stderr, "TEST %s FAILED\n", tests[i].name);
+            tests_failed++;
+        }
+        else
+        {
+            tests_succeded++;
+        }
+        if (timing)
+        {
+            fprintf(stdout, "%10.3f ms  %s\n", tests[i].ns / 1e6, tests[i].name);
+        }
+    }
 
-    fprintf(stdout, "Tests succeded: %llu failed: %llu\n", tests_succeded, tests_failed);
-    return 0;
+    fprintf(stdout, "Tests succeded: %llu failed: %llu\n", (unsigned long long)tests_succeded,
+            (unsigned long long)tests_failed);
+    fprintf(stdout, "%d tests on %d threads in %.3f ms\n", tests_count, started, elapsed / 1e6);
+    return tests_failed ? 1 : 0;
 }
\ No newline at end of file
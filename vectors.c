@@ -0,0 +1,692 @@
+#include "cpu/mos6502.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// single-step test vectors (one JSON file per opcode, an array of cases):
+//   {"name": "a9 3f 2c", "initial": {"pc": 1234, "s": 253, "a": 0, "x": 0,
+//    "y": 0, "p": 36, "ram": [[1234, 169], [1235, 63]]}, "final": {...},
+//    "cycles": [[1234, 169, "read"], [1235, 63, "read"]]}
+// every case runs one mos6502_tick, the registers and every ram entry of final
+// are compared, and the tick must take as many cycles as cycles has entries
+
+#define VECTORS_MAX_FILES 1024
+#define VECTORS_MAX_CHUNKS 65536
+#define VECTORS_MAX_THREADS 64
+
+// files are cut into chunks of about this size, the unit the threads share
+#define VECTORS_CHUNK (256 * 1024)
+
+typedef struct vectors_file
+{
+    char path[512];
+    const char *data;
+    size_t size;
+} vectors_file_t;
+
+typedef struct vectors_chunk
+{
+    int file;
+    size_t begin;
+    size_t end;
+
+    uint64_t passed;
+    uint64_t failed;
+    // cases of opcodes without a handler
+    uint64_t skipped;
+    // the first failure: its case name and what differed
+    const char *name;
+    size_t name_length;
+    const char *reason;
+} vectors_chunk_t;
+
+typedef struct vectors_state
+{
+    uint16_t pc;
+    uint8_t s;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t p;
+    // the ram array, walked again when it is applied or compared
+    const char *ram;
+} vectors_state_t;
+
+typedef struct vectors_case
+{
+    const char *name;
+    size_t name_length;
+    vectors_state_t initial;
+    vectors_state_t final;
+    int cycles;
+} vectors_case_t;
+
+// a position in the mapped file, parse errors only set failed
+typedef struct vectors_cursor
+{
+    const char *p;
+    const char *end;
+    int failed;
+} vectors_cursor_t;
+
+typedef struct vectors_worker
+{
+    mos6502_t cpu;
+    mos6502_page_map_t pages;
+    uint8_t memory[65536];
+} vectors_worker_t;
+
+static vectors_file_t vectors_files[VECTORS_MAX_FILES];
+static int vectors_file_count = 0;
+static vectors_chunk_t vectors_chunks[VECTORS_MAX_CHUNKS];
+static int vectors_chunk_count = 0;
+static atomic_int vectors_next;
+static vectors_worker_t vectors_workers[VECTORS_MAX_THREADS];
+
+static double vectors_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void vectors_space(vectors_cursor_t *c)
+{
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\n' || *c->p == '\r' || *c->p == '\t'))
+    {
+        c->p++;
+    }
+}
+
+// the next character after white space, 0 at the end
+static char vectors_peek(vectors_cursor_t *c)
+{
+    vectors_space(c);
+    return c->p < c->end ? *c->p : 0;
+}
+
+static int vectors_accept(vectors_cursor_t *c, char expected)
+{
+    if (vectors_peek(c) == expected)
+    {
+        c->p++;
+        return 1;
+    }
+    return 0;
+}
+
+static void vectors_expect(vectors_cursor_t *c, char expected)
+{
+    if (!vectors_accept(c, expected))
+    {
+        c->failed = 1;
+        c->p = c->end;
+    }
+}
+
+static uint64_t vectors_number(vectors_cursor_t *c)
+{
+    uint64_t value = 0;
+    vectors_space(c);
+    if (c->p == c->end || *c->p < '0' || *c->p > '9')
+    {
+        c->failed = 1;
+        c->p = c->end;
+        return 0;
+    }
+    while (c->p < c->end && *c->p >= '0' && *c->p <= '9')
+    {
+        value = value * 10 + (*c->p++ - '0');
+    }
+    return value;
+}
+
+// a string without unescaping, the corpus names have no escapes
+static void vectors_string(vectors_cursor_t *c, const char **string, size_t *length)
+{
+    vectors_expect(c, '"');
+    const char *start = c->p;
+    while (c->p < c->end && *c->p != '"')
+    {
+        c->p += *c->p == '\\' ? 2 : 1;
+    }
+    if (c->p >= c->end)
+    {
+        c->failed = 1;
+        c->p = c->end;
+        return;
+    }
+    *string = start;
+    *length = c->p++ - start;
+}
+
+// any value, for the keys the runner does not use
+static void vectors_skip(vectors_cursor_t *c)
+{
+    const char *string;
+    size_t length;
+    char next = vectors_peek(c);
+    if (next == '"')
+    {
+        vectors_string(c, &string, &length);
+    }
+    else if (next == '[' || next == '{')
+    {
+        char close = next == '[' ? ']' : '}';
+        c->p++;
+        if (vectors_accept(c, close))
+        {
+            return;
+        }
+        do
+        {
+            if (close == '}')
+            {
+                vectors_string(c, &string, &length);
+                vectors_expect(c, ':');
+            }
+            vectors_skip(c);
+        } while (!c->failed && vectors_accept(c, ','));
+        vectors_expect(c, close);
+    }
+    else
+    {
+        while (c->p < c->end && *c->p != ',' && *c->p != ']' && *c->p != '}')
+        {
+            c->p++;
+        }
+    }
+}
+
+static void vectors_parse_state(vectors_cursor_t *c, vectors_state_t *state)
+{
+    vectors_expect(c, '{');
+    if (vectors_accept(c, '}'))
+    {
+        return;
+    }
+    do
+    {
+        const char *key = NULL;
+        size_t length = 0;
+        vectors_string(c, &key, &length);
+        vectors_expect(c, ':');
+        if (length == 2 && !memcmp(key, "pc", 2))
+        {
+            state->pc = vectors_number(c);
+        }
+        else if (length == 1 && strchr("saxyp", key[0]))
+        {
+            uint8_t value = vectors_number(c);
+            switch (key[0])
+            {
+            case 's': state->s = value; break;
+            case 'a': state->a = value; break;
+            case 'x': state->x = value; break;
+            case 'y': state->y = value; break;
+            case 'p': state->p = value; break;
+            }
+        }
+        else if (length == 3 && !memcmp(key, "ram", 3))
+        {
+            state->ram = c->p;
+            vectors_skip(c);
+        }
+        else
+        {
+            vectors_skip(c);
+        }
+    } while (!c->failed && vectors_accept(c, ','));
+    vectors_expect(c, '}');
+}
+
+// the number of entries of an array, skipping them
+static int vectors_count(vectors_cursor_t *c)
+{
+    int count = 0;
+    vectors_expect(c, '[');
+    if (vectors_accept(c, ']'))
+    {
+        return 0;
+    }
+    do
+    {
+        vectors_skip(c);
+        count++;
+    } while (!c->failed && vectors_accept(c, ','));
+    vectors_expect(c, ']');
+    return count;
+}
+
+static void vectors_parse_case(vectors_cursor_t *c, vectors_case_t *test)
+{
+    memset(test, 0, sizeof(*test));
+    vectors_expect(c, '{');
+    do
+    {
+        const char *key = NULL;
+        size_t length = 0;
+        vectors_string(c, &key, &length);
+        vectors_expect(c, ':');
+        if (length == 4 && !memcmp(key, "name", 4))
+        {
+            vectors_string(c, &test->name, &test->name_length);
+        }
+        else if (length == 7 && !memcmp(key, "initial", 7))
+        {
+            vectors_parse_state(c, &test->initial);
+        }
+        else if (length == 5 && !memcmp(key, "final", 5))
+        {
+            vectors_parse_state(c, &test->final);
+        }
+        else if (length == 6 && !memcmp(key, "cycles", 6))
+        {
+            test->cycles = vectors_count(c);
+        }
+        else
+        {
+            vectors_skip(c);
+        }
+    } while (!c->failed && vectors_accept(c, ','));
+    vectors_expect(c, '}');
+}
+
+// walk the [[address, value], ...] pairs of ram: write them (mode 0), compare
+// them (mode 1, returns 0 on the first difference) or zero their addresses
+// (mode 2). returns 0 if ram does not parse
+static int vectors_ram(vectors_worker_t *worker, const char *ram, const char *end, int mode)
+{
+    if (!ram)
+    {
+        return 1;
+    }
+
+    vectors_cursor_t c = {ram, end, 0};
+    vectors_expect(&c, '[');
+    if (vectors_accept(&c, ']'))
+    {
+        return 1;
+    }
+    do
+    {
+        vectors_expect(&c, '[');
+        uint16_t address = vectors_number(&c);
+        vectors_expect(&c, ',');
+        uint8_t value = vectors_number(&c);
+        vectors_expect(&c, ']');
+        if (c.failed)
+        {
+            return 0;
+        }
+
+        switch (mode)
+        {
+        case 0:
+            worker->memory[address] = value;
+            break;
+        case 1:
+            if (worker->memory[address] != value)
+            {
+                return 0;
+            }
+            break;
+        default:
+            worker->memory[address] = 0;
+            break;
+        }
+    } while (vectors_accept(&c, ','));
+    return !c.failed;
+}
+
+// run one case, NULL if it passed, otherwise what differed ("" for skipped)
+static const char *vectors_run_case(vectors_worker_t *worker, const vectors_case_t *test, const char *end)
+{
+    mos6502_t *cpu = &worker->cpu;
+    const vectors_state_t *initial = &test->initial;
+    const vectors_state_t *final = &test->final;
+
+    if (!vectors_ram(worker, initial->ram, end, 0))
+    {
+        return "bad initial ram";
+    }
+
+    mos6502_init(cpu);
+    cpu->pages = &worker->pages;
+    cpu->rst = 0;
+    cpu->pc = initial->pc;
+    cpu->sp = initial->s;
+    cpu->a = initial->a;
+    cpu->x = initial->x;
+    cpu->y = initial->y;
+    // bits 4 and 5 only exist on the stack, the core keeps them clear
+    cpu->flags = initial->p & ~0x30;
+
+    const char *reason = NULL;
+    int ticks = mos6502_tick(cpu);
+    if (ticks < 0)
+    {
+        reason = "";
+    }
+    else if (cpu->pc != final->pc)
+    {
+        reason = "pc";
+    }
+    else if (cpu->sp != final->s)
+    {
+        reason = "s";
+    }
+    else if (cpu->a != final->a)
+    {
+        reason = "a";
+    }
+    else if (cpu->x != final->x)
+    {
+        reason = "x";
+    }
+    else if (cpu->y != final->y)
+    {
+        reason = "y";
+    }
+    else if ((cpu->flags ^ final->p) & ~0x30)
+    {
+        reason = "p";
+    }
+    else if (!vectors_ram(worker, final->ram, end, 1))
+    {
+        reason = "ram";
+    }
+    else if (ticks != test->cycles)
+    {
+        reason = "cycles";
+    }
+
+    // only the listed addresses were set, the instruction under test may only
+    // write listed ones too
+    vectors_ram(worker, initial->ram, end, 2);
+    vectors_ram(worker, final->ram, end, 2);
+    return reason;
+}
+
+// a case starts with {"name", the start of the next one at or after p
+static const char *vectors_sync(const char *p, const char *end)
+{
+    for (; p < end; p++)
+    {
+        if (*p != '{')
+        {
+            continue;
+        }
+        const char *q = p + 1;
+        while (q < end && (*q == ' ' || *q == '\n' || *q == '\r' || *q == '\t'))
+        {
+            q++;
+        }
+        if (end - q >= 6 && !memcmp(q, "\"name\"", 6))
+        {
+            return p;
+        }
+    }
+    return end;
+}
+
+static void vectors_run_chunk(vectors_worker_t *worker, vectors_chunk_t *chunk)
+{
+    const vectors_file_t *file = &vectors_files[chunk->file];
+    const char *end = file->data + file->size;
+    const char *stop = file->data + chunk->end;
+
+    // the cases starting in [begin, end) belong to this chunk
+    const char *p = vectors_sync(file->data + chunk->begin, end);
+    while (p < stop)
+    {
+        vectors_cursor_t c = {p, end, 0};
+        vectors_case_t test;
+        vectors_parse_case(&c, &test);
+        if (c.failed)
+        {
+            chunk->failed++;
+            if (!chunk->reason)
+            {
+                chunk->name = p;
+                chunk->name_length = 0;
+                chunk->reason = "parse error";
+            }
+            return;
+        }
+
+        const char *reason = vectors_run_case(worker, &test, end);
+        if (!reason)
+        {
+            chunk->passed++;
+        }
+        else if (!*reason)
+        {
+            chunk->skipped++;
+        }
+        else
+        {
+            chunk->failed++;
+            if (!chunk->reason)
+            {
+                chunk->name = test.name;
+                chunk->name_length = test.name_length;
+                chunk->reason = reason;
+            }
+        }
+        p = vectors_sync(c.p, end);
+    }
+}
+
+static void *vectors_thread(void *arg)
+{
+    vectors_worker_t *worker = arg;
+    memset(worker->memory, 0, sizeof(worker->memory));
+    mos6502_map_init(&worker->pages);
+    mos6502_map_pages(&worker->pages, 0x00, 256, worker->memory, 0);
+
+    for (;;)
+    {
+        int chunk = atomic_fetch_add(&vectors_next, 1);
+        if (chunk >= vectors_chunk_count)
+        {
+            return NULL;
+        }
+        vectors_run_chunk(worker, &vectors_chunks[chunk]);
+    }
+}
+
+static int vectors_add_file(const char *path)
+{
+    if (vectors_file_count == VECTORS_MAX_FILES)
+    {
+        fprintf(stderr, "%s: more than %d files\n", path, VECTORS_MAX_FILES);
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st))
+    {
+        perror(path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror(path);
+        return -1;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    vectors_file_t *file = &vectors_files[vectors_file_count];
+    snprintf(file->path, sizeof(file->path), "%s", path);
+    file->data = data;
+    file->size = st.st_size;
+
+    for (size_t begin = 0; begin < file->size; begin += VECTORS_CHUNK)
+    {
+        if (vectors_chunk_count == VECTORS_MAX_CHUNKS)
+        {
+            fprintf(stderr, "%s: more than %d chunks\n", path, VECTORS_MAX_CHUNKS);
+            return -1;
+        }
+        vectors_chunk_t *chunk = &vectors_chunks[vectors_chunk_count++];
+        memset(chunk, 0, sizeof(*chunk));
+        chunk->file = vectors_file_count;
+        chunk->begin = begin;
+        chunk->end = begin + VECTORS_CHUNK < file->size ? begin + VECTORS_CHUNK : file->size;
+    }
+    vectors_file_count++;
+    return 0;
+}
+
+static int vectors_compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// every .json file of a directory, in name order
+static int vectors_add_directory(const char *path, DIR *dir)
+{
+    // only used for sorting, vectors_add_file copies the paths
+    static char names[VECTORS_MAX_FILES][512];
+    char *sorted[VECTORS_MAX_FILES];
+    int count = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)))
+    {
+        size_t length = strlen(entry->d_name);
+        if (length < 5 || strcmp(entry->d_name + length - 5, ".json"))
+        {
+            continue;
+        }
+        if (count == VECTORS_MAX_FILES - vectors_file_count)
+        {
+            fprintf(stderr, "%s: more than %d files\n", path, VECTORS_MAX_FILES);
+            closedir(dir);
+            return -1;
+        }
+        snprintf(names[count], sizeof(names[count]), "%s/%s", path, entry->d_name);
+        sorted[count] = names[count];
+        count++;
+    }
+    closedir(dir);
+
+    qsort(sorted, count, sizeof(sorted[0]), vectors_compare_names);
+    for (int i = 0; i < count; i++)
+    {
+        if (vectors_add_file(sorted[i]))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void vectors_usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-j threads] FILE.json|DIRECTORY...\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int paths = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        {
+            threads = strtol(argv[++i], NULL, 10);
+            continue;
+        }
+        if (argv[i][0] == '-')
+        {
+            vectors_usage(argv[0]);
+            return 2;
+        }
+
+        DIR *dir = opendir(argv[i]);
+        if (dir ? vectors_add_directory(argv[i], dir) : vectors_add_file(argv[i]))
+        {
+            return 1;
+        }
+        paths++;
+    }
+    if (!paths)
+    {
+        vectors_usage(argv[0]);
+        return 2;
+    }
+    threads = threads < 1 ? 1 : threads > VECTORS_MAX_THREADS ? VECTORS_MAX_THREADS : threads;
+
+    // the calling thread is the first worker
+    pthread_t workers[VECTORS_MAX_THREADS];
+    double start = vectors_now();
+    int started = 1;
+    while (started < threads && pthread_create(&workers[started], NULL, vectors_thread, &vectors_workers[started]) == 0)
+    {
+        started++;
+    }
+    vectors_thread(&vectors_workers[0]);
+    for (int i = 1; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    double elapsed = vectors_now() - start;
+
+    // chunks are in file order, the first failure of a file is its first
+    uint64_t passed = 0, failed = 0, skipped = 0;
+    int chunk = 0;
+    for (int i = 0; i < vectors_file_count; i++)
+    {
+        uint64_t file_passed = 0, file_failed = 0, file_skipped = 0;
+        const vectors_chunk_t *first = NULL;
+        for (; chunk < vectors_chunk_count && vectors_chunks[chunk].file == i; chunk++)
+        {
+            const vectors_chunk_t *current = &vectors_chunks[chunk];
+            file_passed += current->passed;
+            file_failed += current->failed;
+            file_skipped += current->skipped;
+            if (!first && current->reason)
+            {
+                first = current;
+            }
+        }
+
+        printf("%s: %llu passed, %llu failed, %llu skipped", vectors_files[i].path,
+               (unsigned long long)file_passed, (unsigned long long)file_failed, (unsigned long long)file_skipped);
+        if (first)
+        {
+            printf(" (first: \"%.*s\" %s)", (int)first->name_length, first->name, first->reason);
+        }
+        printf("\n");
+        passed += file_passed;
+        failed += file_failed;
+        skipped += file_skipped;
+    }
+
+    uint64_t total = passed + failed + skipped;
+    printf("%llu cases: %llu passed, %llu failed, %llu skipped (no handler) on %d threads in %.3f s, %.0f cases/s\n",
+           (unsigned long long)total, (unsigned long long)passed, (unsigned long long)failed,
+           (unsigned long long)skipped, started, elapsed, total / elapsed);
+    return failed ? 1 : 0;
+}
\ No newline at end of file